@@ -6,6 +6,15 @@
 
 #define COLLISION_MSG 30
 
+//How often the server sends snapshots and clients acknowledge them. Clients interpolate
+//between snapshots, so this only decides how up to date objects are, not how smoothly they move
+const float NETWORK_TICK_RATE	= 20.0f;
+//How far behind the server clients show objects - two ticks, so one lost packet still leaves
+//a state either side to interpolate between
+const float INTERPOLATION_DELAY	= 2.0f / NETWORK_TICK_RATE;
+//How long an object carries on at its last velocity once it's run out of states, before stopping
+const float MAX_EXTRAPOLATION	= 0.25f;
+
 struct MessagePacket : public GamePacket {
 	short playerID;
 	short messageID;
@@ -16,13 +25,26 @@ struct MessagePacket : public GamePacket {
 	}
 };
 
+//Sent reliably by the server to tell clients about a player joining or leaving, so that
+//they've made its NetworkObject, with the server's ID, before any snapshot mentions it
+struct PlayerPacket : public GamePacket {
+	short playerNum;
+	short networkID;
+
+	PlayerPacket(short type) : GamePacket(type) {
+		playerNum = 0;
+		networkID = -1;
+		size = sizeof(short) * 2;
+	}
+};
+
 NetworkedGame::NetworkedGame()	{
 	thisServer = nullptr;
 	thisClient = nullptr;
 
 	NetworkBase::Initialise();
-	timeToNextPacket  = 0.0f;
-	packetsToSnapshot = 0;
+	timeToNextPacket	= 0.0f;
+	serverTick			= 0;
 }
 
 NetworkedGame::~NetworkedGame()	{
@@ -34,6 +56,8 @@ void NetworkedGame::StartAsServer() {
 	thisServer = new GameServer(NetworkBase::GetDefaultPort(), 4);
 
 	thisServer->RegisterPacketHandler(Received_State, this);
+	thisServer->RegisterPacketHandler(Player_Connected, this);
+	thisServer->RegisterPacketHandler(Player_Disconnected, this);
 
 	StartLevel();
 }
@@ -44,9 +68,12 @@ void NetworkedGame::StartAsClient(char a, char b, char c, char d) {
 
 	thisClient->RegisterPacketHandler(Delta_State, this);
 	thisClient->RegisterPacketHandler(Full_State, this);
+	thisClient->RegisterPacketHandler(Snapshot_State, this);
 	thisClient->RegisterPacketHandler(Player_Connected, this);
 	thisClient->RegisterPacketHandler(Player_Disconnected, this);
 
+	receiver.SetTiming(NETWORK_TICK_RATE, INTERPOLATION_DELAY, MAX_EXTRAPOLATION);
+
 	StartLevel();
 }
 
@@ -59,7 +86,10 @@ void NetworkedGame::Update(float dt) {
 		else if (thisClient) {
 			UpdateAsClient(dt);
 		}
-		timeToNextPacket += 1.0f / 20.0f; //20hz server/client update
+		timeToNextPacket += 1.0f / NETWORK_TICK_RATE;
+	}
+	if (thisClient) {
+		receiver.Interpolate(dt, networkObjects);
 	}
 
 	if (!thisServer && Window::GetKeyboard()->KeyPressed(KeyboardKeys::F9)) {
@@ -73,74 +103,111 @@ void NetworkedGame::Update(float dt) {
 }
 
 void NetworkedGame::UpdateAsServer(float dt) {
-	packetsToSnapshot--;
-	if (packetsToSnapshot < 0) {
-		BroadcastSnapshot(false);
-		packetsToSnapshot = 5;
-	}
-	else {
-		BroadcastSnapshot(true);
-	}
+	BroadcastSnapshot();
 }
 
 void NetworkedGame::UpdateAsClient(float dt) {
 	ClientPacket newPacket;
+	newPacket.lastID = receiver.GetCompleteTick();
 
 	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::SPACE)) {
 		//fire button pressed!
 		newPacket.buttonstates[0] = 1;
-		newPacket.lastID = 0; //You'll need to work this out somehow...
 	}
 	thisClient->SendPacket(newPacket);
 }
 
-void NetworkedGame::BroadcastSnapshot(bool deltaFrame) {
+/*
+Every object records its state for the tick once, and then each client is sent its own
+snapshot of them, with deltas from whichever tick that client last acknowledged. Each
+client's snapshot goes into the same few packets, rather than a packet per object, so
+the per packet headers and sends are paid once per tick instead of once per object.
+
+A client with a player in the world only hears about what's near it, less often the
+further away it is; one without is sent everything, every tick.
+*/
+void NetworkedGame::BroadcastSnapshot() {
 	std::vector<GameObject*>::const_iterator first;
 	std::vector<GameObject*>::const_iterator last;
 
 	world->GetObjectIterators(first, last);
 
+	serverTick++;
+	replicated.clear();
 	for (auto i = first; i != last; ++i) {
 		NetworkObject* o = (*i)->GetNetworkObject();
 		if (!o) {
 			continue;
 		}
-		//TODO - you'll need some way of determining when a player has sent the server an acknowledgement and store the lastID somewhere. A map between player and an int could work, or it could be part of a NetworkPlayer struct. 
-		int playerState = 0;
-		GamePacket* newPacket = nullptr;
-		if (o->WritePacket(&newPacket, deltaFrame, playerState)) {
-			thisServer->SendGlobalPacket(*newPacket);
-			delete newPacket;
+		o->RecordState(serverTick);
+		replicated.push_back(o);
+	}
+	interest.Build(replicated);
+
+	for (int client : clients) {
+		candidates.clear();
+		auto player = serverPlayers.find(client);
+		if (player != serverPlayers.end() && player->second) {
+			interest.GetCandidates(player->second->GetTransform().GetPosition(), candidates);
+		}
+		else {
+			for (NetworkObject* o : replicated) {
+				candidates.push_back({ o, 1.0f });
+			}
+		}
+		snapshot.Build(client, serverTick, candidates);
+		for (int i = 0; i < snapshot.GetPacketCount(); ++i) {
+			thisServer->SendPacket(snapshot.GetPacket(i), client);
 		}
 	}
 }
 
-void NetworkedGame::UpdateMinimumState() {
-	//Periodically remove old data from the server
-	int minID = INT_MAX;
-	int maxID = 0; //we could use this to see if a player is lagging behind?
+NetworkPlayer* NetworkedGame::SpawnPlayer(int playerNum, int networkID) {
+	const float radius = 1.0f;
 
-	for (auto i : stateIDs) {
-		minID = min(minID, i.second);
-		maxID = max(maxID, i.second);
-	}
-	//every client has acknowledged reaching at least state minID
-	//so we can get rid of any old states!
-	std::vector<GameObject*>::const_iterator first;
-	std::vector<GameObject*>::const_iterator last;
-	world->GetObjectIterators(first, last);
+	NetworkPlayer* player = new NetworkPlayer(this, playerNum);
+	Vector3 sphereSize = Vector3(radius, radius, radius);
+	player->SetBoundingVolume((CollisionVolume*)new SphereVolume(radius), sphereSize);
 
-	for (auto i = first; i != last; ++i) {
-		NetworkObject* o = (*i)->GetNetworkObject();
-		if (!o) {
-			continue;
-		}
-		o->UpdateStateHistory(minID); //clear out old states so they arent taking up memory...
+	player->GetTransform()
+		.SetScale(sphereSize)
+		.SetPosition(Vector3(playerNum * 4.0f, 5.0f, 0.0f));
+
+	player->SetRenderObject(new RenderObject(&player->GetTransform(), sphereMesh, basicTex, basicShader));
+	player->SetPhysicsObject(new PhysicsObject(&player->GetTransform(), player->GetBoundingVolume()));
+	player->GetPhysicsObject()->SetInverseMass(1.0f);
+	player->GetPhysicsObject()->InitSphereInertia();
+
+	player->SetNetworkObject(new NetworkObject(*player, networkID));
+	if (networkID >= (int)networkObjects.size()) {
+		networkObjects.resize(networkID + 1, nullptr);
 	}
+	networkObjects[networkID] = player->GetNetworkObject();
+
+	world->AddGameObject(player);
+	return player;
 }
 
-void NetworkedGame::SpawnPlayer() {
+/*
+Tells a client (or every client, for -1) about a player, reliably, so it's there
+before the first snapshot the client gets with it in
+*/
+void NetworkedGame::SendPlayerSpawn(GameObject* player, int playerNum, int client) {
+	PlayerPacket packet(Player_Connected);
+	packet.playerNum = (short)playerNum;
+	packet.networkID = (short)player->GetNetworkObject()->GetNetworkID();
+	if (client < 0) {
+		thisServer->SendGlobalPacket(packet, true);
+	}
+	else {
+		thisServer->SendPacket(packet, client, true);
+	}
+}
 
+void NetworkedGame::RemovePlayer(GameObject* player) {
+	networkObjects[player->GetNetworkObject()->GetNetworkID()] = nullptr;
+	physics->RemoveCollisions(player);
+	world->RemoveGameObject(player, true);
 }
 
 void NetworkedGame::StartLevel() {
@@ -148,7 +215,71 @@ void NetworkedGame::StartLevel() {
 }
 
 void NetworkedGame::ReceivePacket(int type, GamePacket* payload, int source) {
-	
+	if (thisServer) {
+		if (type == Received_State) {
+			snapshot.Acknowledge(source, ((ClientPacket*)payload)->lastID);
+		}
+		else if (type == Player_Connected) {
+			//The new client hears about everyone already playing, then everyone hears about it.
+			//Network IDs aren't reused, so a client never mistakes a new player for an old one
+			for (auto& p : serverPlayers) {
+				SendPlayerSpawn(p.second, p.first, source);
+			}
+			snapshot.AddClient(source);
+			clients.push_back(source);
+			serverPlayers[source] = SpawnPlayer(source, (int)networkObjects.size());
+			SendPlayerSpawn(serverPlayers[source], source, -1);
+		}
+		else if (type == Player_Disconnected) {
+			snapshot.RemoveClient(source);
+			clients.erase(std::remove(clients.begin(), clients.end(), source), clients.end());
+
+			auto player = serverPlayers.find(source);
+			if (player != serverPlayers.end()) {
+				PlayerPacket packet(Player_Disconnected);
+				packet.playerNum = (short)source;
+				packet.networkID = (short)player->second->GetNetworkObject()->GetNetworkID();
+				thisServer->SendGlobalPacket(packet, true);
+
+				RemovePlayer(player->second);
+				serverPlayers.erase(player);
+			}
+		}
+		return;
+	}
+	if (type == Player_Connected) {
+		//Only the server simulates players - a client's copies are kinematic, and just
+		//go wherever the snapshots put them
+		PlayerPacket* packet = (PlayerPacket*)payload;
+		if (!FindNetworkObject(packet->networkID)) {
+			NetworkPlayer* player = SpawnPlayer(packet->playerNum, packet->networkID);
+			player->GetPhysicsObject()->SetBodyType(BodyType::Kinematic);
+			clientPlayers[packet->networkID] = player;
+		}
+	}
+	else if (type == Player_Disconnected) {
+		auto player = clientPlayers.find(((PlayerPacket*)payload)->networkID);
+		if (player != clientPlayers.end()) {
+			RemovePlayer(player->second);
+			clientPlayers.erase(player);
+		}
+	}
+	else if (type == Snapshot_State) {
+		receiver.Receive(*payload, networkObjects);
+	}
+	else if (type == Full_State || type == Delta_State) {
+		NetworkObject* o = FindNetworkObject(((StatePacket*)payload)->GetObjectID());
+		if (o) {
+			o->ReadPacket(*payload);
+		}
+	}
+}
+
+NetworkObject* NetworkedGame::FindNetworkObject(int objectID) const {
+	if (objectID < 0 || objectID >= (int)networkObjects.size()) {
+		return nullptr;
+	}
+	return networkObjects[objectID];
 }
 
 void NetworkedGame::OnPlayerCollision(NetworkPlayer* a, NetworkPlayer* b) {
@@ -1,6 +1,8 @@
 #pragma once
 #include "TutorialGame.h"
 #include "NetworkBase.h"
+#include "SnapshotReceiver.h"
+#include "InterestGrid.h"
 
 namespace NCL {
 	namespace GameDemo {
@@ -18,7 +20,9 @@ namespace NCL {
 
 			void Update(float dt) override;
 
-			void SpawnPlayer();
+			//Adds a player for a connected client to the world, replicated like everything else.
+			//Clients are told each player's network ID by the server, and spawn theirs with it
+			NetworkPlayer* SpawnPlayer(int playerNum, int networkID);
 
 			void StartLevel();
 
@@ -30,18 +34,28 @@ namespace NCL {
 			void UpdateAsServer(float dt);
 			void UpdateAsClient(float dt);
 
-			void BroadcastSnapshot(bool deltaFrame);
-			void UpdateMinimumState();
-			std::map<int, int> stateIDs;
+			void BroadcastSnapshot();
+			void SendPlayerSpawn(GameObject* player, int playerNum, int client);
+			void RemovePlayer(GameObject* player);
+			NetworkObject* FindNetworkObject(int objectID) const;
+
+			SnapshotBuilder		snapshot;
+			SnapshotReceiver	receiver;
+			std::vector<int>	clients;
+			InterestGrid		interest;
+			//Rebuilt every tick, but kept to save reallocating them
+			std::vector<NetworkObject*>				replicated;
+			std::vector<SnapshotBuilder::Candidate>	candidates;
 
 			GameServer* thisServer;
 			GameClient* thisClient;
 			float timeToNextPacket;
-			int packetsToSnapshot;
+			int serverTick;
 
-			std::vector<NetworkObject*> networkObjects;
+			std::vector<NetworkObject*> networkObjects;	//Indexed by network ID, with nullptr gaps
 
-			std::map<int, GameObject*> serverPlayers;
+			std::map<int, GameObject*> serverPlayers;	//By client, for the server to centre their interest on
+			std::map<int, GameObject*> clientPlayers;	//By network ID, as the server told this client about them
 			GameObject* localPlayer;
 		};
 	}
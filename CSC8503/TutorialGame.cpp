@@ -9,6 +9,7 @@
 #include "StateGameObject.h"
 
 #include <stack>
+#include <set>
 #include <corecrt_math_defines.h>
 #include <cmath>
 
@@ -105,6 +106,7 @@ void TutorialGame::InitGame() {
 		InitMap();
 		InitGameObjects();
 		InitDefaultFloor();
+		world->BakeStaticObjects(true);
 	}
 	catch (int i) {
 		switch (i) {
@@ -135,7 +137,8 @@ GameObject* TutorialGame::AddFloorToWorld(const Vector3& position) {
 	floor->SetColour(Vector4(0.5f, 0.5f, 0.5f, 1.0f));
 	floor->SetPhysicsObject(new PhysicsObject(&floor->GetTransform(), floor->GetBoundingVolume()));
 
-	floor->GetPhysicsObject()->SetInverseMass(0);
+	floor->GetPhysicsObject()->SetBodyType(BodyType::Static);
+	floor->SetCollisionLayers(LAYER_WALL);
 
 	world->AddGameObject(floor);
 
@@ -297,6 +300,118 @@ void TutorialGame::InitCubeGridWorld(int numRows, int numCols, float rowSpacing,
 	}
 }
 
+/*
+Fills the world with a loose lattice of spheres, so that the different broadphase
+containers can be compared against each other. Press B to enable the broadphase,
+and N to cycle between the containers - the pairs per second are shown on screen.
+*/
+void TutorialGame::InitBroadPhaseBenchmark(int numBodies) {
+	InitWorld();
+	selectionObject = nullptr;
+
+	int side = (int)ceil(cbrt((float)numBodies));
+	float spacing = 3.0f;
+	float radius = 1.0f;
+	Vector3 offset = Vector3(side * spacing * -0.5f, 5.0f, side * spacing * -0.5f);
+
+	int added = 0;
+	for (int y = 0; y < side && added < numBodies; ++y) {
+		for (int x = 0; x < side && added < numBodies; ++x) {
+			for (int z = 0; z < side && added < numBodies; ++z) {
+				AddSphereToWorld(offset + Vector3(x * spacing, y * spacing, z * spacing), radius, 1.0f);
+				added++;
+			}
+		}
+	}
+	InitDefaultFloor();
+	physics->UseBroadPhase(true);
+}
+
+/*
+Runs every integration kernel set the CPU supports over the same made up bodies,
+checking each one still matches the plain version, then times how many bodies each
+gets through per millisecond. Press F6 to run it - the results are shown on screen.
+*/
+void TutorialGame::IntegrationBenchmark() {
+	const int	bodyCount	= 100000;
+	const int	checkSteps	= 120;
+	const int	timedSteps	= 20;
+	const float tolerance	= 0.001f;
+
+	integrationResults.clear();
+	for (const PhysicsKernels* kernels : PhysicsKernels::GetAvailable()) {
+		float difference	= PhysicsKernels::Compare(PhysicsKernels::Scalar(), *kernels, 1003, checkSteps);
+		float bodiesPerMS	= PhysicsKernels::Benchmark(*kernels, bodyCount, timedSteps);
+
+		std::string line = std::string(kernels->name) + ": " + std::to_string((int)bodiesPerMS) + " bodies/ms";
+		line += (difference <= tolerance) ? ", matches scalar" : ", MISMATCH " + std::to_string(difference);
+		integrationResults.emplace_back(line);
+	}
+}
+
+/*
+Times the PairCache the collision lists are kept in against the std::set they used to
+be, over the same 10,000 made up contacts between the world's objects - pick a scene
+with plenty in first, like F4's. Each step clears the list, adds every pair, then looks
+each one up again, as the physics does. Press F11 to run it.
+*/
+void TutorialGame::PairCacheBenchmark() {
+	const int pairCount = 10000;
+	const int steps		= 50;
+
+	std::vector<GameObject*>::const_iterator first;
+	std::vector<GameObject*>::const_iterator last;
+	world->GetObjectIterators(first, last);
+	int objectCount = (int)(last - first);
+	if (objectCount < 2) {
+		return;
+	}
+
+	std::mt19937 random(1234);
+	std::vector<std::pair<GameObject*, GameObject*>> pairs;
+	pairs.reserve(pairCount);
+	for (int i = 0; i < pairCount; ++i) {
+		int indexA = random() % objectCount;
+		int indexB = (indexA + 1 + random() % (objectCount - 1)) % objectCount; //Never the same object
+		GameObject* a = *(first + indexA);
+		GameObject* b = *(first + indexB);
+		if (b->GetWorldID() < a->GetWorldID()) {
+			std::swap(a, b);
+		}
+		pairs.emplace_back(a, b);
+	}
+
+	int found = 0;
+	GameTimer timer;
+	PairCache<GameObject*, PairCacheEmpty, WorldIDPairKey> cache;
+	for (int s = 0; s < steps; ++s) {
+		cache.Clear();
+		for (const auto& pair : pairs) {
+			cache.Insert(pair.first, pair.second);
+		}
+		for (const auto& pair : pairs) {
+			found += cache.Find(pair.first, pair.second) ? 1 : 0;
+		}
+	}
+	timer.Tick();
+	cachePairsPerMS = (pairCount * (float)steps) / std::max(timer.GetTimeDeltaSeconds() * 1000.0f, 1e-6f);
+
+	std::set<std::pair<GameObject*, GameObject*>> set;
+	for (int s = 0; s < steps; ++s) {
+		set.clear();
+		for (const auto& pair : pairs) {
+			set.insert(pair);
+		}
+		for (const auto& pair : pairs) {
+			found += set.count(pair) ? 1 : 0;
+		}
+	}
+	timer.Tick();
+	setPairsPerMS = (pairCount * (float)steps) / std::max(timer.GetTimeDeltaSeconds() * 1000.0f, 1e-6f);
+
+	std::cout << "Pair benchmark found " << found << " of " << pairCount * steps * 2 << " pairs" << std::endl;
+}
+
 void TutorialGame::SelectGameMode() {
 	string text = "1. Test Mode.";
 	Debug::Print(text, Vector2(35, 30), Debug::GREEN);
@@ -351,6 +466,29 @@ void TutorialGame::UpdateTest(float dt) {
 		Debug::Print("(G)ravity off", Vector2(5, 95), Debug::RED);
 	}
 
+	float broadTime = physics->GetBroadPhaseTime();
+	if (broadTime > 0.0f) {
+		int pairsPerSecond = (int)(physics->GetBroadPhasePairCount() / broadTime);
+		Debug::Print("Broadphase " + std::to_string((int)physics->GetBroadPhaseType()) + ": " + std::to_string(pairsPerSecond) + " pairs/s", Vector2(5, 85), Debug::YELLOW);
+	}
+
+	float integrationTime = physics->GetIntegrationTime();
+	if (integrationTime > 0.0f) {
+		int bodiesPerMS = (int)(physics->GetIntegratedBodyCount() / (integrationTime * 1000.0f));
+		Debug::Print(std::string("(M) Integrator ") + physics->GetIntegrationKernels().name + ": " + std::to_string(bodiesPerMS) + " bodies/ms", Vector2(5, 80), Debug::YELLOW);
+	}
+	for (int i = 0; i < (int)integrationResults.size(); ++i) {
+		Debug::Print("(F6) " + integrationResults[i], Vector2(5, 60.0f - i * 5.0f), Debug::YELLOW);
+	}
+	if (0.0f < cachePairsPerMS) {
+		Debug::Print("(F11) Pairs/ms cache: " + std::to_string((int)cachePairsPerMS) + " std::set: " + std::to_string((int)setPairsPerMS), Vector2(5, 40), Debug::YELLOW);
+	}
+	const StepScheduler& scheduler = physics->GetScheduler();
+	Debug::Print("(I/O) Solver iterations: " + std::to_string(scheduler.GetIterationCount()) + ", over budget: " + StepScheduler::GetStageName(scheduler.GetOverBudgetStage()), Vector2(5, 65), Debug::YELLOW);
+	float listTime = physics->GetCollisionListTime();
+	Debug::Print("Collision list: " + std::to_string(physics->GetCollisionListSize()) + " pairs, " + std::to_string(listTime * 1000.0f) + "ms", Vector2(5, 70), Debug::YELLOW);
+	Debug::Print("Awake bodies: " + std::to_string(world->GetBodyStore().GetAwakeCount()) + "/" + std::to_string(world->GetBodyStore().GetBodyCount()), Vector2(5, 75), Debug::YELLOW);
+
 	RayCast();
 	SelectObject();
 	MoveSelectedObject();
@@ -400,6 +538,22 @@ void TutorialGame::UpdateKeys() {
 		InitCamera(); //F2 will reset the camera to a specific default place
 	}
 
+	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::F3)) {
+		InitBroadPhaseBenchmark(1000);
+	}
+	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::F4)) {
+		InitBroadPhaseBenchmark(10000);
+	}
+	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::F5)) {
+		InitBroadPhaseBenchmark(50000);
+	}
+	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::F6)) {
+		IntegrationBenchmark();
+	}
+	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::F11)) {
+		PairCacheBenchmark();
+	}
+
 	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::G)) {
 		useGravity = !useGravity; //Toggle gravity!
 		physics->UseGravity(useGravity);
@@ -431,6 +585,9 @@ void TutorialGame::UpdateGameKeys() {
 	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::G)) {
 		gameover = !gameover;
 	}
+	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::R)) {
+		RayBenchmark();
+	}
 }
 
 bool TutorialGame::UpdateCountdown(float dt) {
@@ -512,7 +669,7 @@ bool TutorialGame::SelectObject() {
 
 		if (Window::GetMouse()->ButtonDown(NCL::MouseButtons::LEFT)) {
 			if (selectionObject) {	//set colour to deselected;
-				selectionObject->GetRenderObject()->SetColour(Vector4(1, 1, 1, 1));
+				selectionObject->SetColour(Vector4(1, 1, 1, 1));
 				selectionObject = nullptr;
 			}
 
@@ -522,7 +679,7 @@ bool TutorialGame::SelectObject() {
 			if (world->Raycast(ray, closestCollision, true)) {
 				selectionObject = (GameObject*)closestCollision.node;
 
-				selectionObject->GetRenderObject()->SetColour(Vector4(0, 1, 0, 1));
+				selectionObject->SetColour(Vector4(0, 1, 0, 1));
 				return true;
 			}
 			else {
@@ -560,11 +717,11 @@ void TutorialGame::RayCast() {
 
 		if (world->Raycast(r, closestCollision, true, selectionObject)) {
 			if (objClosest) {
-				objClosest->GetRenderObject()->SetColour(Vector4(1, 1, 1, 1));
+				objClosest->SetColour(Vector4(1, 1, 1, 1));
 			}
 			objClosest = (GameObject*)closestCollision.node;
 
-			objClosest->GetRenderObject()->SetColour(Vector4(1, 0, 1, 1));
+			objClosest->SetColour(Vector4(1, 0, 1, 1));
 		}
 	}
 
@@ -715,6 +872,10 @@ GameObject* TutorialGame::AddWallToWorld(const Vector3& position, Vector3 dimens
 	//cube->GetPhysicsObject()->SetFriction(0.5f);
 	cube->GetPhysicsObject()->SetInverseMass(inverseMass);
 	cube->GetPhysicsObject()->InitCubeInertia();
+	if (inverseMass == 0.0f) {
+		cube->GetPhysicsObject()->SetBodyType(BodyType::Static);
+	}
+	cube->SetCollisionLayers(LAYER_WALL);
 
 	world->AddGameObject(cube);
 
@@ -737,6 +898,7 @@ GameEnemy* TutorialGame::AddEnemyToWorld(const Vector3& position) {
 
 	character->GetPhysicsObject()->SetInverseMass(inverseMass);
 	character->GetPhysicsObject()->SetFriction(ENEMY_FRICTION);
+	character->SetCollisionLayers(LAYER_ENEMY);
 	character->SetColour(ENEMY_DEFAULT_COLOUR);
 
 	world->AddGameObject(character);
@@ -761,6 +923,7 @@ GamePlayer* TutorialGame::AddPlayerToWorld(const Vector3& position) {
 
 	character->GetPhysicsObject()->SetInverseMass(inverseMass);
 	character->GetPhysicsObject()->SetElasticity(0.8f);
+	character->SetCollisionLayers(LAYER_PLAYER);
 	character->SetOriginPosition(position);
 
 	world->AddGameObject(character);
@@ -780,6 +943,8 @@ GameBall* TutorialGame::AddBallToWorld(const Vector3& position) {
 
 	ball->GetPhysicsObject()->SetInverseMass(1.0f);
 	ball->GetPhysicsObject()->InitCubeInertia();
+	ball->GetPhysicsObject()->SetContinuous(true); //Kicks are fast enough to go through thin walls
+	ball->SetCollisionLayers(LAYER_BALL);
 	ball->SetColour(Vector4(1, 1, 0, 1));
 	ball->SetOriginPosition(position);
 
@@ -802,9 +967,9 @@ GameObject* TutorialGame::AddGoalTargetToWorld(const Vector3& position) {
 	goal->SetPhysicsObject(new PhysicsObject(&goal->GetTransform(), goal->GetBoundingVolume()));
 
 	//cannot move
-	goal->GetPhysicsObject()->SetInverseMass(0.0f);
+	goal->GetPhysicsObject()->SetBodyType(BodyType::Static);
 	goal->GetPhysicsObject()->SetElasticity(0.0f);
-	goal->GetPhysicsObject()->InitSphereInertia();
+	goal->SetCollisionLayers(LAYER_WALL);
 
 	//set colour
 	goal->SetColour(Vector4(0, 1, 1, 1));
@@ -827,6 +992,8 @@ GameObject* TutorialGame::AddGoalDeocrationToWorld(const Vector3& position) {
 
 	doc->GetPhysicsObject()->SetInverseMass(0.2f);
 	doc->GetPhysicsObject()->InitSphereInertia();
+	//decorations don't bump into each other
+	doc->SetCollisionLayers(LAYER_DECORATION, ALL_COLLISION_LAYERS & ~LAYER_DECORATION);
 	doc->SetColour(Vector4(0, 1, 1, 1));
 	//add
 	if (goalObject != nullptr) {
@@ -883,6 +1050,8 @@ void TutorialGame::PlayerObjectMovement(float dt) {
 	Quaternion orientation = transform.GetOrientation();
 	orientation = orientation + (Quaternion(Vector3(0, -dirVal * playerObject->GetTurnSpeed(), 0), 0.0f) * orientation);
 	transform.SetOrientation(orientation.Normalised());
+	//the player is moved by hand rather than by forces, so has to be woken up explicitly
+	playerObject->GetPhysicsObject()->Wake();
 	//linear
 	float speed = 0.0f;
 	auto speedUp = [&]() {
@@ -924,32 +1093,42 @@ void TutorialGame::UpdatePlayerState(float dt) {
 	playerObject->Update(dt);
 }
 
-//check for position in enemy's view
-//@param pos - player's position
-//@param enemy - enemy object
-bool TutorialGame::CheckPositionInEnemyView(Vector3 pos, GameEnemy* enemy) {
-	if (!enemy) { return false; }
-	if (!enemy->CheckPositionInView(pos)) { return false; }
-	//check for objects blocking the vie
-	Vector3 enemyPos = enemy->GetTransform().GetPosition();
-	Vector3 vecEtoP = pos - enemyPos;
-	float dist = NCL::Maths::Distance(enemyPos, pos);
-	vector<GameObject*> objects;
-	world->GetObjectsInTargetView(objects, enemyPos, vecEtoP, dist);
-	auto ray = Ray(enemyPos, vecEtoP.Normalised());
-	RayCollision collision;
-	for (auto object : objects) {
-		if (CollisionDetection::RayIntersection(ray, *object, collision)) {
-			return false;
-		}
-	}
-	return true;
-}
-
+/*
+Every enemy that could see the player, if nothing was in the way, gets a ray towards
+the player, and they're all cast together. An enemy can see the player if its ray
+doesn't hit anything before it gets there - the player and other enemies are
+masked out of the rays, so enemies don't block each other's view.
+*/
 void TutorialGame::UpdateEnemyState(float dt) {
 	Vector3 playerPos = playerObject->GetTransform().GetPosition();
-	for (auto enemy : enemyObjects) {
-		if (CheckPositionInEnemyView(playerPos, enemy)) {
+
+	const unsigned int sightLayers = ALL_COLLISION_LAYERS & ~(LAYER_PLAYER | LAYER_ENEMY);
+
+	sightRays.clear();
+	sightEnemies.clear();
+	for (int i = 0; i < (int)enemyObjects.size(); ++i) {
+		if (!enemyObjects[i]->CheckPositionInView(playerPos)) {
+			continue;
+		}
+		Vector3 enemyPos = enemyObjects[i]->GetTransform().GetPosition();
+		sightRays.emplace_back(enemyPos, (playerPos - enemyPos).Normalised());
+		sightEnemies.push_back(i);
+	}
+	sightCollisions.resize(sightRays.size());
+	world->RaycastBatch(sightRays.data(), (int)sightRays.size(), sightCollisions.data(),
+		FLT_MAX, nullptr, 0, sightLayers);
+
+	int sightRay = 0;
+	for (int i = 0; i < (int)enemyObjects.size(); ++i) {
+		GameEnemy* enemy = enemyObjects[i];
+		bool canSee = false;
+		if (sightRay < (int)sightEnemies.size() && sightEnemies[sightRay] == i) {
+			const RayCollision& collision = sightCollisions[sightRay];
+			canSee = !collision.node ||
+				collision.rayDistance > NCL::Maths::Distance(enemy->GetTransform().GetPosition(), playerPos);
+			sightRay++;
+		}
+		if (canSee) {
 			if (!enemy->TrackingPlayer()) {
 				enemy->SetColour(Vector4(1.0f, 0.0f, 0.0f, 1.0f)); //become red
 			}
@@ -970,6 +1149,40 @@ void TutorialGame::UpdateEnemyState(float dt) {
 	}
 }
 
+/*
+Casts a few thousand rays from around the maze in random flat directions, first one
+at a time through Raycast, then all together through RaycastBatch, and shows how many
+rays per second each managed. The rays come from a fixed seed, so runs can be compared.
+*/
+void TutorialGame::RayBenchmark() {
+	const int rayCount = 4096;
+	float nodeSize	= (float)mapPathFinding->GetNodeSize();
+	float mapWidth	= sqrt((float)mapPathFinding->GetMapSize()) * nodeSize;
+
+	std::mt19937 random(1234);
+	auto nextFloat = [&]() {
+		return (float)random() / (float)random.max();
+	};
+	std::vector<Ray> rays;
+	rays.reserve(rayCount);
+	for (int i = 0; i < rayCount; ++i) {
+		float angle = nextFloat() * 2.0f * (float)M_PI;
+		Vector3 origin(nextFloat() * mapWidth, nodeSize, nextFloat() * mapWidth);
+		rays.emplace_back(origin, Vector3(cos(angle), 0.0f, sin(angle)));
+	}
+	std::vector<RayCollision> collisions(rayCount);
+
+	GameTimer timer;
+	for (int i = 0; i < rayCount; ++i) {
+		world->Raycast(rays[i], collisions[i], true);
+	}
+	timer.Tick();
+	singleRaysPerSecond = rayCount / std::max(timer.GetTimeDeltaSeconds(), 1e-6f);
+
+	world->RaycastBatch(rays.data(), rayCount, collisions.data());
+	timer.Tick();
+	batchRaysPerSecond = rayCount / std::max(timer.GetTimeDeltaSeconds(), 1e-6f);
+}
 
 bool TutorialGame::KickBall() {
 	if (!playerObject->CheckCatchBall()) {
@@ -984,6 +1197,7 @@ bool TutorialGame::KickBall() {
 		//higher amend
 		transPos.y += 1.0f;
 		ballObject->GetTransform().SetPosition(transPos);
+		ballObject->GetPhysicsObject()->Wake();
 		//change force;
 		if (Window::GetKeyboard()->KeyHeld(KeyboardKeys::E)) { ballObject->IncreaseForce(100.0f); }
 		else if (Window::GetKeyboard()->KeyHeld(KeyboardKeys::Q)) { ballObject->DecreaseForce(100.0f); }
@@ -1044,21 +1258,21 @@ void TutorialGame::CheckPlayerDead() {
 		gameover = true; 
 		return;
 	}
-	CollisionDetection::CollisionInfo collision;
-	for (auto& i : enemyObjects) {
-		GameEnemy* enemy = i;
-		if (!enemy->TrackingPlayer()) { continue; }
-		if (CollisionDetection::ObjectIntersection(enemy, playerObject, collision)) {
-			if (playerObject->CheckCatchBall()) {
-				//take the ball
-				auto cons = playerObject->LostBall();
-				world->RemoveConstraint(cons, true);
-				//put ball back
-				ballObject->Reset();
-			}
-			//player dead
-			playerObject->Revive();
+	//only the objects touching the player need checking
+	GameObject* touching[16];
+	int touchCount = world->OverlapObject(playerObject, touching, 16);
+	for (int i = 0; i < touchCount; ++i) {
+		auto enemy = std::find(enemyObjects.begin(), enemyObjects.end(), touching[i]);
+		if (enemy == enemyObjects.end() || !(*enemy)->TrackingPlayer()) { continue; }
+		if (playerObject->CheckCatchBall()) {
+			//take the ball
+			auto cons = playerObject->LostBall();
+			world->RemoveConstraint(cons, true);
+			//put ball back
+			ballObject->Reset();
 		}
+		//player dead
+		playerObject->Revive();
 	}
 }
 
@@ -1090,6 +1304,10 @@ void TutorialGame::UpdateScreenInfo(float dt) {
 		Debug::Print("Goal !!!!!", Vector2(40, 40), Debug::RED);
 		goalTime -= dt;
 	}
+	//ray benchmark
+	if (0.0f < batchRaysPerSecond) {
+		Debug::Print("(R) Rays/s single: " + std::to_string((int)singleRaysPerSecond) + " batch: " + std::to_string((int)batchRaysPerSecond), Vector2(5, 85), Debug::YELLOW);
+	}
 	//Operation
 	//print player info
 	string text;
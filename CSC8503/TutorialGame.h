@@ -20,6 +20,13 @@ namespace NCL {
 		const int GAME_MODE_START = 2;
 		const float COUNT_DOWN_TIME = 3.0f;
 
+		//Collision layers - anything not given one stays on DEFAULT_COLLISION_LAYER
+		const unsigned int LAYER_WALL		= 1 << 1;
+		const unsigned int LAYER_PLAYER		= 1 << 2;
+		const unsigned int LAYER_ENEMY		= 1 << 3;
+		const unsigned int LAYER_BALL		= 1 << 4;
+		const unsigned int LAYER_DECORATION	= 1 << 5;
+
 		class TutorialGame		{
 		public:
 			TutorialGame();
@@ -51,6 +58,9 @@ namespace NCL {
 			void InitMixedGridWorld(int numRows, int numCols, float rowSpacing, float colSpacing);
 			void InitCubeGridWorld(int numRows, int numCols, float rowSpacing, float colSpacing, const Vector3& cubeDims);
 			void InitDefaultFloor();
+			void InitBroadPhaseBenchmark(int numBodies);
+			void IntegrationBenchmark();
+			void PairCacheBenchmark();
 
 			void UpdateTest(float dt);
 			void UpdateGame(float dt);
@@ -90,12 +100,12 @@ namespace NCL {
 			void InitMap();
 			void CheckBallState();
 			void UpdatePlayerState(float dt);
-			bool CheckPositionInEnemyView(Vector3 pos, GameEnemy* enemy);
 			void UpdateEnemyState(float dt);
 			bool CheckPlayerInEnemyView(GameEnemy* enemy);
 			bool KickBall();
 			bool Goal();
 			void CheckPlayerDead();
+			void RayBenchmark();
 
 
 #ifdef USEVULKAN
@@ -147,6 +157,20 @@ namespace NCL {
 			GameObject* goalObject = nullptr;
 			GamePlayer* playerObject = nullptr;
 			std::vector<GameEnemy*> enemyObjects ;
+
+			//Enemy line of sight rays, kept between frames so they aren't reallocated every frame
+			std::vector<Ray>			sightRays;
+			std::vector<RayCollision>	sightCollisions;
+			std::vector<int>			sightEnemies;
+
+			float singleRaysPerSecond	= 0.0f;
+			float batchRaysPerSecond	= 0.0f;
+
+			//One line per integration kernel set, from the last IntegrationBenchmark
+			std::vector<std::string> integrationResults;
+
+			float cachePairsPerMS	= 0.0f;
+			float setPairsPerMS		= 0.0f;
 		};
 	}
 }
@@ -0,0 +1,552 @@
+#pragma once
+#include "BoxTests.h"
+
+namespace NCL {
+	using namespace NCL::Maths;
+	namespace GameDemo {
+		const int AABB_TREE_NULL_NODE = -1;
+		//The tree is kept balanced, so walking it never needs more than this many nodes waiting
+		const int AABB_TREE_STACK_SIZE = 64;
+
+		/*
+		A node of the dynamic AABB tree. Nodes live in a single vector owned by the
+		tree and refer to each other by index, so growing the tree never calls new
+		for individual nodes. Leaves hold the 'fat' box used by the tree, plus the
+		tight box the object actually occupies, which is used for the final pair test.
+		Branches hold every layer and mask bit of the leaves below them, and whether
+		any of those leaves are dynamic.
+		*/
+		template<class T>
+		struct AABBTreeNode {
+			Vector3 fatMin;
+			Vector3 fatMax;
+			Vector3 tightMin;
+			Vector3 tightMax;
+
+			int parent	= AABB_TREE_NULL_NODE;	//doubles as the free list link
+			int left	= AABB_TREE_NULL_NODE;
+			int right	= AABB_TREE_NULL_NODE;
+			int height	= -1;					//-1 marks a free node
+			int stamp	= 0;
+
+			unsigned int	layers	= 0xFFFFFFFF;
+			unsigned int	mask	= 0xFFFFFFFF;
+			bool			dynamic = true;
+
+			T object = T();
+
+			bool IsLeaf() const {
+				return left == AABB_TREE_NULL_NODE;
+			}
+		};
+
+		/*
+		A persistent bounding volume hierarchy for the broadphase. Unlike the QuadTree,
+		which is rebuilt from scratch every step, objects stay in this tree between
+		steps. Each leaf is 'fattened' by a margin, and an object only has to be removed
+		and reinserted once it moves out of that fat box, so resting objects cost nothing
+		beyond a containment test. Insertion picks a sibling using the surface area
+		heuristic, and the tree is kept balanced with AVL style rotations.
+		*/
+		template<class T>
+		class AABBTree : protected BoxTests {
+		public:
+			typedef std::function<void(T&, T&)> AABBTreePairFunc;
+
+			AABBTree(float fatMargin = 0.5f) {
+				margin		= fatMargin;
+				root		= AABB_TREE_NULL_NODE;
+				freeList	= AABB_TREE_NULL_NODE;
+				leafCount	= 0;
+			}
+			~AABBTree() {
+			}
+
+			void Clear() {
+				nodes.clear();
+				root		= AABB_TREE_NULL_NODE;
+				freeList	= AABB_TREE_NULL_NODE;
+				leafCount	= 0;
+			}
+
+			int Insert(T object, const Vector3& pos, const Vector3& halfSize) {
+				int leaf = AllocateNode();
+				AABBTreeNode<T>& n = nodes[leaf];
+				n.object	= object;
+				n.height	= 0;
+				n.tightMin	= pos - halfSize;
+				n.tightMax	= pos + halfSize;
+				n.fatMin	= n.tightMin - Vector3(margin, margin, margin);
+				n.fatMax	= n.tightMax + Vector3(margin, margin, margin);
+
+				InsertLeaf(leaf);
+				leafCount++;
+				return leaf;
+			}
+
+			void Remove(int proxy) {
+				RemoveLeaf(proxy);
+				FreeNode(proxy);
+				leafCount--;
+			}
+
+			//Returns true if the object left its fat box and had to be reinserted
+			bool Update(int proxy, const Vector3& pos, const Vector3& halfSize) {
+				AABBTreeNode<T>& n = nodes[proxy];
+				n.tightMin = pos - halfSize;
+				n.tightMax = pos + halfSize;
+
+				if (Contains(n.fatMin, n.fatMax, n.tightMin, n.tightMax)) {
+					return false;
+				}
+				RemoveLeaf(proxy);
+				nodes[proxy].fatMin = nodes[proxy].tightMin - Vector3(margin, margin, margin);
+				nodes[proxy].fatMax = nodes[proxy].tightMax + Vector3(margin, margin, margin);
+				InsertLeaf(proxy);
+				return true;
+			}
+
+			//A proxy handle is only trusted if it still refers to a leaf holding this object
+			bool IsValid(int proxy, const T& object) const {
+				if (proxy < 0 || proxy >= (int)nodes.size()) {
+					return false;
+				}
+				const AABBTreeNode<T>& n = nodes[proxy];
+				return n.height == 0 && n.object == object;
+			}
+
+			/*
+			Gives a leaf collision layers and a mask, and says whether it's dynamic. Two
+			leaves are only paired if each is in a layer the other's mask has, and at least
+			one of them is dynamic - and as every branch knows what's below it, whole
+			branches of static objects, or of layers that can't collide, are skipped at once.
+			*/
+			void SetFilter(int proxy, unsigned int layers, unsigned int mask, bool dynamic) {
+				AABBTreeNode<T>& n = nodes[proxy];
+				if (n.layers == layers && n.mask == mask && n.dynamic == dynamic) {
+					return;
+				}
+				n.layers	= layers;
+				n.mask		= mask;
+				n.dynamic	= dynamic;
+				for (int i = n.parent; i != AABB_TREE_NULL_NODE; i = nodes[i].parent) {
+					RefitNode(i);
+				}
+			}
+
+			void SetStamp(int proxy, int stamp) {
+				nodes[proxy].stamp = stamp;
+			}
+
+			//Removes every leaf that wasn't stamped with the given value - used to drop
+			//objects that have been removed from the world since the last update
+			void RemoveStale(int stamp) {
+				for (int i = 0; i < (int)nodes.size(); ++i) {
+					if (nodes[i].height == 0 && nodes[i].stamp != stamp) {
+						Remove(i);
+					}
+				}
+			}
+
+			int GetLeafCount() const {
+				return leafCount;
+			}
+
+			/*
+			Calls func once for every pair of leaves whose tight boxes overlap. Rather than
+			querying the tree once per leaf, the tree is tested against itself: every internal
+			node tests its two subtrees against each other, and pairs of subtrees that don't
+			overlap, or can't have any pairs in them that pass SetFilter's rules, are thrown
+			away in one go. Each pair of leaves is only reached once.
+			*/
+			void OperateOnPairs(AABBTreePairFunc func) {
+				if (root == AABB_TREE_NULL_NODE) {
+					return;
+				}
+				pairStack.clear();
+				for (int i = 0; i < (int)nodes.size(); ++i) {
+					if (nodes[i].height > 0 && nodes[i].dynamic && CanPair(nodes[nodes[i].left], nodes[nodes[i].right])) {
+						pairStack.emplace_back(nodes[i].left, nodes[i].right);
+					}
+				}
+				while (!pairStack.empty()) {
+					std::pair<int, int> p = pairStack.back();
+					pairStack.pop_back();
+
+					const AABBTreeNode<T>& a = nodes[p.first];
+					const AABBTreeNode<T>& b = nodes[p.second];
+					if (!CanPair(a, b) || !Overlaps(a.fatMin, a.fatMax, b.fatMin, b.fatMax)) {
+						continue;
+					}
+					if (a.IsLeaf() && b.IsLeaf()) {
+						if (Overlaps(a.tightMin, a.tightMax, b.tightMin, b.tightMax)) {
+							func(nodes[p.first].object, nodes[p.second].object);
+						}
+					}
+					else if (b.IsLeaf() || (!a.IsLeaf() && a.height >= b.height)) {
+						pairStack.emplace_back(a.left, p.second);
+						pairStack.emplace_back(a.right, p.second);
+					}
+					else {
+						pairStack.emplace_back(p.first, b.left);
+						pairStack.emplace_back(p.first, b.right);
+					}
+				}
+			}
+
+			/*
+			Walks down every branch whose box passes test, calling func on the object of
+			each leaf whose tight box passes it too. test is given a box's min and max
+			corners, and func returns false to end the walk there. Everything is on the
+			stack, so nothing is allocated however many objects are found.
+			*/
+			template<class Test, class F>
+			void Traverse(Test test, F func) const {
+				if (root == AABB_TREE_NULL_NODE) {
+					return;
+				}
+				int stack[AABB_TREE_STACK_SIZE];
+				int count = 0;
+				stack[count++] = root;
+				while (count > 0) {
+					const AABBTreeNode<T>& n = nodes[stack[--count]];
+					if (n.IsLeaf()) {
+						if (test(n.tightMin, n.tightMax) && !func(n.object)) {
+							return;
+						}
+					}
+					else if (test(n.fatMin, n.fatMax)) {
+						stack[count++] = n.left;
+						stack[count++] = n.right;
+					}
+				}
+			}
+
+			//Calls func on every object whose tight box overlaps the given box, until it returns false
+			template<class F>
+			void Query(const Vector3& boxMin, const Vector3& boxMax, F func) const {
+				Traverse(
+					[&](const Vector3& nodeMin, const Vector3& nodeMax) {
+						return Overlaps(nodeMin, nodeMax, boxMin, boxMax);
+					},
+					func);
+			}
+
+			/*
+			Walks the tree along a ray, calling func on each object whose tight box the ray
+			passes through, before it's gone maxDistance. func is given the object and how
+			far along the ray the closest hit so far is, and returns the new closest hit - so
+			once something's been hit, everything behind it is skipped. Returning a negative
+			distance ends the walk straight away. The nearer child of each node is visited
+			first, so the closest hits tend to be found early on.
+			*/
+			template<class F>
+			void Raycast(const Vector3& origin, const Vector3& direction, float maxDistance, F func) const {
+				Sweep(origin, direction, Vector3(), maxDistance, func);
+			}
+
+			//Raycast for a box of the given half size moved along the ray - every box in the
+			//tree is grown by the moving box's size, which leaves a ray to cast against it
+			template<class F>
+			void Sweep(const Vector3& origin, const Vector3& direction, const Vector3& halfSize, float maxDistance, F func) const {
+				if (root == AABB_TREE_NULL_NODE) {
+					return;
+				}
+				Vector3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+				int		stack[AABB_TREE_STACK_SIZE];
+				float	entries[AABB_TREE_STACK_SIZE];
+				int		count = 0;
+
+				float entry;
+				if (RayBox(origin, inverse, maxDistance, nodes[root].fatMin - halfSize, nodes[root].fatMax + halfSize, entry)) {
+					stack[count]	= root;
+					entries[count]	= entry;
+					count++;
+				}
+				while (count > 0) {
+					count--;
+					if (entries[count] > maxDistance) {
+						continue;
+					}
+					const AABBTreeNode<T>& n = nodes[stack[count]];
+					if (n.IsLeaf()) {
+						if (RayBox(origin, inverse, maxDistance, n.tightMin - halfSize, n.tightMax + halfSize, entry)) {
+							maxDistance = func(n.object, maxDistance);
+							if (maxDistance < 0.0f) {
+								return;
+							}
+						}
+						continue;
+					}
+					float leftEntry;
+					float rightEntry;
+					bool hitLeft	= RayBox(origin, inverse, maxDistance, nodes[n.left].fatMin - halfSize, nodes[n.left].fatMax + halfSize, leftEntry);
+					bool hitRight	= RayBox(origin, inverse, maxDistance, nodes[n.right].fatMin - halfSize, nodes[n.right].fatMax + halfSize, rightEntry);
+					//The nearer child goes on last, so it comes off first
+					bool leftFirst = leftEntry <= rightEntry;
+					if (hitLeft && hitRight) {
+						stack[count]		= leftFirst ? n.right : n.left;
+						entries[count]		= leftFirst ? rightEntry : leftEntry;
+						stack[count + 1]	= leftFirst ? n.left : n.right;
+						entries[count + 1]	= leftFirst ? leftEntry : rightEntry;
+						count += 2;
+					}
+					else if (hitLeft || hitRight) {
+						stack[count]	= hitLeft ? n.left : n.right;
+						entries[count]	= hitLeft ? leftEntry : rightEntry;
+						count++;
+					}
+				}
+			}
+
+			/*
+			The same walk as Raycast, but for up to AABB_TREE_PACKET_SIZE rays at once, with
+			each node's box tested against all of them together in one set of SSE registers.
+			Rays fired from about the same place in about the same direction - an enemy's
+			line of sight, or a spread of rays from the camera - mostly go down the same
+			branches, so each node is only fetched once for the whole packet.
+
+			func is given the object and a bitmask of which rays hit its tight box, and
+			should shorten the maxDistances of any of those rays that hit the object itself.
+			*/
+			template<class F>
+			void RaycastPacket(const Vector3* origins, const Vector3* directions, float* maxDistances, int rayCount, F func) const {
+				if (root == AABB_TREE_NULL_NODE || rayCount <= 0) {
+					return;
+				}
+				RayPacket packet = MakeRayPacket(origins, directions, maxDistances, rayCount);
+
+				int		stack[AABB_TREE_STACK_SIZE];
+				int		count = 0;
+				__m128	entry;
+				if (RayPacketBox(packet, nodes[root].fatMin, nodes[root].fatMax, entry)) {
+					stack[count++] = root;
+				}
+				while (count > 0) {
+					const AABBTreeNode<T>& n = nodes[stack[--count]];
+					if (n.IsLeaf()) {
+						//Rays may have been shortened since this node went on the stack
+						int mask = RayPacketBox(packet, n.tightMin, n.tightMax, entry);
+						if (mask) {
+							func(n.object, mask);
+							SetPacketDistances(packet, maxDistances, rayCount);
+						}
+						continue;
+					}
+					__m128 leftEntry;
+					__m128 rightEntry;
+					int leftMask	= RayPacketBox(packet, nodes[n.left].fatMin, nodes[n.left].fatMax, leftEntry);
+					int rightMask	= RayPacketBox(packet, nodes[n.right].fatMin, nodes[n.right].fatMax, rightEntry);
+					if (leftMask && rightMask) {
+						//Whichever child the packet reaches first, on average, comes off the stack first
+						__m128 difference	= _mm_sub_ps(leftEntry, rightEntry);
+						int leftNearer		= _mm_movemask_ps(_mm_cmplt_ps(difference, _mm_setzero_ps())) & leftMask & rightMask;
+						int rightNearer		= _mm_movemask_ps(_mm_cmpgt_ps(difference, _mm_setzero_ps())) & leftMask & rightMask;
+						bool leftFirst		= PopCount(leftNearer) >= PopCount(rightNearer);
+						stack[count++] = leftFirst ? n.right : n.left;
+						stack[count++] = leftFirst ? n.left : n.right;
+					}
+					else if (leftMask || rightMask) {
+						stack[count++] = leftMask ? n.left : n.right;
+					}
+				}
+			}
+
+		protected:
+			static bool CanPair(const AABBTreeNode<T>& a, const AABBTreeNode<T>& b) {
+				return (a.dynamic || b.dynamic) && (a.layers & b.mask) && (b.layers & a.mask);
+			}
+
+			int AllocateNode() {
+				if (freeList == AABB_TREE_NULL_NODE) {
+					nodes.emplace_back();
+					return (int)nodes.size() - 1;
+				}
+				int index	= freeList;
+				freeList	= nodes[index].parent;
+				nodes[index] = AABBTreeNode<T>();
+				return index;
+			}
+
+			void FreeNode(int index) {
+				nodes[index].parent = freeList;
+				nodes[index].height = -1;
+				nodes[index].object = T();
+				freeList = index;
+			}
+
+			void RefitNode(int index) {
+				AABBTreeNode<T>& n = nodes[index];
+				n.fatMin = Min(nodes[n.left].fatMin, nodes[n.right].fatMin);
+				n.fatMax = Max(nodes[n.left].fatMax, nodes[n.right].fatMax);
+				n.height = 1 + std::max(nodes[n.left].height, nodes[n.right].height);
+
+				n.layers	= nodes[n.left].layers | nodes[n.right].layers;
+				n.mask		= nodes[n.left].mask | nodes[n.right].mask;
+				n.dynamic	= nodes[n.left].dynamic || nodes[n.right].dynamic;
+			}
+
+			void InsertLeaf(int leaf) {
+				if (root == AABB_TREE_NULL_NODE) {
+					root = leaf;
+					nodes[root].parent = AABB_TREE_NULL_NODE;
+					return;
+				}
+				Vector3 leafMin = nodes[leaf].fatMin;
+				Vector3 leafMax = nodes[leaf].fatMax;
+
+				//Walk down the tree, picking the cheapest child by surface area
+				int index = root;
+				while (!nodes[index].IsLeaf()) {
+					const AABBTreeNode<T>& n = nodes[index];
+					float area			= SurfaceArea(n.fatMin, n.fatMax);
+					float combinedArea	= SurfaceArea(Min(n.fatMin, leafMin), Max(n.fatMax, leafMax));
+
+					float cost			= 2.0f * combinedArea;
+					float inheritCost	= 2.0f * (combinedArea - area);
+
+					float costLeft	= ChildCost(n.left, leafMin, leafMax) + inheritCost;
+					float costRight	= ChildCost(n.right, leafMin, leafMax) + inheritCost;
+
+					if (cost < costLeft && cost < costRight) {
+						break;
+					}
+					index = costLeft < costRight ? n.left : n.right;
+				}
+
+				int sibling		= index;
+				int oldParent	= nodes[sibling].parent;
+				int newParent	= AllocateNode();
+
+				nodes[newParent].parent = oldParent;
+				nodes[newParent].left	= sibling;
+				nodes[newParent].right	= leaf;
+				nodes[sibling].parent	= newParent;
+				nodes[leaf].parent		= newParent;
+				RefitNode(newParent);
+
+				if (oldParent == AABB_TREE_NULL_NODE) {
+					root = newParent;
+				}
+				else if (nodes[oldParent].left == sibling) {
+					nodes[oldParent].left = newParent;
+				}
+				else {
+					nodes[oldParent].right = newParent;
+				}
+				RefitAncestors(nodes[leaf].parent);
+			}
+
+			float ChildCost(int child, const Vector3& leafMin, const Vector3& leafMax) const {
+				const AABBTreeNode<T>& c = nodes[child];
+				float combined = SurfaceArea(Min(c.fatMin, leafMin), Max(c.fatMax, leafMax));
+				if (c.IsLeaf()) {
+					return combined;
+				}
+				return combined - SurfaceArea(c.fatMin, c.fatMax);
+			}
+
+			void RemoveLeaf(int leaf) {
+				if (leaf == root) {
+					root = AABB_TREE_NULL_NODE;
+					return;
+				}
+				int parent		= nodes[leaf].parent;
+				int grandParent = nodes[parent].parent;
+				int sibling		= nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+
+				if (grandParent == AABB_TREE_NULL_NODE) {
+					root = sibling;
+					nodes[sibling].parent = AABB_TREE_NULL_NODE;
+				}
+				else {
+					if (nodes[grandParent].left == parent) {
+						nodes[grandParent].left = sibling;
+					}
+					else {
+						nodes[grandParent].right = sibling;
+					}
+					nodes[sibling].parent = grandParent;
+					RefitAncestors(grandParent);
+				}
+				FreeNode(parent);
+				nodes[leaf].parent = AABB_TREE_NULL_NODE;
+			}
+
+			void RefitAncestors(int index) {
+				while (index != AABB_TREE_NULL_NODE) {
+					index = Balance(index);
+					RefitNode(index);
+					index = nodes[index].parent;
+				}
+			}
+
+			//Performs a left or right rotation if node a is imbalanced, returning the new subtree root
+			int Balance(int a) {
+				if (nodes[a].IsLeaf() || nodes[a].height < 2) {
+					return a;
+				}
+				int b = nodes[a].left;
+				int c = nodes[a].right;
+				int balance = nodes[c].height - nodes[b].height;
+
+				if (balance > 1) {
+					return Rotate(a, c);
+				}
+				if (balance < -1) {
+					return Rotate(a, b);
+				}
+				return a;
+			}
+
+			//Promotes the taller child 'up' above a, which keeps its other child
+			int Rotate(int a, int up) {
+				int f = nodes[up].left;
+				int g = nodes[up].right;
+
+				nodes[up].left		= a;
+				nodes[up].parent	= nodes[a].parent;
+				nodes[a].parent		= up;
+
+				int upParent = nodes[up].parent;
+				if (upParent == AABB_TREE_NULL_NODE) {
+					root = up;
+				}
+				else if (nodes[upParent].left == a) {
+					nodes[upParent].left = up;
+				}
+				else {
+					nodes[upParent].right = up;
+				}
+
+				//the taller grandchild stays with 'up', the shorter moves across to a
+				int keep	= nodes[f].height > nodes[g].height ? f : g;
+				int move	= keep == f ? g : f;
+
+				nodes[up].right		= keep;
+				nodes[keep].parent	= up;
+
+				if (nodes[a].left == up) {
+					nodes[a].left = move;
+				}
+				else {
+					nodes[a].right = move;
+				}
+				nodes[move].parent = a;
+
+				RefitNode(a);
+				RefitNode(up);
+				return up;
+			}
+
+			std::vector<AABBTreeNode<T>>	nodes;
+			std::vector<std::pair<int, int>>	pairStack;
+
+			int		root;
+			int		freeList;
+			int		leafCount;
+			float	margin;
+		};
+	}
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+namespace NCL::GameDemo {
+	/*
+	Packs values into a byte buffer using only as many bits as each one needs, lowest
+	bits first, so the same stream reads back the same way on any machine. The buffer
+	belongs to whoever made the writer - nothing is ever allocated. Writing more than
+	fits sets the overflow flag and drops the value, rather than running off the end,
+	so a stream can be filled and then checked once.
+	*/
+	class BitWriter {
+	public:
+		BitWriter(unsigned char* buffer, int capacity) {
+			this->buffer	= buffer;
+			this->capacity	= capacity;
+			scratch			= 0;
+			scratchBits		= 0;
+			byteCount		= 0;
+			bitCount		= 0;
+			overflowed		= false;
+		}
+
+		//Writes the lowest bits of value, up to 32 of them
+		void Write(unsigned int value, int bits) {
+			if (bitCount + bits > capacity * 8) {
+				overflowed = true;
+				return;
+			}
+			scratch		|= (value & Mask(bits)) << scratchBits;
+			scratchBits += bits;
+			bitCount	+= bits;
+			while (scratchBits >= 8) {
+				buffer[byteCount++] = (unsigned char)scratch;
+				scratch		>>= 8;
+				scratchBits	-= 8;
+			}
+			//The unfinished byte is kept up to date too, so there's no need to flush the stream
+			if (scratchBits > 0) {
+				buffer[byteCount] = (unsigned char)scratch;
+			}
+		}
+
+		void WriteBool(bool value) {
+			Write(value ? 1 : 0, 1);
+		}
+
+		//Copies the first bits of another stream's buffer onto the end of this one
+		void WriteStream(const unsigned char* data, int bits) {
+			for (int i = 0; i < bits / 8; ++i) {
+				Write(data[i], 8);
+			}
+			if (bits % 8) {
+				Write(data[bits / 8], bits % 8);
+			}
+		}
+
+		int GetBitCount() const {
+			return bitCount;
+		}
+
+		//Including the last byte, if it's only partly used
+		int GetByteCount() const {
+			return (bitCount + 7) / 8;
+		}
+
+		bool HasOverflowed() const {
+			return overflowed;
+		}
+
+		static unsigned long long Mask(int bits) {
+			return (1ull << bits) - 1;
+		}
+
+	protected:
+		unsigned char*		buffer;
+		int					capacity;	//In bytes
+		unsigned long long	scratch;	//Bits not yet making up a whole byte
+		int					scratchBits;
+		int					byteCount;
+		int					bitCount;
+		bool				overflowed;
+	};
+
+	/*
+	Reads back what a BitWriter wrote, given the same bit counts in the same order.
+	Reading past the end of the buffer gives 0 and sets the overflow flag, so a short or
+	corrupt packet can be read all the way through and only checked at the end.
+	*/
+	class BitReader {
+	public:
+		BitReader(const unsigned char* buffer, int size) {
+			this->buffer	= buffer;
+			this->size		= size;
+			scratch			= 0;
+			scratchBits		= 0;
+			byteCount		= 0;
+			bitCount		= 0;
+			overflowed		= false;
+		}
+
+		unsigned int Read(int bits) {
+			if (bitCount + bits > size * 8) {
+				overflowed = true;
+				return 0;
+			}
+			while (scratchBits < bits) {
+				scratch		|= (unsigned long long)buffer[byteCount++] << scratchBits;
+				scratchBits += 8;
+			}
+			unsigned int value = (unsigned int)(scratch & BitWriter::Mask(bits));
+			scratch		>>= bits;
+			scratchBits -= bits;
+			bitCount	+= bits;
+			return value;
+		}
+
+		bool ReadBool() {
+			return Read(1) != 0;
+		}
+
+		void Skip(int bits) {
+			while (bits > 0) {
+				int count = bits < 32 ? bits : 32;
+				Read(count);
+				bits -= count;
+			}
+		}
+
+		int GetBitCount() const {
+			return bitCount;
+		}
+
+		int GetBitsLeft() const {
+			return size * 8 - bitCount;
+		}
+
+		bool HasOverflowed() const {
+			return overflowed;
+		}
+
+	protected:
+		const unsigned char*	buffer;
+		int						size;		//In bytes
+		unsigned long long		scratch;
+		int						scratchBits;
+		int						byteCount;
+		int						bitCount;
+		bool					overflowed;
+	};
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <algorithm>
+#include <emmintrin.h>
+#include "Vector3.h"
+
+namespace NCL {
+	using namespace NCL::Maths;
+	namespace GameDemo {
+		//How many rays are walked down a tree together by RaycastPacket
+		const int AABB_TREE_PACKET_SIZE = 4;
+
+		/*
+		The box tests shared by the object tree and the static BVH - overlap and
+		containment, distances, and slab tests for single rays and SSE ray packets.
+		*/
+		struct BoxTests {
+			struct RayPacket {
+				__m128 originX;
+				__m128 originY;
+				__m128 originZ;
+				__m128 inverseX;
+				__m128 inverseY;
+				__m128 inverseZ;
+				__m128 maxDistance;
+			};
+
+			//Loads up to AABB_TREE_PACKET_SIZE rays into a packet. Empty lanes copy the
+			//first ray, but are given a negative length so they can never hit anything
+			static RayPacket MakeRayPacket(const Vector3* origins, const Vector3* directions, const float* maxDistances, int rayCount) {
+				alignas(16) float lanes[6][AABB_TREE_PACKET_SIZE];
+				for (int i = 0; i < AABB_TREE_PACKET_SIZE; ++i) {
+					int ray = i < rayCount ? i : 0;
+					lanes[0][i] = origins[ray].x;
+					lanes[1][i] = origins[ray].y;
+					lanes[2][i] = origins[ray].z;
+					lanes[3][i] = 1.0f / directions[ray].x;
+					lanes[4][i] = 1.0f / directions[ray].y;
+					lanes[5][i] = 1.0f / directions[ray].z;
+				}
+				RayPacket packet;
+				packet.originX	= _mm_load_ps(lanes[0]);
+				packet.originY	= _mm_load_ps(lanes[1]);
+				packet.originZ	= _mm_load_ps(lanes[2]);
+				packet.inverseX	= _mm_load_ps(lanes[3]);
+				packet.inverseY	= _mm_load_ps(lanes[4]);
+				packet.inverseZ	= _mm_load_ps(lanes[5]);
+				SetPacketDistances(packet, maxDistances, rayCount);
+				return packet;
+			}
+
+			static void SetPacketDistances(RayPacket& packet, const float* maxDistances, int rayCount) {
+				alignas(16) float distances[AABB_TREE_PACKET_SIZE];
+				for (int i = 0; i < AABB_TREE_PACKET_SIZE; ++i) {
+					distances[i] = i < rayCount ? maxDistances[i] : -1.0f;
+				}
+				packet.maxDistance = _mm_load_ps(distances);
+			}
+
+			//Slab test - how far along the ray it enters the box, if it does before maxDistance
+			static bool RayBox(const Vector3& origin, const Vector3& inverse, float maxDistance, const Vector3& boxMin, const Vector3& boxMax, float& entry) {
+				float exit = maxDistance;
+				entry = 0.0f;
+				for (int i = 0; i < 3; ++i) {
+					float nearSide	= (boxMin[i] - origin[i]) * inverse[i];
+					float farSide	= (boxMax[i] - origin[i]) * inverse[i];
+					entry	= std::max(entry, std::min(nearSide, farSide));
+					exit	= std::min(exit, std::max(nearSide, farSide));
+				}
+				return entry <= exit;
+			}
+
+			//The same slab test for every ray of a packet, returning a bitmask of the rays that hit
+			static int RayPacketBox(const RayPacket& packet, const Vector3& boxMin, const Vector3& boxMax, __m128& entry) {
+				__m128 nearX	= _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxMin.x), packet.originX), packet.inverseX);
+				__m128 farX		= _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxMax.x), packet.originX), packet.inverseX);
+				__m128 nearY	= _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxMin.y), packet.originY), packet.inverseY);
+				__m128 farY		= _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxMax.y), packet.originY), packet.inverseY);
+				__m128 nearZ	= _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxMin.z), packet.originZ), packet.inverseZ);
+				__m128 farZ		= _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxMax.z), packet.originZ), packet.inverseZ);
+
+				entry = _mm_max_ps(_mm_max_ps(_mm_min_ps(nearX, farX), _mm_min_ps(nearY, farY)), _mm_max_ps(_mm_min_ps(nearZ, farZ), _mm_setzero_ps()));
+				__m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(nearX, farX), _mm_max_ps(nearY, farY)), _mm_min_ps(_mm_max_ps(nearZ, farZ), packet.maxDistance));
+				return _mm_movemask_ps(_mm_cmple_ps(entry, exit));
+			}
+
+			static int PopCount(int mask) {
+				return (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+			}
+
+			static bool Overlaps(const Vector3& minA, const Vector3& maxA, const Vector3& minB, const Vector3& maxB) {
+				return	minA.x <= maxB.x && maxA.x >= minB.x &&
+						minA.y <= maxB.y && maxA.y >= minB.y &&
+						minA.z <= maxB.z && maxA.z >= minB.z;
+			}
+
+			static bool Contains(const Vector3& outerMin, const Vector3& outerMax, const Vector3& innerMin, const Vector3& innerMax) {
+				return	outerMin.x <= innerMin.x && outerMin.y <= innerMin.y && outerMin.z <= innerMin.z &&
+						outerMax.x >= innerMax.x && outerMax.y >= innerMax.y && outerMax.z >= innerMax.z;
+			}
+
+			static float SurfaceArea(const Vector3& boxMin, const Vector3& boxMax) {
+				Vector3 d = boxMax - boxMin;
+				return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+			}
+
+			static Vector3 Min(const Vector3& a, const Vector3& b) {
+				return Vector3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+			}
+
+			static Vector3 Max(const Vector3& a, const Vector3& b) {
+				return Vector3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+			}
+		};
+	}
+}
@@ -3,6 +3,9 @@
 #include "AABBVolume.h"
 #include "OBBVolume.h"
 #include "SphereVolume.h"
+#include "TriangleMeshVolume.h"
+#include "HeightfieldVolume.h"
+#include "GJK.h"
 #include "Window.h"
 #include "Maths.h"
 #include "Debug.h"
@@ -43,6 +46,10 @@ bool CollisionDetection::RayIntersection(const Ray& r,GameObject& object, RayCol
 		case VolumeType::Sphere:	hasCollided = RaySphereIntersection(r, worldTransform, (const SphereVolume&)*volume	, collision); break;
 
 		case VolumeType::Capsule:	hasCollided = RayCapsuleIntersection(r, worldTransform, (const CapsuleVolume&)*volume, collision); break;
+
+		case VolumeType::Mesh:
+		case VolumeType::Heightfield:	hasCollided = RayConcaveIntersection(r, worldTransform, *volume, collision); break;
+		default: break;
 	}
 
 	return hasCollided;
@@ -135,6 +142,67 @@ bool CollisionDetection::RaySphereIntersection(const Ray&r, const Transform& wor
 	return true;
 }
 
+/*
+The ray is moved into the volume's local space, where each triangle it might hit is
+handed over nearest first, so the walk can stop as soon as nothing left could be any
+nearer than what it's already hit.
+*/
+bool CollisionDetection::RayConcaveIntersection(const Ray& r, const Transform& worldTransform, const CollisionVolume& volume, RayCollision& collision) {
+	Quaternion	inverse = worldTransform.GetOrientation().Conjugate();
+	Ray			localRay(inverse * (r.GetPosition() - worldTransform.GetPosition()), inverse * r.GetDirection());
+
+	float nearest = FLT_MAX;
+	auto test = [&](const Vector3& a, const Vector3& b, const Vector3& c, float maxDistance) {
+		RayCollision hit;
+		if (RayTriangleIntersection(localRay, a, b, c, hit) && hit.rayDistance < maxDistance) {
+			nearest = hit.rayDistance;
+			return nearest;
+		}
+		return maxDistance;
+	};
+	if (volume.type == VolumeType::Mesh) {
+		((const TriangleMeshVolume&)volume).Raycast(localRay.GetPosition(), localRay.GetDirection(), FLT_MAX, test);
+	}
+	else {
+		((const HeightfieldVolume&)volume).Raycast(localRay.GetPosition(), localRay.GetDirection(), FLT_MAX, test);
+	}
+	if (nearest == FLT_MAX) {
+		return false;
+	}
+	collision.rayDistance	= nearest;
+	collision.collidedAt	= r.GetPosition() + r.GetDirection() * nearest;
+	return true;
+}
+
+bool CollisionDetection::RayTriangleIntersection(const Ray& r, const Vector3& a, const Vector3& b, const Vector3& c, RayCollision& collision) {
+	Vector3 ab			= b - a;
+	Vector3 ac			= c - a;
+	Vector3 direction	= r.GetDirection();
+	Vector3 p			= Vector3::Cross(direction, ac);
+	float	determinant	= Vector3::Dot(ab, p);
+	if (fabsf(determinant) < 1e-12f) {
+		return false; //The ray runs along the triangle's plane
+	}
+	float	inverse = 1.0f / determinant;
+	Vector3 offset	= r.GetPosition() - a;
+	float	u		= Vector3::Dot(offset, p) * inverse;
+	if (u < 0.0f || u > 1.0f) {
+		return false;
+	}
+	Vector3 q = Vector3::Cross(offset, ab);
+	float	v = Vector3::Dot(direction, q) * inverse;
+	if (v < 0.0f || u + v > 1.0f) {
+		return false;
+	}
+	float t = Vector3::Dot(ac, q) * inverse;
+	if (t < 0.0f) {
+		return false; //no backwards rays!
+	}
+	collision.rayDistance	= t;
+	collision.collidedAt	= r.GetPosition() + direction * t;
+	return true;
+}
+
 bool CollisionDetection::RayCapsuleIntersection(const Ray& r, const Transform& worldTransform, const CapsuleVolume& volume, RayCollision& collision) {
 	Vector3 origin = worldTransform.GetPosition();
 	float capsRadius = volume.GetRadius();
@@ -212,88 +280,29 @@ bool CollisionDetection::ObjectIntersection(GameObject* a, GameObject* b, Collis
 	if (pairType == VolumeType::OBB) {
 		return OBBIntersection((OBBVolume&)*volA, transformA, (OBBVolume&)*volB, transformB, collisionInfo);
 	}
-	//Two Capsules
-	if (pairType == VolumeType::Capsule) {
-		return CapsuleIntersection((CapsuleVolume&)*volA, transformA, (CapsuleVolume&)*volB, transformB, collisionInfo);
-	}
-
-	//AABB vs Sphere pairs
-	if (volA->type == VolumeType::AABB && volB->type == VolumeType::Sphere) {
-		return AABBSphereIntersection((AABBVolume&)*volA, transformA, (SphereVolume&)*volB, transformB, collisionInfo);
-	}
-	if (volA->type == VolumeType::Sphere && volB->type == VolumeType::AABB) {
-		collisionInfo.a = b;
-		collisionInfo.b = a;
-		return AABBSphereIntersection((AABBVolume&)*volB, transformB, (SphereVolume&)*volA, transformA, collisionInfo);
-	}
-
-	//OBB vs sphere pairs
-	if (volA->type == VolumeType::OBB && volB->type == VolumeType::Sphere) {
-		return OBBSphereIntersection((OBBVolume&)*volA, transformA, (SphereVolume&)*volB, transformB, collisionInfo);
+	//An OBB and an AABB are still just two boxes
+	if (pairType == (VolumeType)((int)VolumeType::AABB | (int)VolumeType::OBB)) {
+		return BoxIntersection(ConvexShape(*volA, transformA), ConvexShape(*volB, transformB), collisionInfo);
 	}
-
-	if (volA->type == VolumeType::Sphere && volB->type == VolumeType::OBB) {
-		collisionInfo.a = b;
-		collisionInfo.b = a;
-		return OBBSphereIntersection((OBBVolume&)*volB, transformB, (SphereVolume&)*volA, transformA, collisionInfo);
+	//Triangle meshes and heightfields are tested against convex volumes a triangle at a time
+	if (ConvexShape::IsConvex(volA->type) && ConvexShape::IsConcave(volB->type)) {
+		return ConcaveIntersection(ConvexShape(*volA, transformA), *volB, transformB, collisionInfo);
 	}
-
-	//OBB vs AABB
-	if (volA->type == VolumeType::OBB && volB->type == VolumeType::AABB || volA->type == VolumeType::AABB && volB->type == VolumeType::OBB)
-	{
-		auto obbVolA = (OBBVolume&)*volA;
-		auto obbVolB = (OBBVolume&)*volB;
-		if (obbVolA.GetHalfDimensions().Length() > obbVolB.GetHalfDimensions().Length()) {
-			return OBBIntersection(obbVolA, transformA, obbVolB, transformB, collisionInfo);
+	if (ConvexShape::IsConcave(volA->type) && ConvexShape::IsConvex(volB->type)) {
+		CollisionInfo flipped;
+		if (!ConcaveIntersection(ConvexShape(*volB, transformB), *volA, transformA, flipped)) {
+			return false;
 		}
-		else {
-			collisionInfo.a = b;
-			collisionInfo.b = a;
-			return OBBIntersection(obbVolB, transformB, obbVolA, transformA, collisionInfo);
+		for (int i = 0; i < flipped.pointCount; ++i) {
+			const ContactPoint& p = flipped.points[i];
+			collisionInfo.AddContactPoint(p.localB, p.localA, -p.normal, p.penetration);
 		}
+		return true;
 	}
-
-	if (volA->type == VolumeType::AABB && volB->type == VolumeType::OBB)
-	{
-		collisionInfo.a = b;
-		collisionInfo.b = a;
-	}
-
-	//Capsule vs other interactions
-	if (volA->type == VolumeType::Capsule && volB->type == VolumeType::Sphere) {
-		return SphereCapsuleIntersection((CapsuleVolume&)*volA, transformA, (SphereVolume&)*volB, transformB, collisionInfo);
-	}
-	if (volA->type == VolumeType::Sphere && volB->type == VolumeType::Capsule) {
-		collisionInfo.a = b;
-		collisionInfo.b = a;
-		return SphereCapsuleIntersection((CapsuleVolume&)*volB, transformB, (SphereVolume&)*volA, transformA, collisionInfo);
-	}
-
-	if (volA->type == VolumeType::Capsule && volB->type == VolumeType::AABB) {
-		return AABBCapsuleIntersection((CapsuleVolume&)*volA, transformA, (AABBVolume&)*volB, transformB, collisionInfo);
-	}
-	if (volB->type == VolumeType::Capsule && volA->type == VolumeType::AABB) {
-		collisionInfo.a = b;
-		collisionInfo.b = a;
-		return AABBCapsuleIntersection((CapsuleVolume&)*volB, transformB, (AABBVolume&)*volA, transformA, collisionInfo);
-	}
-
-	if (volA->type == VolumeType::Capsule && volB->type == VolumeType::OBB) {
-		return CapsuleOBBIntersection((CapsuleVolume&)*volA, transformA, (OBBVolume&)*volB, transformB, collisionInfo);
-	}
-
-	if (volA->type == VolumeType::OBB && volB->type == VolumeType::Capsule) {
-		collisionInfo.a = b;
-		collisionInfo.b = a;
-		return CapsuleOBBIntersection((CapsuleVolume&)*volB, transformB, (OBBVolume&)*volA, transformA, collisionInfo);
-	}
-
-	if (volA->type == VolumeType::Sphere && volB->type == VolumeType::OBB) {
-		collisionInfo.a = b;
-		collisionInfo.b = a;
-		return CapsuleOBBIntersection((CapsuleVolume&)*volB, transformB, (OBBVolume&)*volA, transformA, collisionInfo);
+	//Everything else is left to GJK
+	if (ConvexShape::IsConvex(volA->type) && ConvexShape::IsConvex(volB->type)) {
+		return ConvexIntersection(*volA, transformA, *volB, transformB, collisionInfo);
 	}
-
 	return false;
 }
 
@@ -376,423 +385,443 @@ bool CollisionDetection::SphereIntersection(const SphereVolume& volumeA, const T
 	return false;
 }
 
-//AABB - Sphere Collision
-bool CollisionDetection::AABBSphereIntersection(const AABBVolume& volumeA, const Transform& worldTransformA,
-	const SphereVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo) {
-	Vector3 boxSize = volumeA.GetHalfDimensions();
-
-	Vector3 delta = worldTransformB.GetPosition() - worldTransformA.GetPosition();
-
-	Vector3 closestPointOnBox = Maths::Clamp(delta, -boxSize, boxSize);
-	Vector3 localPoint = delta - closestPointOnBox;
-	float distance = localPoint.Length();
-
-	if (distance < volumeB.GetRadius()) {
-		Vector3 collisionNormal = localPoint.Normalised();
-		float penetration = (volumeB.GetRadius() - distance);
-
-		Vector3 localA = Vector3();
-		Vector3 localB = -collisionNormal * volumeB.GetRadius();
+/*
+Every pair without a test of its own goes through GJK and EPA, which only find the
+single deepest point. That's all a sphere or capsule needs, but a box resting on a
+box would rock about on it - so when both are boxes, the points come from clipping
+the faces they're touching with instead, unless they've met edge to edge.
+*/
+bool CollisionDetection::ConvexIntersection(const CollisionVolume& volumeA, const Transform& worldTransformA,
+	const CollisionVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo) {
+	ConvexShape shapeA(volumeA, worldTransformA);
+	ConvexShape shapeB(volumeB, worldTransformB);
 
-		collisionInfo.AddContactPoint(localA, localB, collisionNormal, penetration);
-		return true;
+	GJK::Contact contact;
+	if (!GJK::Intersection(shapeA, shapeB, contact) || contact.penetration <= 0.0f) {
+		return false;
 	}
-	return false;
-}
-
-bool CollisionDetection::CapsuleIntersection(const CapsuleVolume& volumeA, const Transform& worldTransformA,
-	const CapsuleVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo) {
-
-	Vector3 capsATop = Vector3(worldTransformA.GetPosition().x,
-		worldTransformA.GetPosition().y + volumeA.GetHalfHeight() + volumeA.GetRadius(),
-		worldTransformA.GetPosition().z);
-	Vector3 capsABase = Vector3(worldTransformA.GetPosition().x,
-		worldTransformA.GetPosition().y - volumeA.GetHalfHeight() - volumeA.GetRadius(),
-		worldTransformA.GetPosition().z);
-	Vector3 capsBTop = Vector3(worldTransformB.GetPosition().x,
-		worldTransformB.GetPosition().y + volumeB.GetHalfHeight() + volumeB.GetRadius(),
-		worldTransformB.GetPosition().z);
-	Vector3 capsBBase = Vector3(worldTransformB.GetPosition().x,
-		worldTransformB.GetPosition().y - volumeB.GetHalfHeight() - volumeB.GetRadius(),
-		worldTransformB.GetPosition().z);
-
-	// Capsule A
-	Vector3 aNormal = Vector3(capsATop - capsABase).Normalised();
-	Vector3 aLineEndOffset = aNormal * volumeA.GetRadius();
-	Vector3 aEndpointA = capsABase + aLineEndOffset;
-	Vector3 aEndpointB = capsATop - aLineEndOffset;
-
-	// Capsule B
-	Vector3 bNormal = Vector3(capsBTop - capsBBase).Normalised();
-	Vector3 bLineEndOffset = bNormal * volumeB.GetRadius();
-	Vector3 bEndpointA = capsBBase + bLineEndOffset;
-	Vector3 bEndpointB = capsBTop - bLineEndOffset;
-
-	// vectors between line endpoints
-	Vector3 v0 = bEndpointA - aEndpointA;
-	Vector3 v1 = bEndpointB - aEndpointA;
-	Vector3 v2 = bEndpointA - aEndpointB;
-	Vector3 v3 = bEndpointB - aEndpointB;
-
-	// squared distances
-	float d0 = Vector3::Dot(v0, v0);
-	float d1 = Vector3::Dot(v1, v1);
-	float d2 = Vector3::Dot(v2, v2);
-	float d3 = Vector3::Dot(v3, v3);
-
-	// Select best endpoint on capsule A
-	Vector3 bestA;
-	(d2 < d0 || d2 < d1 || d3 < d0 || d3 < d1) ? bestA = aEndpointB : bestA = aEndpointA;
-
-	Vector3 bestB = ClosestPointOnLine(bEndpointA, bEndpointB, bestA);
-	bestA = ClosestPointOnLine(aEndpointA, aEndpointB, bestB);
-
-	Vector3 normal = bestB - bestA;
-	float length = normal.Length();
-	normal = normal.Normalised();
-	float penetration = volumeA.GetRadius() + volumeB.GetRadius() - length;
-
-	if (penetration > 0) {
-		bestA = normal * volumeA.GetRadius();
-		bestB = -normal * volumeB.GetRadius();
-		collisionInfo.AddContactPoint(bestA, bestB, normal, penetration);
+	if (shapeA.IsBox() && shapeB.IsBox() && BoxFaceContacts(shapeA, shapeB, contact.normal, collisionInfo)) {
 		return true;
 	}
-	return false;
+	collisionInfo.AddContactPoint(contact.pointA - shapeA.position, contact.pointB - shapeB.position, contact.normal, contact.penetration);
+	return true;
 }
 
-bool  CollisionDetection::OBBSphereIntersection(const OBBVolume& volumeA, const Transform& worldTransformA,
-	const SphereVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo) {
-	Quaternion orientation = worldTransformA.GetOrientation();
-
-	//Matrix3 transform = Matrix3(orientation);
-	//Matrix3 invTransform = Matrix3();
-
-	Vector3 localPos = worldTransformB.GetPosition();
-	//invTransform *
-	Vector3 boxSize = volumeA.GetHalfDimensions();
-
-	Vector3 delta = localPos - worldTransformA.GetPosition();
-
-	delta = orientation.Conjugate() * delta;
-
-	Vector3 closestPointOnBox = Maths::Clamp(delta, -boxSize, boxSize);
-
-	Vector3 localPoint = delta - closestPointOnBox;
-	float distance = localPoint.Length();
-
-	if (distance < volumeB.GetRadius())
-	{
-		Vector3 collisionNormal = localPoint.Normalised();
-		collisionNormal = orientation * collisionNormal;
-		collisionNormal.Normalise();
-
-		float penetration = (volumeB.GetRadius() - distance);
-		Vector3 localA = orientation * closestPointOnBox;
-		Vector3 localB = -collisionNormal * volumeB.GetRadius();
-
-		collisionInfo.AddContactPoint(localA, localB, collisionNormal, penetration);
-
-		return true;
+/*
+The box whose face lines up best with the contact normal gives the reference face,
+and the other box's face pointing most back at it is clipped to the reference face's
+sides. Whichever corners of what's left have gone through the reference face are the
+contact points, cut down to MAX_CONTACT_POINTS.
+*/
+bool CollisionDetection::BoxFaceContacts(const ConvexShape& a, const ConvexShape& b, const Vector3& normal, CollisionInfo& collisionInfo) {
+	auto bestFace = [](const ConvexShape& box, const Vector3& direction, int& axis) {
+		float best = -1.0f;
+		for (int i = 0; i < 3; ++i) {
+			float alignment = fabsf(Vector3::Dot(box.axes[i], direction));
+			if (alignment > best) {
+				best = alignment;
+				axis = i;
+			}
+		}
+		return best;
+	};
+	int axisA = 0;
+	int axisB = 0;
+	float alignA = bestFace(a, normal, axisA);
+	float alignB = bestFace(b, normal, axisB);
+	if (fmaxf(alignA, alignB) < BOX_FACE_ALIGNMENT) {
+		return false;
 	}
-	return false;
-}
-//Capsule - Sphere Collision
-bool CollisionDetection::AABBCapsuleIntersection(
-	const CapsuleVolume& volumeA, const Transform& worldTransformA,
-	const AABBVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo) {
-	Vector3 capsulePosition = worldTransformA.GetPosition();
-	Quaternion orientation = worldTransformA.GetOrientation();
-
-	Matrix3 transform = Matrix3(orientation);
-	Vector3 upVector = transform * Vector3(0, 1, 0);
-
-	Vector3 topPos = capsulePosition + (upVector * (volumeA.GetHalfHeight() - volumeA.GetRadius()));
-
-	Vector3 localPos = worldTransformB.GetPosition() - capsulePosition;
-	Vector3 originTop = topPos - capsulePosition;
-
-	Vector3 thirdPoint = Vector3::Cross(localPos.Normalised(), originTop.Normalised());
-
-	thirdPoint += capsulePosition;
-
-	Vector3 vA = topPos - worldTransformB.GetPosition();
-	Vector3 vB = topPos - capsulePosition;
-
-	float dotDist = Vector3::Dot(vA, vB);
-
-	if (dotDist < 0) {
-		Vector3 penetrationDistance = worldTransformB.GetPosition() - topPos;
-
-		float penetrationFloat = penetrationDistance.Length();
-
-		if (penetrationFloat <= volumeA.GetRadius() + volumeB.GetHalfDimensions().Length()) {
-			SphereVolume sphere = SphereVolume(volumeA.GetRadius());
-			Transform transform = Transform();
-			transform.SetPosition(topPos);
-			transform.SetOrientation(orientation);
-			transform.SetScale(worldTransformA.GetScale());
-			GameObject* a = collisionInfo.a;
-			GameObject* b = collisionInfo.b;
-
-			collisionInfo.a = b;
-			collisionInfo.b = a;
+	//Stick with a's face unless b's is clearly better, so the choice doesn't flicker between steps
+	bool flip = alignB > alignA + 0.01f;
+	const ConvexShape& reference	= flip ? b : a;
+	const ConvexShape& incident		= flip ? a : b;
+	int referenceAxis				= flip ? axisB : axisA;
+
+	//Points out of the reference box, towards the incident one
+	Vector3 faceNormal = reference.axes[referenceAxis];
+	if (Vector3::Dot(faceNormal, flip ? -normal : normal) < 0.0f) {
+		faceNormal = -faceNormal;
+	}
+	float faceDistance = Vector3::Dot(faceNormal, reference.position) + reference.halfSizes[referenceAxis];
 
-			return AABBSphereIntersection(volumeB, worldTransformB, sphere, transform, collisionInfo);
+	int incidentAxis = 0;
+	bestFace(incident, faceNormal, incidentAxis);
+	Vector3 incidentNormal = incident.axes[incidentAxis];
+	if (Vector3::Dot(incidentNormal, faceNormal) > 0.0f) {
+		incidentNormal = -incidentNormal;
+	}
+	Vector3 centre	= incident.position + incidentNormal * incident.halfSizes[incidentAxis];
+	Vector3 edgeU	= incident.axes[(incidentAxis + 1) % 3] * incident.halfSizes[(incidentAxis + 1) % 3];
+	Vector3 edgeV	= incident.axes[(incidentAxis + 2) % 3] * incident.halfSizes[(incidentAxis + 2) % 3];
+
+	//Clipping a quad to four planes never leaves more than eight corners
+	Vector3 polygon[8] = { centre + edgeU + edgeV, centre - edgeU + edgeV, centre - edgeU - edgeV, centre + edgeU - edgeV };
+	Vector3 clipped[8];
+	int		count = 4;
+
+	for (int side = 0; side < 4 && count > 0; ++side) {
+		int		axis			= (referenceAxis + 1 + side / 2) % 3;
+		Vector3 planeNormal		= reference.axes[axis] * (side % 2 == 0 ? 1.0f : -1.0f);
+		float	planeDistance	= Vector3::Dot(planeNormal, reference.position) + reference.halfSizes[axis];
+
+		int clippedCount = 0;
+		for (int i = 0; i < count && clippedCount < 8; ++i) {
+			const Vector3& from = polygon[i];
+			const Vector3& to	= polygon[(i + 1) % count];
+			float fromDistance	= Vector3::Dot(planeNormal, from) - planeDistance;
+			float toDistance	= Vector3::Dot(planeNormal, to) - planeDistance;
+			if (fromDistance <= 0.0f) {
+				clipped[clippedCount++] = from;
+			}
+			if (((fromDistance < 0.0f && toDistance > 0.0f) || (fromDistance > 0.0f && toDistance < 0.0f)) && clippedCount < 8) {
+				clipped[clippedCount++] = from + (to - from) * (fromDistance / (fromDistance - toDistance));
+			}
 		}
+		for (int i = 0; i < clippedCount; ++i) {
+			polygon[i] = clipped[i];
+		}
+		count = clippedCount;
 	}
 
-	Vector3 bottomPos = capsulePosition - (upVector * (volumeA.GetHalfHeight() - volumeA.GetRadius()));
-	vA = bottomPos - worldTransformB.GetPosition();
-	vB = bottomPos - capsulePosition;
-	dotDist = Vector3::Dot(vA, vB);
-
-	if (dotDist < 0) {
-		Vector3 penetrationDistance = worldTransformB.GetPosition() - bottomPos;
-
-		float penetrationFloat = penetrationDistance.Length();
-
-		if (penetrationFloat <= volumeA.GetRadius() + volumeB.GetHalfDimensions().Length()) {
-			SphereVolume sphere = SphereVolume(volumeA.GetRadius());
-			Transform transform = Transform();
-			transform.SetPosition(bottomPos);
-			transform.SetOrientation(orientation);
-			transform.SetScale(worldTransformA.GetScale());
-			GameObject* a = collisionInfo.a;
-			GameObject* b = collisionInfo.b;
-
-			collisionInfo.a = b;
-			collisionInfo.b = a;
-			return AABBSphereIntersection(volumeB, worldTransformB, sphere, transform, collisionInfo);
+	Vector3 points[8];
+	int		pointCount = 0;
+	for (int i = 0; i < count; ++i) {
+		if (faceDistance - Vector3::Dot(faceNormal, polygon[i]) > 0.0f) {
+			points[pointCount++] = polygon[i];
 		}
 	}
-
-	Vector3 cD = worldTransformB.GetPosition() - capsulePosition;
-	float clampedDot = Maths::Clamp(Vector3::Dot(cD, upVector), -volumeA.GetHalfHeight(), volumeA.GetHalfHeight());
-
-	Vector3 d = capsulePosition + (upVector * (clampedDot));
-
-	float dist = (d - worldTransformB.GetPosition()).Length();
-
-	if (dist > volumeA.GetRadius() + volumeB.GetHalfDimensions().Length()) {
+	if (pointCount == 0) {
 		return false;
 	}
-
-	else {
-		SphereVolume sphere = SphereVolume(volumeA.GetRadius());
-		Transform transform = Transform();
-		transform.SetPosition(d);
-		transform.SetOrientation(orientation);
-		transform.SetScale(worldTransformA.GetScale());
-		GameObject* a = collisionInfo.a;
-		GameObject* b = collisionInfo.b;
-
-		collisionInfo.a = b;
-		collisionInfo.b = a;
-		return AABBSphereIntersection(volumeB, worldTransformB, sphere, transform, collisionInfo);
+	pointCount = ReduceContactPoints(points, pointCount, faceNormal);
+
+	Vector3 contactNormal = flip ? -faceNormal : faceNormal;
+	for (int i = 0; i < pointCount; ++i) {
+		float	depth		= faceDistance - Vector3::Dot(faceNormal, points[i]);
+		Vector3 onReference = points[i] + faceNormal * depth;
+		Vector3 pointA		= flip ? points[i] : onReference;
+		Vector3 pointB		= flip ? onReference : points[i];
+		collisionInfo.AddContactPoint(pointA - a.position, pointB - b.position, contactNormal, depth);
 	}
-
-	return false;
+	return true;
 }
 
-bool CollisionDetection::CapsuleOBBIntersection(
-	const CapsuleVolume& volumeA, const Transform& worldTransformA,
-	const OBBVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo)
-{
-	Quaternion orientation = worldTransformB.GetOrientation();
-	Vector3 position = worldTransformB.GetPosition();
-
-	Matrix3 transform = Matrix3(orientation);
-	Matrix3 invTransform = Matrix3(orientation.Conjugate());;
+bool CollisionDetection::OBBIntersection(const OBBVolume& volumeA, const Transform& worldTransformA,
+	const OBBVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo) {
+	ConvexShape shapeA((const CollisionVolume&)volumeA, worldTransformA);
+	ConvexShape shapeB((const CollisionVolume&)volumeB, worldTransformB);
+	return BoxIntersection(shapeA, shapeB, collisionInfo);
+}
 
-	Vector3 tempVectorA = invTransform * worldTransformA.GetPosition();
-	Vector3 tempVectorB = (invTransform * worldTransformB.GetPosition());
+/*
+Separating axis test between two boxes - each box's three face normals, then the nine
+cross products of an edge from each. Everything is worked out from the dot products
+of the two boxes' axes, which are found once up front, and the test stops at the first
+axis the boxes don't overlap along. Otherwise whichever axis they overlap least on
+gives the contact normal, and the contact points come from clipping the faces against
+each other, or from where the two edges pass closest if it was an edge pair.
+*/
+bool CollisionDetection::BoxIntersection(const ConvexShape& a, const ConvexShape& b, CollisionInfo& collisionInfo) {
+	Vector3 delta = b.position - a.position;
 
-	Transform tempTransformA = Transform();
-	tempTransformA.SetPosition(tempVectorA);
+	float rotation[3][3];		//rotation[i][j] is a's axis i against b's axis j
+	float absRotation[3][3];
+	float offsetA[3];			//How far apart the boxes are along each of a's axes
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			rotation[i][j]		= Vector3::Dot(a.axes[i], b.axes[j]);
+			absRotation[i][j]	= fabsf(rotation[i][j]);
+		}
+		offsetA[i] = Vector3::Dot(delta, a.axes[i]);
+	}
 
-	Transform tempTransformB = Transform();
-	tempTransformB.SetPosition(tempVectorB);
+	float	depth = FLT_MAX;
+	Vector3 normal;
 
-	AABBVolume aabb = AABBVolume(volumeB.GetHalfDimensions());
+	for (int i = 0; i < 3; ++i) {
+		float radiusB = b.halfSizes[0] * absRotation[i][0] + b.halfSizes[1] * absRotation[i][1] + b.halfSizes[2] * absRotation[i][2];
+		float overlap = a.halfSizes[i] + radiusB - fabsf(offsetA[i]);
+		if (overlap < 0.0f) {
+			return false;
+		}
+		if (overlap < depth) {
+			depth	= overlap;
+			normal	= offsetA[i] < 0.0f ? -a.axes[i] : a.axes[i];
+		}
+	}
+	for (int j = 0; j < 3; ++j) {
+		float radiusA = a.halfSizes[0] * absRotation[0][j] + a.halfSizes[1] * absRotation[1][j] + a.halfSizes[2] * absRotation[2][j];
+		float offsetB = Vector3::Dot(delta, b.axes[j]);
+		float overlap = radiusA + b.halfSizes[j] - fabsf(offsetB);
+		if (overlap < 0.0f) {
+			return false;
+		}
+		if (overlap < depth) {
+			depth	= overlap;
+			normal	= offsetB < 0.0f ? -b.axes[j] : b.axes[j];
+		}
+	}
 
-	bool collided = AABBCapsuleIntersection(volumeA, tempTransformA, aabb, tempTransformB, collisionInfo);
+	int		edgeA		= -1;
+	int		edgeB		= -1;
+	float	edgeDepth	= depth - BOX_EDGE_BIAS;
+	for (int i = 0; i < 3; ++i) {
+		int i1 = (i + 1) % 3;
+		int i2 = (i + 2) % 3;
+		for (int j = 0; j < 3; ++j) {
+			//Edges that are nearly parallel have no useful axis between them, and
+			//any separation along it would have shown up on the face normals anyway
+			float lengthSquared = 1.0f - rotation[i][j] * rotation[i][j];
+			if (lengthSquared < 1e-4f) {
+				continue;
+			}
+			int j1 = (j + 1) % 3;
+			int j2 = (j + 2) % 3;
+			float radiusA	= a.halfSizes[i1] * absRotation[i2][j] + a.halfSizes[i2] * absRotation[i1][j];
+			float radiusB	= b.halfSizes[j1] * absRotation[i][j2] + b.halfSizes[j2] * absRotation[i][j1];
+			float offset	= offsetA[i2] * rotation[i1][j] - offsetA[i1] * rotation[i2][j];
+			float overlap	= (radiusA + radiusB - fabsf(offset)) / sqrtf(lengthSquared);
+			if (overlap < 0.0f) {
+				return false;
+			}
+			if (overlap < edgeDepth) {
+				edgeDepth	= overlap;
+				edgeA		= i;
+				edgeB		= j;
+			}
+		}
+	}
 
-	if (collided) {
-		collisionInfo.point.normal = transform * collisionInfo.point.normal;
-		collisionInfo.point.localA = transform * collisionInfo.point.localA;
-		collisionInfo.point.localB = transform * collisionInfo.point.localB;
+	if (edgeA < 0) {
+		if (!BoxFaceContacts(a, b, normal, collisionInfo)) {
+			//Only touching at a corner, too shallow for anything to be left after clipping
+			Vector3 pointB = b.CoreSupport(-normal);
+			collisionInfo.AddContactPoint(pointB + normal * depth - a.position, pointB - b.position, normal, depth);
+		}
 		return true;
 	}
 
-	return false;
-
-}
-
-bool CollisionDetection::SphereCapsuleIntersection(
-	const CapsuleVolume& volumeA, const Transform& worldTransformA,
-	const SphereVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo) {
-	Vector3 capsulePosition = worldTransformA.GetPosition();
-	Quaternion orientation = worldTransformA.GetOrientation();
-
-	Matrix3 transform = Matrix3(orientation);
-	Vector3 upVector = transform * Vector3(0, 1, 0);
-
-	Vector3 topPos = capsulePosition + (upVector * (volumeA.GetHalfHeight() - volumeA.GetRadius()));
-
-	Vector3 localPos = worldTransformB.GetPosition() - capsulePosition;
-	Vector3 originTop = topPos - capsulePosition;
-
-	Vector3 thirdPoint = Vector3::Cross(localPos.Normalised(), originTop.Normalised());
-
-	thirdPoint += capsulePosition;
-
-	Vector3 vA = topPos - worldTransformB.GetPosition();
-	Vector3 vB = topPos - capsulePosition;
-
-	float dotDist = Vector3::Dot(vA, vB);
-
-	if (dotDist < 0) {
-		Vector3 penetrationDistance = worldTransformB.GetPosition() - topPos;
-
-		float penetrationFloat = penetrationDistance.Length();
-		if (penetrationFloat <= volumeA.GetRadius() + volumeB.GetRadius()) {
-			SphereVolume sphere = SphereVolume(volumeA.GetRadius());
-			Transform transform = Transform();
-			transform.SetPosition(topPos);
-			transform.SetOrientation(orientation);
-			transform.SetScale(worldTransformA.GetScale());
-			return SphereIntersection(sphere, transform, volumeB, worldTransformB, collisionInfo);
+	normal = Vector3::Cross(a.axes[edgeA], b.axes[edgeB]).Normalised();
+	if (Vector3::Dot(normal, delta) < 0.0f) {
+		normal = -normal;
+	}
+	//The edge of each box that's furthest into the other...
+	Vector3 onEdgeA = a.position;
+	Vector3 onEdgeB = b.position;
+	for (int i = 0; i < 3; ++i) {
+		if (i != edgeA) {
+			onEdgeA += a.axes[i] * (Vector3::Dot(a.axes[i], normal) > 0.0f ? a.halfSizes[i] : -a.halfSizes[i]);
+		}
+		if (i != edgeB) {
+			onEdgeB += b.axes[i] * (Vector3::Dot(b.axes[i], normal) > 0.0f ? -b.halfSizes[i] : b.halfSizes[i]);
 		}
-
-		return false;
 	}
+	//...and the points along them that come closest together
+	const Vector3&	directionA	= a.axes[edgeA];
+	const Vector3&	directionB	= b.axes[edgeB];
+	Vector3			between		= onEdgeA - onEdgeB;
+	float cosine	= rotation[edgeA][edgeB];
+	float alongA	= Vector3::Dot(directionA, between);
+	float alongB	= Vector3::Dot(directionB, between);
+	float s = Maths::Clamp((cosine * alongB - alongA) / (1.0f - cosine * cosine), -a.halfSizes[edgeA], a.halfSizes[edgeA]);
+	float t = Maths::Clamp(cosine * s + alongB, -b.halfSizes[edgeB], b.halfSizes[edgeB]);
+
+	Vector3 pointA = onEdgeA + directionA * s;
+	Vector3 pointB = onEdgeB + directionB * t;
+	collisionInfo.AddContactPoint(pointA - a.position, pointB - b.position, normal, edgeDepth);
+	return true;
+}
 
-	Vector3 bottomPos = capsulePosition - (upVector * (volumeA.GetHalfHeight() - volumeA.GetRadius()));
-	vA = bottomPos - worldTransformB.GetPosition();
-	vB = bottomPos - capsulePosition;
-
-	dotDist = Vector3::Dot(vA, vB);
-
-	if (dotDist < 0) {
-		Vector3 penetrationDistance = worldTransformB.GetPosition() - bottomPos;
+static Vector3 GetConcaveHalfSizes(const CollisionVolume& volume) {
+	if (volume.type == VolumeType::Mesh) {
+		return ((const TriangleMeshVolume&)volume).GetHalfDimensions();
+	}
+	return ((const HeightfieldVolume&)volume).GetHalfDimensions();
+}
 
-		float penetrationFloat = penetrationDistance.Length();
+//Whether a point lies over a triangle, looking down its normal
+static bool OverTriangle(const Vector3& point, const Vector3& a, const Vector3& b, const Vector3& c, const Vector3& normal) {
+	return	Vector3::Dot(Vector3::Cross(b - a, point - a), normal) >= 0.0f &&
+			Vector3::Dot(Vector3::Cross(c - b, point - b), normal) >= 0.0f &&
+			Vector3::Dot(Vector3::Cross(a - c, point - c), normal) >= 0.0f;
+}
 
-		if (penetrationFloat <= volumeA.GetRadius() + volumeB.GetRadius()) {
-			SphereVolume sphere = SphereVolume(volumeA.GetRadius());
-			Transform transform = Transform();
-			transform.SetPosition(bottomPos);
-			transform.SetOrientation(orientation);
-			transform.SetScale(worldTransformA.GetScale());
-			return SphereIntersection(sphere, transform, volumeB, worldTransformB, collisionInfo);
+struct TriangleContact {
+	Vector3 pointA;		//On the convex shape
+	Vector3 pointB;		//On the triangle
+	Vector3 normal;
+	float	penetration;
+};
+
+//A shape lying across the edge between two triangles finds the same point on both, so
+//points that match one already found are merged, and once full the shallowest goes
+static void AddTriangleContact(TriangleContact* contacts, int& count, const TriangleContact& contact) {
+	float matchDistance = CollisionDetection::CONTACT_MATCH_DISTANCE * CollisionDetection::CONTACT_MATCH_DISTANCE;
+	int shallowest = 0;
+	for (int i = 0; i < count; ++i) {
+		if ((contacts[i].pointA - contact.pointA).LengthSquared() < matchDistance) {
+			if (contact.penetration > contacts[i].penetration) {
+				contacts[i] = contact;
+			}
+			return;
+		}
+		if (contacts[i].penetration < contacts[shallowest].penetration) {
+			shallowest = i;
 		}
-
-		return false;
 	}
-
-	Vector3 cD = worldTransformB.GetPosition() - capsulePosition;
-	float clampedDot = Maths::Clamp(Vector3::Dot(cD, upVector), -volumeA.GetHalfHeight(), volumeA.GetHalfHeight());
-
-	Vector3 d = capsulePosition + (upVector * (clampedDot));
-	float dist = (d - worldTransformB.GetPosition()).Length();
-
-	if (dist > volumeA.GetRadius() + volumeB.GetRadius()) { return false; }
-	else {
-		SphereVolume sphere = SphereVolume(volumeA.GetRadius());
-		Transform transform = Transform();
-		transform.SetPosition(d);
-		transform.SetOrientation(orientation);
-		transform.SetScale(worldTransformA.GetScale());
-		return SphereIntersection(sphere, transform, volumeB, worldTransformB, collisionInfo);
+	if (count < CollisionDetection::MAX_TRIANGLE_CONTACTS) {
+		contacts[count++] = contact;
+	}
+	else if (contact.penetration > contacts[shallowest].penetration) {
+		contacts[shallowest] = contact;
 	}
-	return false;
 }
 
-bool CollisionDetection::OBBIntersection(const OBBVolume& volumeA, const Transform& worldTransformA,
-	const OBBVolume& volumeB, const Transform& worldTransformB, CollisionInfo& collisionInfo) {
-	Quaternion orientationA = worldTransformA.GetOrientation();
-	Quaternion orientationB = worldTransformB.GetOrientation();
-	Vector3 directions[15] = {
-
-		// A XYZ
-		orientationA * Vector3(1, 0, 0),
-		orientationA * Vector3(0, 1, 0),
-		orientationA * Vector3(0, 0, 1),
-		// B XYZ
-		orientationB * Vector3(1, 0, 0),
-		orientationB * Vector3(0, 1, 0),
-		orientationB * Vector3(0, 0, 1)
-	};
-
-	for (int i = 0; i < 3; ++i) { // Fill out rest of axis
-		directions[6 + i * 3 + 0] = Vector3::Cross(directions[i], directions[0]);
-		directions[6 + i * 3 + 1] = Vector3::Cross(directions[i], directions[1]);
-		directions[6 + i * 3 + 2] = Vector3::Cross(directions[i], directions[2]);
+/*
+GJK finds the deepest point of the shape in the triangle, except for boxes lying flat
+on it, which get a point for every corner that's gone through it - otherwise a box on
+a floor would only ever be held up at one corner at a time, and rock about on it.
+A shape that's got underneath a solid surface is pushed straight back out of the top
+of it, whichever side GJK thinks is nearer.
+*/
+static void AddTriangleContacts(const ConvexShape& shape, const Vector3& a, const Vector3& b, const Vector3& c, bool solid,
+	TriangleContact* contacts, int& count) {
+	Vector3 faceNormal	= Vector3::Cross(b - a, c - a);
+	float	area		= faceNormal.Length();
+	if (area <= 0.0f) {
+		return;
 	}
+	faceNormal = faceNormal / area;
 
-	Vector3 hitNormal = Vector3();
-	bool shouldFlip;
-	float depth = FLT_MAX;
-
-	for (int i = 0; i < 15; ++i) {
-		if (directions[i].x < 0.000001f) directions[i].x = 0.0f;
-		if (directions[i].y < 0.000001f) directions[i].y = 0.0f;
-		if (directions[i].z < 0.000001f) directions[i].z = 0.0f;
-		if (Vector3::Dot(directions[i], directions[i]) < 0.001f) {
-			continue;
-		}
-
-		float tDepth = PenetrationDepth(volumeA, worldTransformA, volumeB, worldTransformB, directions[i], &shouldFlip);
-		if (depth <= 0.0f) {
-			return false;
+	if (solid && Vector3::Dot(faceNormal, shape.position - a) < 0.0f) {
+		if (OverTriangle(shape.position, a, b, c, faceNormal)) {
+			Vector3 deepest	= shape.Support(-faceNormal);
+			float	depth	= Vector3::Dot(faceNormal, a - deepest);
+			AddTriangleContact(contacts, count, { deepest, deepest + faceNormal * depth, -faceNormal, depth });
 		}
-		else if (tDepth < depth) {
-			if (shouldFlip) {
-				directions[i] = directions[i] * -1.0f;
+		return;
+	}
+	GJK::Contact contact;
+	if (!GJK::Intersection(shape, ConvexShape(a, b, c), contact) || contact.penetration <= 0.0f) {
+		return;
+	}
+	float alignment = Vector3::Dot(contact.normal, faceNormal);
+	if (shape.IsBox() && fabsf(alignment) > CollisionDetection::BOX_FACE_ALIGNMENT) {
+		Vector3 up		= alignment < 0.0f ? faceNormal : -faceNormal;
+		int		corners	= 0;
+		for (int i = 0; i < 8; ++i) {
+			Vector3 corner = shape.position;
+			for (int j = 0; j < 3; ++j) {
+				corner += shape.axes[j] * ((i >> j) & 1 ? shape.halfSizes[j] : -shape.halfSizes[j]);
+			}
+			float depth = Vector3::Dot(up, a - corner);
+			if (depth > 0.0f && OverTriangle(corner, a, b, c, faceNormal)) {
+				AddTriangleContact(contacts, count, { corner, corner + up * depth, -up, depth });
+				corners++;
 			}
-			depth = tDepth;
-			hitNormal = directions[i];
+		}
+		if (corners > 0) {
+			return;
 		}
 	}
+	AddTriangleContact(contacts, count, { contact.pointA, contact.pointB, contact.normal, contact.penetration });
+}
 
-	if (hitNormal.Length() == 0) {
-		return false;
+/*
+Meshes and heightfields can be any shape at all, so rather than being tested as a
+whole, the convex shape is tested against each triangle near it in turn. The shape is
+moved into the volume's local space to do it, so that none of the triangles need to
+be moved out of it, and only the deepest MAX_CONTACT_POINTS of the points found are
+kept. Under a heightfield counts as in it, so the box looked in reaches all the way up.
+*/
+bool CollisionDetection::ConcaveIntersection(const ConvexShape& shape, const CollisionVolume& volume,
+	const Transform& worldTransform, CollisionInfo& collisionInfo) {
+	Quaternion	orientation	= worldTransform.GetOrientation();
+	Quaternion	inverse		= orientation.Conjugate();
+	Vector3		position	= worldTransform.GetPosition();
+
+	ConvexShape local = shape;
+	local.position = inverse * (shape.position - position);
+	for (int i = 0; i < 3; ++i) {
+		local.axes[i] = inverse * shape.axes[i];
+	}
+	bool	solid	= volume.type == VolumeType::Heightfield;
+	Vector3 reach	= local.GetBoundingHalfSizes();
+	Vector3 boxMin	= local.position - reach;
+	Vector3 boxMax	= local.position + reach;
+	if (solid) {
+		boxMax.y = FLT_MAX;
 	}
 
-	Vector3 axis = hitNormal.Normalised();
-
-	std::vector<Vector3> contactPoints;
-	std::vector<Vector3> pointsOnEdges = ClipEdgesToOBB(GetEdges(worldTransformB, volumeB), volumeA, worldTransformA);
-	contactPoints.insert(contactPoints.end(), pointsOnEdges.begin(), pointsOnEdges.end());
-
-	Interval i = GetInterval(worldTransformA, volumeA, axis);
-	float distance = (i.max - i.min) * 0.5f - depth * 0.5f;
-	Vector3 pointOnPlane = worldTransformA.GetPosition() + axis * distance;
-
-	for (int i = contactPoints.size() - 1; i >= 0; --i) {
-		Vector3 contact = contactPoints[i];
-		contactPoints[i] = contact + (axis * Vector3::Dot(axis, pointOnPlane - contact));
+	TriangleContact contacts[MAX_TRIANGLE_CONTACTS];
+	int				count = 0;
+	GetConcaveTriangles(volume, boxMin, boxMax, [&](const Vector3& a, const Vector3& b, const Vector3& c) {
+		AddTriangleContacts(local, a, b, c, solid, contacts, count);
+	});
+	if (count == 0) {
+		return false;
+	}
+	std::sort(contacts, contacts + count, [](const TriangleContact& a, const TriangleContact& b) {
+		return a.penetration > b.penetration;
+	});
+	for (int i = 0; i < count && i < MAX_CONTACT_POINTS; ++i) {
+		Vector3 pointA = orientation * contacts[i].pointA + position;
+		collisionInfo.AddContactPoint(pointA - shape.position, orientation * contacts[i].pointB,
+			orientation * contacts[i].normal, contacts[i].penetration);
+	}
+	return true;
+}
 
-		for (int j = contactPoints.size() - 1; j > i; --j) {
-			if (Vector3::Dot(contactPoints[j] - contactPoints[i], contactPoints[j] - contactPoints[i]) < 0.0001f) {
-				contactPoints.erase(contactPoints.begin() + j);
-				break;
-			}
+/*
+Cuts a contact patch down to MAX_CONTACT_POINTS, keeping the points that span the most
+area across the contact plane - two points furthest apart, then the point making the
+biggest triangle with them, then the point furthest out on the other side of it.
+*/
+int CollisionDetection::ReduceContactPoints(Vector3* points, int count, const Vector3& normal) {
+	if (count <= MAX_CONTACT_POINTS) {
+		return count;
+	}
+	Vector3 kept[MAX_CONTACT_POINTS];
+	kept[0] = points[0];
+
+	float best = -1.0f;
+	for (int i = 0; i < count; ++i) {
+		const Vector3& p = points[i];
+		float d = (p - kept[0]).LengthSquared();
+		if (d > best) {
+			best	= d;
+			kept[1] = p;
 		}
 	}
-
-	//std::cout << "new penetration " << depth << std::endl;
-	collisionInfo.point.penetration = depth;
-	//std::cout << "new normal " << axis << std::endl;
-	collisionInfo.point.normal = axis;
-	if (contactPoints.size() > 0) {
-		//std::cout << "new localA " << contactPoints.size() << std::endl;
-		collisionInfo.point.localA = contactPoints[0] - worldTransformA.GetPosition();
-		collisionInfo.point.localB = contactPoints[0] - worldTransformB.GetPosition();
-		return true;
+	//Signed area of the triangle each point makes with the first two, across the plane
+	auto area = [&](const Vector3& a, const Vector3& b, const Vector3& p) {
+		return Vector3::Dot(Vector3::Cross(a - p, b - p), normal);
+	};
+	best = -1.0f;
+	for (int i = 0; i < count; ++i) {
+		const Vector3& p = points[i];
+		float d = fabsf(area(kept[0], kept[1], p));
+		if (d > best) {
+			best	= d;
+			kept[2] = p;
+		}
 	}
-	return false;
+	//The last point is whichever lies furthest outside any edge of that triangle
+	float side = area(kept[0], kept[1], kept[2]) > 0.0f ? -1.0f : 1.0f;
+	best = -FLT_MAX;
+	for (int i = 0; i < count; ++i) {
+		const Vector3& p = points[i];
+		float d = fmaxf(fmaxf(area(kept[0], kept[1], p) * side, area(kept[1], kept[2], p) * side), area(kept[2], kept[0], p) * side);
+		if (d > best) {
+			best	= d;
+			kept[3] = p;
+		}
+	}
+	for (int i = 0; i < MAX_CONTACT_POINTS; ++i) {
+		points[i] = kept[i];
+	}
+	return MAX_CONTACT_POINTS;
 }
 
 Matrix4 GenerateInverseView(const Camera &c) {
@@ -986,3 +1015,116 @@ Vector3 CollisionDetection::ClosestPointOnLine(const Vector3& capsuleBase, const
 	float maxt = t > 0.0f ? t : 0.0f;
 	return capsuleBase + capsuleHeight * (maxt < 1.0f ? maxt : 1.0f);
 }
+
+static float PointBoxDistance(const Vector3& localPoint, const Vector3& halfSize) {
+	Vector3 outside(
+		fmaxf(fabsf(localPoint.x) - halfSize.x, 0.0f),
+		fmaxf(fabsf(localPoint.y) - halfSize.y, 0.0f),
+		fmaxf(fabsf(localPoint.z) - halfSize.z, 0.0f));
+	return outside.Length();
+}
+
+/*
+Only triangles within limit of the point can be any nearer than limit, so those are
+all that are looked at. Without a limit, the furthest any triangle can be is the
+distance to the volume's bounds plus the width of them.
+*/
+static float PointConcaveDistance(const Vector3& point, const CollisionVolume& volume, const Transform& worldTransform, float limit) {
+	Vector3 local		= worldTransform.GetOrientation().Conjugate() * (point - worldTransform.GetPosition());
+	Vector3 halfSizes	= GetConcaveHalfSizes(volume);
+	float	reach		= fminf(limit, PointBoxDistance(local, halfSizes) + halfSizes.Length() * 2.0f);
+
+	if (volume.type == VolumeType::Heightfield) {
+		float height;
+		if (((const HeightfieldVolume&)volume).GetHeight(local.x, local.z, height) && local.y <= height) {
+			return 0.0f;
+		}
+	}
+	ConvexShape pointShape(VolumeType::Sphere, local, Vector3(), 0.0f);
+	float		distance = reach;
+	CollisionDetection::GetConcaveTriangles(volume, local - Vector3(reach, reach, reach), local + Vector3(reach, reach, reach),
+		[&](const Vector3& a, const Vector3& b, const Vector3& c) {
+			Vector3 onPoint;
+			Vector3 onTriangle;
+			distance = fminf(distance, GJK::Distance(pointShape, ConvexShape(a, b, c), onPoint, onTriangle));
+		});
+	return distance;
+}
+
+float CollisionDetection::PointVolumeDistance(const Vector3& point, const CollisionVolume& volume, const Transform& worldTransform, float limit) {
+	Vector3 position = worldTransform.GetPosition();
+
+	switch (volume.type) {
+		case VolumeType::AABB:
+			return PointBoxDistance(point - position, ((const AABBVolume&)volume).GetHalfDimensions());
+		case VolumeType::OBB:
+			return PointBoxDistance(worldTransform.GetOrientation().Conjugate() * (point - position), ((const OBBVolume&)volume).GetHalfDimensions());
+		case VolumeType::Sphere:
+			return fmaxf((point - position).Length() - ((const SphereVolume&)volume).GetRadius(), 0.0f);
+		case VolumeType::Capsule: {
+			const CapsuleVolume& capsule = (const CapsuleVolume&)volume;
+			float segment = capsule.GetHalfHeight() - capsule.GetRadius();
+			Vector3 closest = position;
+			if (segment > 0.0f) {
+				Vector3 up = worldTransform.GetOrientation() * Vector3(0, 1, 0);
+				closest = ClosestPointOnLine(position - up * segment, position + up * segment, point);
+			}
+			return fmaxf((point - closest).Length() - capsule.GetRadius(), 0.0f);
+		}
+		case VolumeType::Mesh:
+		case VolumeType::Heightfield:
+			return PointConcaveDistance(point, volume, worldTransform, limit);
+		default:
+			break; //Anything else is treated as out of reach
+	}
+	return FLT_MAX;
+}
+
+float CollisionDetection::GetBoundingRadius(const CollisionVolume& volume) {
+	switch (volume.type) {
+		case VolumeType::AABB:		return ((const AABBVolume&)volume).GetHalfDimensions().Length();
+		case VolumeType::OBB:		return ((const OBBVolume&)volume).GetHalfDimensions().Length();
+		case VolumeType::Sphere:	return ((const SphereVolume&)volume).GetRadius();
+		case VolumeType::Capsule:	return ((const CapsuleVolume&)volume).GetHalfHeight();
+
+		case VolumeType::Mesh:
+		case VolumeType::Heightfield:	return GetConcaveHalfSizes(volume).Length();
+		default:						break;
+	}
+	return 0.0f;
+}
+
+/*
+Conservative advancement - the sphere can't touch the volume before it has moved at
+least as far as the gap between them, so it can always be moved on by that gap
+without passing through anything. Head on, that closes the gap in one go; at a
+glancing angle it takes a few more steps, and a sphere skimming past a surface
+would creep along forever, so a sweep that hasn't closed in by MAX_SWEEP_STEPS
+is counted as a miss, leaving the narrowphase to deal with it.
+*/
+bool CollisionDetection::SweptSphereIntersection(const Vector3& start, const Vector3& motion, float radius,
+	const CollisionVolume& volume, const Transform& worldTransform, float tolerance, float& toi) {
+	float length = motion.Length();
+	if (length <= 0.0f) {
+		return false;
+	}
+	//Nothing further away than this can be reached during the sweep
+	float limit		= radius + length + tolerance;
+	float distance	= PointVolumeDistance(start, volume, worldTransform, limit) - radius;
+	if (distance <= tolerance) {
+		return false; //Already in contact, which is the solver's job
+	}
+	float t = 0.0f;
+	for (int i = 0; i < MAX_SWEEP_STEPS; ++i) {
+		t += distance / length;
+		if (t > 1.0f) {
+			return false;
+		}
+		distance = PointVolumeDistance(start + motion * t, volume, worldTransform, limit) - radius;
+		if (distance <= tolerance) {
+			toi = t;
+			return true;
+		}
+	}
+	return false;
+}
@@ -2,12 +2,18 @@
 
 namespace NCL {
 	namespace GameDemo {
+		class GameObject;
+
 		class Constraint	{
 		public:
 			Constraint() {}
 			virtual ~Constraint() {}
 
 			virtual void UpdateConstraint(float dt) = 0;
+
+			//The objects being constrained - constraints sharing an object are never solved at the same time
+			virtual GameObject* GetObjectA() const = 0;
+			virtual GameObject* GetObjectB() const = 0;
 		};
 	}
 }
\ No newline at end of file
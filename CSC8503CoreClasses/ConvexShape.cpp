@@ -0,0 +1,68 @@
+#include "ConvexShape.h"
+#include "Transform.h"
+#include "AABBVolume.h"
+#include "OBBVolume.h"
+#include "SphereVolume.h"
+#include "CapsuleVolume.h"
+
+using namespace NCL;
+using namespace GameDemo;
+
+ConvexShape::ConvexShape(const CollisionVolume& volume, const Transform& transform) {
+	type		= volume.type;
+	position	= transform.GetPosition();
+	radius		= 0.0f;
+
+	//AABBs ignore their object's orientation, the same as everywhere else
+	if (type == VolumeType::AABB) {
+		axes[0] = Vector3(1, 0, 0);
+		axes[1] = Vector3(0, 1, 0);
+		axes[2] = Vector3(0, 0, 1);
+	}
+	else {
+		for (int i = 0; i < 3; ++i) {
+			axes[i] = transform.GetAxis(i);
+		}
+	}
+
+	switch (type) {
+		case VolumeType::AABB:
+			halfSizes = ((const AABBVolume&)volume).GetHalfDimensions();
+			break;
+		case VolumeType::OBB:
+			halfSizes = ((const OBBVolume&)volume).GetHalfDimensions();
+			break;
+		case VolumeType::Sphere:
+			radius = ((const SphereVolume&)volume).GetRadius();
+			break;
+		case VolumeType::Capsule: {
+			const CapsuleVolume& capsule = (const CapsuleVolume&)volume;
+			radius		= capsule.GetRadius();
+			halfSizes	= Vector3(0, fmaxf(capsule.GetHalfHeight() - radius, 0.0f), 0);
+			break;
+		}
+		default:
+			break;
+	}
+}
+
+ConvexShape::ConvexShape(VolumeType type, const Vector3& position, const Vector3& halfSizes, float radius) {
+	this->type		= type;
+	this->position	= position;
+	this->halfSizes	= halfSizes;
+	this->radius	= radius;
+
+	axes[0] = Vector3(1, 0, 0);
+	axes[1] = Vector3(0, 1, 0);
+	axes[2] = Vector3(0, 0, 1);
+}
+
+ConvexShape::ConvexShape(const Vector3& a, const Vector3& b, const Vector3& c) {
+	type		= VolumeType::Mesh;
+	position	= (a + b + c) / 3.0f;
+	radius		= 0.0f;
+
+	axes[0] = a;
+	axes[1] = b;
+	axes[2] = c;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "CollisionVolume.h"
+#include "Vector3.h"
+
+namespace NCL {
+	using namespace NCL::Maths;
+
+	namespace GameDemo {
+		class Transform;
+	}
+
+	/*
+	A collision volume placed in the world, as GJK and EPA see it - nothing but the
+	point of the shape furthest along any given direction. Every volume we have is a
+	core grown outwards by a radius: a sphere is a point grown by its radius, a capsule
+	is a line segment grown by its radius, and a box is just a box. Points and segments
+	are written as boxes with some of their half sizes at zero, so one support function
+	covers every core. The only core that isn't a box is a single triangle, taken from a
+	triangle mesh or heightfield so it can be tested against a convex volume on its own.
+
+	GJK works on the cores alone where it can, as finding how far apart two points or
+	segments are is exact and quick, and the radii can be taken off afterwards.
+	*/
+	struct ConvexShape {
+		VolumeType	type;
+		Vector3		position;
+		Vector3		axes[3];	//The shape's local axes, in world space - or a triangle's corners
+		Vector3		halfSizes;	//Of the core, along each of the axes
+		float		radius;
+
+		ConvexShape(const CollisionVolume& volume, const GameDemo::Transform& transform);
+		//An axis aligned shape that doesn't belong to any object, such as a query's
+		ConvexShape(VolumeType type, const Vector3& position, const Vector3& halfSizes, float radius);
+		//A triangle of a mesh or heightfield, with no radius
+		ConvexShape(const Vector3& a, const Vector3& b, const Vector3& c);
+
+		Vector3 CoreSupport(const Vector3& direction) const {
+			if (IsTriangle()) {
+				return TriangleSupport(direction);
+			}
+			Vector3 point = position;
+			for (int i = 0; i < 3; ++i) {
+				point += axes[i] * (Vector3::Dot(axes[i], direction) >= 0.0f ? halfSizes[i] : -halfSizes[i]);
+			}
+			return point;
+		}
+
+		Vector3 Support(const Vector3& direction) const {
+			if (radius == 0.0f) {
+				return CoreSupport(direction);
+			}
+			return CoreSupport(direction) + direction.Normalised() * radius;
+		}
+
+		Vector3 TriangleSupport(const Vector3& direction) const {
+			float a = Vector3::Dot(axes[0], direction);
+			float b = Vector3::Dot(axes[1], direction);
+			float c = Vector3::Dot(axes[2], direction);
+			if (a >= b) {
+				return a >= c ? axes[0] : axes[2];
+			}
+			return b >= c ? axes[1] : axes[2];
+		}
+
+		//The half sizes of the axis aligned box around the whole shape
+		Vector3 GetBoundingHalfSizes() const {
+			Vector3 size(radius, radius, radius);
+			if (IsTriangle()) {
+				for (int i = 0; i < 3; ++i) {
+					Vector3 corner = axes[i] - position;
+					size = Vector3(fmaxf(size.x, fabs(corner.x)), fmaxf(size.y, fabs(corner.y)), fmaxf(size.z, fabs(corner.z)));
+				}
+				return size;
+			}
+			for (int i = 0; i < 3; ++i) {
+				Vector3 axis = axes[i] * halfSizes[i];
+				size += Vector3(fabs(axis.x), fabs(axis.y), fabs(axis.z));
+			}
+			return size;
+		}
+
+		bool IsBox() const {
+			return type == VolumeType::AABB || type == VolumeType::OBB;
+		}
+
+		bool IsTriangle() const {
+			return type == VolumeType::Mesh;
+		}
+
+		//Whether a volume type can be described as a ConvexShape at all
+		static bool IsConvex(VolumeType type) {
+			return type == VolumeType::AABB || type == VolumeType::OBB ||
+				type == VolumeType::Sphere || type == VolumeType::Capsule;
+		}
+
+		//Volumes made of triangles, which are tested against convex volumes one triangle at a time
+		static bool IsConcave(VolumeType type) {
+			return type == VolumeType::Mesh || type == VolumeType::Heightfield;
+		}
+	};
+}
@@ -0,0 +1,429 @@
+#include "GJK.h"
+
+using namespace NCL;
+
+bool GJK::Intersection(const ConvexShape& a, const ConvexShape& b, Contact& contact) {
+	Simplex simplex;
+	float	weights[4];
+
+	if (!ClosestPoints(a, b, true, simplex, weights)) {
+		Vector3 pointA;
+		Vector3 pointB;
+		for (int i = 0; i < simplex.count; ++i) {
+			pointA += simplex.vertices[i].a * weights[i];
+			pointB += simplex.vertices[i].b * weights[i];
+		}
+		Vector3 delta		= pointB - pointA;
+		float	distance	= delta.Length();
+		float	radii		= a.radius + b.radius;
+		if (distance >= radii) {
+			return false;
+		}
+		contact.normal		= delta / distance;
+		contact.pointA		= pointA + contact.normal * a.radius;
+		contact.pointB		= pointB - contact.normal * b.radius;
+		contact.penetration = radii - distance;
+		return true;
+	}
+	//The cores overlap, so the radii are no help - EPA needs a simplex on the whole shapes
+	if (a.radius > 0.0f || b.radius > 0.0f) {
+		if (!ClosestPoints(a, b, false, simplex, weights)) {
+			return false;
+		}
+	}
+	if (!FillSimplex(a, b, simplex)) {
+		return false;
+	}
+	return Penetration(a, b, simplex, contact);
+}
+
+float GJK::Distance(const ConvexShape& a, const ConvexShape& b, Vector3& pointA, Vector3& pointB) {
+	Simplex simplex;
+	float	weights[4];
+
+	pointA = a.position;
+	pointB = b.position;
+	if (ClosestPoints(a, b, true, simplex, weights)) {
+		return 0.0f;
+	}
+	pointA = Vector3();
+	pointB = Vector3();
+	for (int i = 0; i < simplex.count; ++i) {
+		pointA += simplex.vertices[i].a * weights[i];
+		pointB += simplex.vertices[i].b * weights[i];
+	}
+	Vector3 delta		= pointB - pointA;
+	float	distance	= delta.Length();
+	float	radii		= a.radius + b.radius;
+	if (distance <= radii) {
+		return 0.0f;
+	}
+	Vector3 normal = delta / distance;
+	pointA += normal * a.radius;
+	pointB -= normal * b.radius;
+	return distance - radii;
+}
+
+GJK::Vertex GJK::Support(const ConvexShape& a, const ConvexShape& b, const Vector3& direction, bool cores) {
+	Vertex vertex;
+	vertex.a = cores ? a.CoreSupport(direction) : a.Support(direction);
+	vertex.b = cores ? b.CoreSupport(-direction) : b.Support(-direction);
+	vertex.w = vertex.a - vertex.b;
+	return vertex;
+}
+
+/*
+Each pass finds the point of the Minkowski difference furthest towards the origin
+from the current closest point, adds it to the simplex, and moves the closest point
+to wherever on the new simplex is nearest the origin. Once a new point gets us no
+closer, the closest point is as close as it gets; if the simplex ever surrounds the
+origin, or touches it, the shapes overlap.
+
+When the closest point is in the middle of a box face, every corner of that face is
+as far along as any other, and rounding can let one that's already been found back
+in - a pass that doesn't get any closer is thrown away rather than trusted.
+*/
+bool GJK::ClosestPoints(const ConvexShape& a, const ConvexShape& b, bool cores, Simplex& simplex, float* weights) {
+	simplex.count = 0;
+
+	Vector3 closest = a.position - b.position;
+	if (closest.LengthSquared() < TOLERANCE) {
+		closest = Vector3(1, 0, 0);
+	}
+	for (int i = 0; i < MAX_ITERATIONS; ++i) {
+		Vertex	vertex		= Support(a, b, -closest, cores);
+		float	lengthSq	= closest.LengthSquared();
+		if (simplex.count > 0 && lengthSq - Vector3::Dot(closest, vertex.w) <= TOLERANCE * lengthSq) {
+			return false;
+		}
+		Simplex previous = simplex;
+		float	previousWeights[4] = { weights[0], weights[1], weights[2], weights[3] };
+		simplex.vertices[simplex.count++] = vertex;
+
+		Vector3 next = ClosestOnSimplex(simplex, weights);
+		if (simplex.count == 4 || next.LengthSquared() < TOLERANCE) {
+			return true;
+		}
+		if (previous.count > 0 && next.LengthSquared() >= lengthSq) {
+			simplex = previous;
+			for (int j = 0; j < 4; ++j) {
+				weights[j] = previousWeights[j];
+			}
+			return false;
+		}
+		closest = next;
+	}
+	return false;
+}
+
+//Drops any vertices that play no part in the closest point, so the simplex never grows past a tetrahedron
+Vector3 GJK::ClosestOnSimplex(Simplex& simplex, float* weights) {
+	Vertex* v	= simplex.vertices;
+	float w[4]	= { 0.0f, 0.0f, 0.0f, 0.0f };
+
+	switch (simplex.count) {
+		case 1:
+			w[0] = 1.0f;
+			break;
+		case 2: {
+			Vector3 ab			= v[1].w - v[0].w;
+			float	lengthSq	= Vector3::Dot(ab, ab);
+			float	t			= lengthSq > 0.0f ? -Vector3::Dot(v[0].w, ab) / lengthSq : 1.0f;
+			t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+			w[0] = 1.0f - t;
+			w[1] = t;
+			break;
+		}
+		case 3: {
+			ClosestOnTriangle(v[0].w, v[1].w, v[2].w, w);
+			break;
+		}
+		case 4: {
+			//Each face, and the vertex opposite it
+			static const int faces[4][4] = { { 0, 1, 2, 3 }, { 0, 3, 1, 2 }, { 0, 2, 3, 1 }, { 1, 3, 2, 0 } };
+			Vector3 ab		= v[1].w - v[0].w;
+			Vector3 ac		= v[2].w - v[0].w;
+			Vector3 ad		= v[3].w - v[0].w;
+			//A tetrahedron that's come out flat can't surround anything, so every face is tried
+			bool	flat	= fabsf(Vector3::Dot(Vector3::Cross(ab, ac), ad)) <= TOLERANCE * ab.Length() * ac.Length() * ad.Length();
+			float	best	= FLT_MAX;
+			bool	inside	= !flat;
+			for (const int* face : faces) {
+				Vector3 normal		= Vector3::Cross(v[face[1]].w - v[face[0]].w, v[face[2]].w - v[face[0]].w);
+				float	originSide	= -Vector3::Dot(normal, v[face[0]].w);
+				float	otherSide	= Vector3::Dot(normal, v[face[3]].w - v[face[0]].w);
+				if (!flat && originSide * otherSide > 0.0f) {
+					continue; //The origin is on the inside of this face
+				}
+				inside = false;
+
+				float	faceWeights[3];
+				Vector3 point = ClosestOnTriangle(v[face[0]].w, v[face[1]].w, v[face[2]].w, faceWeights);
+				if (point.LengthSquared() < best) {
+					best = point.LengthSquared();
+					w[0] = w[1] = w[2] = w[3] = 0.0f;
+					for (int i = 0; i < 3; ++i) {
+						w[face[i]] = faceWeights[i];
+					}
+				}
+			}
+			if (inside) {
+				return Vector3();
+			}
+			break;
+		}
+	}
+
+	Vector3 closest;
+	int		kept = 0;
+	for (int i = 0; i < simplex.count; ++i) {
+		if (w[i] > 0.0f) {
+			closest			+= v[i].w * w[i];
+			v[kept]			= v[i];
+			weights[kept]	= w[i];
+			kept++;
+		}
+	}
+	simplex.count = kept;
+	return closest;
+}
+
+//Works out which part of the triangle - a corner, an edge or the face - is nearest the origin
+Vector3 GJK::ClosestOnTriangle(const Vector3& a, const Vector3& b, const Vector3& c, float* weights) {
+	Vector3 ab = b - a;
+	Vector3 ac = c - a;
+
+	float d1 = -Vector3::Dot(ab, a);
+	float d2 = -Vector3::Dot(ac, a);
+	if (d1 <= 0.0f && d2 <= 0.0f) {
+		weights[0] = 1.0f; weights[1] = 0.0f; weights[2] = 0.0f;
+		return a;
+	}
+	float d3 = -Vector3::Dot(ab, b);
+	float d4 = -Vector3::Dot(ac, b);
+	if (d3 >= 0.0f && d4 <= d3) {
+		weights[0] = 0.0f; weights[1] = 1.0f; weights[2] = 0.0f;
+		return b;
+	}
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		float t = d1 / (d1 - d3);
+		weights[0] = 1.0f - t; weights[1] = t; weights[2] = 0.0f;
+		return a + ab * t;
+	}
+	float d5 = -Vector3::Dot(ab, c);
+	float d6 = -Vector3::Dot(ac, c);
+	if (d6 >= 0.0f && d5 <= d6) {
+		weights[0] = 0.0f; weights[1] = 0.0f; weights[2] = 1.0f;
+		return c;
+	}
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		float t = d2 / (d2 - d6);
+		weights[0] = 1.0f - t; weights[1] = 0.0f; weights[2] = t;
+		return a + ac * t;
+	}
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+		float t = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		weights[0] = 0.0f; weights[1] = 1.0f - t; weights[2] = t;
+		return b + (c - b) * t;
+	}
+	float total = va + vb + vc;
+	if (total <= 0.0f) { //No area to speak of
+		weights[0] = 1.0f; weights[1] = 0.0f; weights[2] = 0.0f;
+		return a;
+	}
+	float v = vb / total;
+	float w = vc / total;
+	weights[0] = 1.0f - v - w; weights[1] = v; weights[2] = w;
+	return a + ab * v + ac * w;
+}
+
+/*
+If the shapes only just touch, GJK stops as soon as its simplex reaches the origin,
+which might be with only a point, line or triangle - EPA needs a tetrahedron to
+start from, so this keeps adding points off the shapes until it has one.
+*/
+bool GJK::FillSimplex(const ConvexShape& a, const ConvexShape& b, Simplex& simplex) {
+	static const Vector3 searchAxes[6] = {
+		Vector3(1, 0, 0), Vector3(-1, 0, 0),
+		Vector3(0, 1, 0), Vector3(0, -1, 0),
+		Vector3(0, 0, 1), Vector3(0, 0, -1)
+	};
+	Vertex* v = simplex.vertices;
+
+	if (simplex.count == 1) {
+		for (const Vector3& axis : searchAxes) {
+			Vertex vertex = Support(a, b, axis, false);
+			if ((vertex.w - v[0].w).LengthSquared() > EPA_TOLERANCE) {
+				v[simplex.count++] = vertex;
+				break;
+			}
+		}
+	}
+	if (simplex.count == 2) {
+		Vector3 line = v[1].w - v[0].w;
+		//Whichever axis is least along the line gives a direction off to its side
+		int axis = 0;
+		for (int i = 1; i < 3; ++i) {
+			if (fabsf(line[i]) < fabsf(line[axis])) {
+				axis = i;
+			}
+		}
+		Vector3 side		= Vector3::Cross(line, searchAxes[axis * 2]);
+		Vector3 directions[4] = { side, -side, Vector3::Cross(line, side), -Vector3::Cross(line, side) };
+		for (const Vector3& direction : directions) {
+			Vertex vertex = Support(a, b, direction, false);
+			if (Vector3::Cross(line, vertex.w - v[0].w).LengthSquared() > EPA_TOLERANCE * line.LengthSquared()) {
+				v[simplex.count++] = vertex;
+				break;
+			}
+		}
+	}
+	if (simplex.count == 3) {
+		Vector3 normal = Vector3::Cross(v[1].w - v[0].w, v[2].w - v[0].w);
+		for (const Vector3& direction : { normal, -normal }) {
+			Vertex vertex = Support(a, b, direction, false);
+			if (fabsf(Vector3::Dot(normal, vertex.w - v[0].w)) > EPA_TOLERANCE * normal.Length()) {
+				v[simplex.count++] = vertex;
+				break;
+			}
+		}
+	}
+	return simplex.count == 4;
+}
+
+/*
+EPA - the tetrahedron holds the origin, and is grown out towards the surface of the
+Minkowski difference one point at a time, always past whichever face is nearest the
+origin. Once that nearest face can't be pushed out any further it's on the surface,
+and how far it is from the origin is how far the shapes overlap.
+*/
+bool GJK::Penetration(const ConvexShape& a, const ConvexShape& b, const Simplex& simplex, Contact& contact) {
+	struct Face {
+		int		v[3];
+		Vector3 normal;
+		float	distance;
+	};
+	Vertex	vertices[MAX_EPA_VERTICES];
+	Face	faces[MAX_EPA_FACES];
+	int		edges[MAX_EPA_FACES][2];
+	int		vertexCount = 0;
+	int		faceCount	= 0;
+
+	auto addFace = [&](int i0, int i1, int i2) {
+		Vector3 normal = Vector3::Cross(vertices[i1].w - vertices[i0].w, vertices[i2].w - vertices[i0].w);
+		float	length = normal.Length();
+		if (length <= 0.0f || faceCount == MAX_EPA_FACES) {
+			return;
+		}
+		Face& face		= faces[faceCount++];
+		face.v[0]		= i0;
+		face.v[1]		= i1;
+		face.v[2]		= i2;
+		face.normal		= normal / length;
+		face.distance	= Vector3::Dot(face.normal, vertices[i0].w);
+	};
+
+	for (int i = 0; i < 4; ++i) {
+		vertices[vertexCount++] = simplex.vertices[i];
+	}
+	//Wind every face so its normal points away from the vertex opposite it
+	static const int tetrahedron[4][4] = { { 0, 1, 2, 3 }, { 0, 3, 1, 2 }, { 0, 2, 3, 1 }, { 1, 3, 2, 0 } };
+	for (const int* face : tetrahedron) {
+		Vector3 normal = Vector3::Cross(vertices[face[1]].w - vertices[face[0]].w, vertices[face[2]].w - vertices[face[0]].w);
+		if (Vector3::Dot(normal, vertices[face[3]].w - vertices[face[0]].w) > 0.0f) {
+			addFace(face[0], face[2], face[1]);
+		}
+		else {
+			addFace(face[0], face[1], face[2]);
+		}
+	}
+
+	auto nearestFace = [&]() {
+		int nearest = 0;
+		for (int i = 1; i < faceCount; ++i) {
+			if (faces[i].distance < faces[nearest].distance) {
+				nearest = i;
+			}
+		}
+		return nearest;
+	};
+
+	for (int iteration = 0; iteration < MAX_EPA_ITERATIONS && faceCount > 0; ++iteration) {
+		const Face& nearest = faces[nearestFace()];
+		Vertex vertex = Support(a, b, nearest.normal, false);
+		if (Vector3::Dot(vertex.w, nearest.normal) - nearest.distance < EPA_TOLERANCE || vertexCount == MAX_EPA_VERTICES) {
+			break;
+		}
+		int newVertex = vertexCount;
+		vertices[vertexCount++] = vertex;
+
+		//Cut out every face the new point can see, keeping the edges around the rim of the hole
+		int edgeCount = 0;
+		for (int f = faceCount - 1; f >= 0; --f) {
+			const Face& face = faces[f];
+			if (Vector3::Dot(face.normal, vertex.w - vertices[face.v[0]].w) <= 0.0f) {
+				continue;
+			}
+			for (int e = 0; e < 3; ++e) {
+				int from	= face.v[e];
+				int to		= face.v[(e + 1) % 3];
+				bool shared = false;
+				for (int k = 0; k < edgeCount; ++k) {
+					if (edges[k][0] == to && edges[k][1] == from) { //Both faces either side are going
+						edgeCount--;
+						edges[k][0] = edges[edgeCount][0];
+						edges[k][1] = edges[edgeCount][1];
+						shared = true;
+						break;
+					}
+				}
+				if (!shared && edgeCount < MAX_EPA_FACES) {
+					edges[edgeCount][0] = from;
+					edges[edgeCount][1] = to;
+					edgeCount++;
+				}
+			}
+			faces[f] = faces[--faceCount];
+		}
+		//And fill it back in with faces fanning out from the new point
+		for (int e = 0; e < edgeCount; ++e) {
+			addFace(edges[e][0], edges[e][1], newVertex);
+		}
+	}
+	if (faceCount == 0) {
+		return false;
+	}
+
+	//Where the origin lands on the nearest face gives the deepest point of each shape
+	const Face& face = faces[nearestFace()];
+	const Vertex& v0 = vertices[face.v[0]];
+	const Vertex& v1 = vertices[face.v[1]];
+	const Vertex& v2 = vertices[face.v[2]];
+
+	Vector3 e0		= v1.w - v0.w;
+	Vector3 e1		= v2.w - v0.w;
+	Vector3 toPoint = face.normal * face.distance - v0.w;
+	float d00 = Vector3::Dot(e0, e0);
+	float d01 = Vector3::Dot(e0, e1);
+	float d11 = Vector3::Dot(e1, e1);
+	float d20 = Vector3::Dot(toPoint, e0);
+	float d21 = Vector3::Dot(toPoint, e1);
+	float denominator = d00 * d11 - d01 * d01;
+
+	float wv = 0.0f;
+	float ww = 0.0f;
+	if (denominator > 0.0f) {
+		wv = (d11 * d20 - d01 * d21) / denominator;
+		ww = (d00 * d21 - d01 * d20) / denominator;
+	}
+	float wu = 1.0f - wv - ww;
+
+	contact.pointA		= v0.a * wu + v1.a * wv + v2.a * ww;
+	contact.pointB		= v0.b * wu + v1.b * wv + v2.b * ww;
+	contact.normal		= face.normal;
+	contact.penetration = face.distance;
+	return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "ConvexShape.h"
+
+namespace NCL {
+	/*
+	Collision between any two ConvexShapes, using nothing but their support functions.
+
+	GJK finds how far apart the shapes' cores are, and the closest point on each. If the
+	cores are further apart than the two radii, the shapes aren't touching; if they're
+	closer, the contact comes straight from those closest points. Only when the cores
+	themselves overlap - which for boxes, with no radius, is any time they touch - does
+	EPA have to work out how far the whole shapes overlap, by growing the simplex GJK
+	finished with out to the surface of the shapes' Minkowski difference.
+
+	Everything runs in fixed size arrays on the stack.
+	*/
+	class GJK {
+	public:
+		struct Contact {
+			Vector3 pointA;		//The deepest points of each shape inside the other
+			Vector3 pointB;
+			Vector3 normal;		//From a towards b
+			float	penetration;
+		};
+
+		static const int MAX_ITERATIONS		= 32;
+		static const int MAX_EPA_ITERATIONS	= 64;
+		static const int MAX_EPA_VERTICES	= MAX_EPA_ITERATIONS + 4;
+		static const int MAX_EPA_FACES		= 2 * MAX_EPA_VERTICES;
+
+		//How close the search has to get before it's counted as done
+		static constexpr float TOLERANCE		= 1e-5f;
+		static constexpr float EPA_TOLERANCE	= 1e-4f;
+
+		static bool Intersection(const ConvexShape& a, const ConvexShape& b, Contact& contact);
+		//How far apart the shapes are, and the closest point of each - or 0 if they touch,
+		//which can be found without ever needing EPA
+		static float Distance(const ConvexShape& a, const ConvexShape& b, Vector3& pointA, Vector3& pointB);
+
+	protected:
+		//A point on the Minkowski difference a - b, and the points of a and b that made it
+		struct Vertex {
+			Vector3 w;
+			Vector3 a;
+			Vector3 b;
+		};
+
+		struct Simplex {
+			Vertex	vertices[4];
+			int		count;
+		};
+
+		static Vertex Support(const ConvexShape& a, const ConvexShape& b, const Vector3& direction, bool cores);
+
+		//Returns whether the shapes (or just their cores) overlap - if they don't, the simplex
+		//is left holding the closest points, with the weight of each vertex in weights
+		static bool		ClosestPoints(const ConvexShape& a, const ConvexShape& b, bool cores, Simplex& simplex, float* weights);
+		static Vector3	ClosestOnSimplex(Simplex& simplex, float* weights);
+		static Vector3	ClosestOnTriangle(const Vector3& a, const Vector3& b, const Vector3& c, float* weights);
+
+		static bool		FillSimplex(const ConvexShape& a, const ConvexShape& b, Simplex& simplex);
+		static bool		Penetration(const ConvexShape& a, const ConvexShape& b, const Simplex& simplex, Contact& contact);
+
+	private:
+		GJK() {}
+		~GJK() {}
+	};
+}
@@ -9,7 +9,12 @@ using namespace NCL::GameDemo;
 GameObject::GameObject(string objectName)	{
 	name			= objectName;
 	worldID			= -1;
+	broadphaseProxy	= -1;
+	treeProxy		= -1;
+	collisionLayers	= DEFAULT_COLLISION_LAYER;
+	collisionMask	= ALL_COLLISION_LAYERS;
 	isActive		= true;
+	isBaked			= false;
 	boundingVolume	= nullptr;
 	physicsObject	= nullptr;
 	renderObject	= nullptr;
@@ -56,4 +61,18 @@ void GameObject::UpdateBroadphaseAABB() {
 		Vector3 halfSizes = ((OBBVolume&)*boundingVolume).GetHalfDimensions();
 		broadphaseAABB = mat * halfSizes;
 	}
+	else if (boundingVolume->type == VolumeType::Capsule) {
+		Matrix3 mat = Matrix3(transform.GetOrientation());
+		mat = mat.Absolute();
+		float r = ((CapsuleVolume&)*boundingVolume).GetRadius();
+		float h = ((CapsuleVolume&)*boundingVolume).GetHalfHeight();
+		broadphaseAABB = mat * Vector3(r, h, r);
+	}
+	else if (boundingVolume->type == VolumeType::Mesh || boundingVolume->type == VolumeType::Heightfield) {
+		Matrix3 mat = Matrix3(transform.GetOrientation());
+		mat = mat.Absolute();
+		Vector3 halfSizes = boundingVolume->type == VolumeType::Mesh ?
+			((TriangleMeshVolume&)*boundingVolume).GetHalfDimensions() : ((HeightfieldVolume&)*boundingVolume).GetHalfDimensions();
+		broadphaseAABB = mat * halfSizes;
+	}
 }
\ No newline at end of file
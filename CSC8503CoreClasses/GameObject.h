@@ -7,6 +7,10 @@
 using std::vector;
 
 namespace NCL::GameDemo {
+	//Collision layers are bits, so an object can be in several at once
+	const unsigned int DEFAULT_COLLISION_LAYER	= 1;
+	const unsigned int ALL_COLLISION_LAYERS		= 0xFFFFFFFF;
+
 	class NetworkObject;
 	class RenderObject;
 	class PhysicsObject;
@@ -14,7 +18,7 @@ namespace NCL::GameDemo {
 	class GameObject	{
 	public:
 		GameObject(std::string name = "");
-		~GameObject();
+		virtual ~GameObject();
 
 		void SetBoundingVolume(CollisionVolume* vol, Vector3 bound) {
 			boundingVolume = vol;
@@ -60,6 +64,10 @@ namespace NCL::GameDemo {
 			physicsObject = newObject;
 		}
 
+		void SetNetworkObject(NetworkObject* newObject) {
+			networkObject = newObject;
+		}
+
 		void SetColour(const Vector4& c) {
 			if (nullptr != renderObject) {
 				renderObject->SetColour(c);
@@ -90,6 +98,58 @@ namespace NCL::GameDemo {
 			return worldID;
 		}
 
+		void SetBroadphaseProxy(int proxy) {
+			broadphaseProxy = proxy;
+		}
+
+		int		GetBroadphaseProxy() const {
+			return broadphaseProxy;
+		}
+
+		//The object's leaf in its world's object tree
+		void SetTreeProxy(int proxy) {
+			treeProxy = proxy;
+		}
+
+		int		GetTreeProxy() const {
+			return treeProxy;
+		}
+
+		//Baked objects are in their world's static BVH instead of its object tree
+		void SetBaked(bool state) {
+			isBaked = state;
+		}
+
+		bool IsBaked() const {
+			return isBaked;
+		}
+
+		//The layers the object is in, and the layers of the objects it can collide with
+		void SetCollisionLayers(unsigned int layers, unsigned int mask = ALL_COLLISION_LAYERS) {
+			collisionLayers = layers;
+			collisionMask	= mask;
+		}
+
+		unsigned int GetCollisionLayers() const {
+			return collisionLayers;
+		}
+
+		unsigned int GetCollisionMask() const {
+			return collisionMask;
+		}
+
+		//Objects without a PhysicsObject can't be moved by anything, so count as static
+		BodyType GetBodyType() const {
+			return physicsObject ? physicsObject->GetBodyType() : BodyType::Static;
+		}
+
+		//Whether two objects should ever be tested against each other - each has to be in
+		//a layer the other collides with, and at least one has to be dynamic
+		static bool ShouldCollide(const GameObject& a, const GameObject& b) {
+			return	(a.collisionLayers & b.collisionMask) && (b.collisionLayers & a.collisionMask) &&
+					(a.GetBodyType() == BodyType::Dynamic || b.GetBodyType() == BodyType::Dynamic);
+		}
+
 	protected:
 		Transform			transform;
 
@@ -100,9 +160,15 @@ namespace NCL::GameDemo {
 
 		Vector3		boundary;
 		bool		isActive;
+		bool		isBaked;
 		int			worldID;
+		int			broadphaseProxy;
+		int			treeProxy;
 		std::string	name;
 
+		unsigned int collisionLayers;
+		unsigned int collisionMask;
+
 		Vector3 broadphaseAABB;
 	};
 }
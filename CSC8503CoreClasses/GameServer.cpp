@@ -41,8 +41,8 @@ bool GameServer::sendGlobalPacket(int msgID) {
 	return SendGlobalPacket(packet);
 }
 
-bool GameServer::SendGlobalPacket(GamePacket& packet) {
-	ENetPacket* dataPacket = enet_packet_create(&packet, packet.GetTotalSize(), 0);
+bool GameServer::SendGlobalPacket(GamePacket& packet, bool reliable) {
+	ENetPacket* dataPacket = enet_packet_create(&packet, packet.GetTotalSize(), reliable ? ENET_PACKET_FLAG_RELIABLE : 0);
 	if (NULL == dataPacket) {
 		std::cout << "Server: Create global packet error..." << std::endl;
 		return false;
@@ -51,6 +51,23 @@ bool GameServer::SendGlobalPacket(GamePacket& packet) {
 	return true;
 }
 
+bool GameServer::SendPacket(GamePacket& packet, int peerID, bool reliable) {
+	if (!netHandle || peerID < 0 || peerID >= (int)netHandle->peerCount) {
+		return false;
+	}
+	ENetPacket* dataPacket = enet_packet_create(&packet, packet.GetTotalSize(), reliable ? ENET_PACKET_FLAG_RELIABLE : 0);
+	if (NULL == dataPacket) {
+		std::cout << "Server: Create packet error..." << std::endl;
+		return false;
+	}
+	if (enet_peer_send(&netHandle->peers[peerID], 0, dataPacket) < 0) {
+		enet_packet_destroy(dataPacket);
+		return false;
+	}
+	return true;
+}
+
+//Connections are handed to the server's own packet handlers as packets from that client
 void GameServer::UpdateServer() {
 	if (!netHandle) { return; }
 	ENetEvent event;
@@ -61,9 +78,13 @@ void GameServer::UpdateServer() {
 
 		if (ENetEventType::ENET_EVENT_TYPE_CONNECT == type) {
 			std::cout << "Server: Client[" << peer << "] connected..." << std::endl;
+			GamePacket packet(Player_Connected);
+			ProcessPacket(&packet, peer);
 		}
 		else if (ENetEventType::ENET_EVENT_TYPE_DISCONNECT == type) {
 			std::cout << "Server: Client[" << peer << "] has disconnected..." << std::endl;
+			GamePacket packet(Player_Disconnected);
+			ProcessPacket(&packet, peer);
 		}
 		else if (ENetEventType::ENET_EVENT_TYPE_RECEIVE == type) {
 			GamePacket* packet = (GamePacket*)event.packet->data;
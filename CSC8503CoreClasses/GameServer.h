@@ -14,7 +14,10 @@ namespace NCL {
 
 			void SetGameWorld(GameWorld &g);
 
-			bool SendGlobalPacket(GamePacket& packet);
+			//Reliable packets are resent until they arrive, and anything sent after them
+			//waits until they have
+			bool SendGlobalPacket(GamePacket& packet, bool reliable = false);
+			bool SendPacket(GamePacket& packet, int peerID, bool reliable = false);
 
 			virtual void UpdateServer();
 
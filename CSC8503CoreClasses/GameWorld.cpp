@@ -2,7 +2,9 @@
 #include "GameObject.h"
 #include "Constraint.h"
 #include "CollisionDetection.h"
+#include "GJK.h"
 #include "Camera.h"
+#include "AABBVolume.h"
 #include "../NCLCoreClasses/Maths.h"
 #include <corecrt_math_defines.h>
 
@@ -17,23 +19,35 @@ GameWorld::GameWorld()	{
 	shuffleObjects		= false;
 	worldIDCounter		= 0;
 	worldStateCounter	= 0;
+
+	shuffleRandom.seed((unsigned int)std::chrono::system_clock::now().time_since_epoch().count());
 }
 
 GameWorld::~GameWorld()	{
+	//Anything still holding a body here is outliving the world, so mustn't be left pointing at it
+	PhysicsBodyStore& unattached = PhysicsBodyStore::GetUnattached();
+	while (bodies.GetBodyCount() > 0) {
+		bodies.MoveBody(bodies.GetBodyCount() - 1, unattached);
+	}
 }
 
 void GameWorld::Clear() {
+	for (GameObject* o : gameObjects) {
+		DetachBody(o);
+	}
 	gameObjects.clear();
 	constraints.clear();
+	objectTree.Clear();
+	staticTree.Clear();
 	worldIDCounter		= 0;
 	worldStateCounter	= 0;
 }
 
 void GameWorld::ClearAndErase() {
-	gameObjects = std::vector<GameObject*>();
 	for (auto i : gameObjects) {
 		delete i;
 	}
+	gameObjects = std::vector<GameObject*>();
 	for (auto i : constraints) {
 		delete i;
 	}
@@ -44,16 +58,45 @@ void GameWorld::AddGameObject(GameObject* o) {
 	gameObjects.emplace_back(o);
 	o->SetWorldID(worldIDCounter++);
 	worldStateCounter++;
+
+	if (PhysicsObject* physics = o->GetPhysicsObject()) {
+		physics->GetBodyStore().MoveBody(physics->GetBodyIndex(), bodies);
+	}
+
+	Vector3 halfSizes;
+	o->UpdateBroadphaseAABB();
+	if (o->GetBroadphaseAABB(halfSizes)) {
+		o->SetTreeProxy(objectTree.Insert(o, o->GetTransform().GetPosition(), halfSizes));
+		objectTree.SetFilter(o->GetTreeProxy(), o->GetCollisionLayers(), o->GetCollisionMask(), o->GetBodyType() == BodyType::Dynamic);
+	}
 }
 
 void GameWorld::RemoveGameObject(GameObject* o, bool andDelete) {
 	gameObjects.erase(std::remove(gameObjects.begin(), gameObjects.end(), o), gameObjects.end());
+	if (objectTree.IsValid(o->GetTreeProxy(), o)) {
+		objectTree.Remove(o->GetTreeProxy());
+	}
+	if (o->IsBaked()) {
+		o->SetBaked(false);
+		BuildStaticTree();
+	}
 	if (andDelete) {
 		delete o;
 	}
+	else {
+		DetachBody(o);
+	}
 	worldStateCounter++;
 }
 
+//An object taken out of the world but kept around mustn't go on being simulated with it
+void GameWorld::DetachBody(GameObject* o) {
+	PhysicsObject* physics = o->GetPhysicsObject();
+	if (physics && &physics->GetBodyStore() == &bodies) {
+		bodies.MoveBody(physics->GetBodyIndex(), PhysicsBodyStore::GetUnattached());
+	}
+}
+
 void GameWorld::GetObjectIterators(
 	GameObjectIterator& first,
 	GameObjectIterator& last) const {
@@ -68,56 +111,362 @@ void GameWorld::OperateOnContents(GameObjectFunc f) {
 	}
 }
 
-void GameWorld::UpdateWorld(float dt) {
-	auto rng = std::default_random_engine{};
-
-	unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-	std::default_random_engine e(seed);
+/*
+A plain Fisher-Yates shuffle rather than std::shuffle, as the standard library is free
+to draw its random numbers differently from one implementation to the next - a given
+seed has to give the same order wherever the world is run.
+*/
+template<class T>
+static void ShuffleContents(std::vector<T>& contents, std::mt19937& random) {
+	for (size_t i = contents.size(); i > 1; --i) {
+		std::swap(contents[i - 1], contents[random() % i]);
+	}
+}
 
+void GameWorld::UpdateWorld(float dt) {
 	if (shuffleObjects) {
-		std::shuffle(gameObjects.begin(), gameObjects.end(), e);
+		ShuffleContents(gameObjects, shuffleRandom);
 	}
 
 	if (shuffleConstraints) {
-		std::shuffle(constraints.begin(), constraints.end(), e);
+		ShuffleContents(constraints, shuffleRandom);
 	}
 }
 
-bool GameWorld::Raycast(Ray& r, RayCollision& closestCollision, bool closestObject, GameObject* ignoreThis) const {
-	//The simplest raycast just goes through each object and sees if there's a collision
-	RayCollision collision;
+/*
+Only awake bodies, and objects without one, have their boxes refreshed - sleeping and
+static bodies can't have moved since they were last put in the tree, the same as in the
+sweep and prune broadphase. Even then an object is only moved around the tree once it
+has left its fattened box, which most objects most of the time won't have. Objects
+that have been given a volume since they were added are put into the tree here, and
+any change to an object's layers or body type is passed on to its leaf.
+*/
+void GameWorld::UpdateObjectTree() {
+	for (GameObject* o : gameObjects) {
+		if (!o->GetBoundingVolume() || o->IsBaked()) {
+			continue;
+		}
+		int proxy = o->GetTreeProxy();
+		bool inTree = objectTree.IsValid(proxy, o);
+
+		PhysicsObject* physics = o->GetPhysicsObject();
+		if (inTree && physics && !physics->IsAwake()) {
+			objectTree.SetFilter(proxy, o->GetCollisionLayers(), o->GetCollisionMask(), o->GetBodyType() == BodyType::Dynamic);
+			continue;
+		}
+		Vector3 halfSizes;
+		o->UpdateBroadphaseAABB();
+		o->GetBroadphaseAABB(halfSizes);
 
-	for (auto& i : gameObjects) {
-		if (!i->GetBoundingVolume()) { //objects might not be colliedable etc...
+		if (inTree) {
+			objectTree.Update(proxy, o->GetTransform().GetPosition(), halfSizes);
+		}
+		else {
+			proxy = objectTree.Insert(o, o->GetTransform().GetPosition(), halfSizes);
+			o->SetTreeProxy(proxy);
+		}
+		objectTree.SetFilter(proxy, o->GetCollisionLayers(), o->GetCollisionMask(), o->GetBodyType() == BodyType::Dynamic);
+	}
+}
+
+void GameWorld::BakeStaticObjects(bool mergeBoxes) {
+	std::vector<GameObject*> statics;
+	for (GameObject* o : gameObjects) {
+		if (o->IsBaked() || !o->GetBoundingVolume() || !o->GetPhysicsObject() || o->GetBodyType() != BodyType::Static) {
 			continue;
 		}
-		if (i == ignoreThis) {
+		if (objectTree.IsValid(o->GetTreeProxy(), o)) {
+			objectTree.Remove(o->GetTreeProxy());
+		}
+		o->SetTreeProxy(AABB_TREE_NULL_NODE);
+		statics.push_back(o);
+	}
+	if (mergeBoxes) {
+		MergeStaticBoxes(statics);
+	}
+	for (GameObject* o : statics) {
+		o->UpdateBroadphaseAABB();
+		o->SetBaked(true);
+	}
+	BuildStaticTree();
+	worldStateCounter++;
+}
+
+/*
+Boxes are merged greedily, one axis at a time - first into runs along x of boxes with
+the same extents in y and z, then those runs into slabs along z, then along y. Only
+AABBs in the same layers, with the same surface, are merged together. A box that
+couldn't be merged with anything is left as the object it came from.
+*/
+void GameWorld::MergeStaticBoxes(std::vector<GameObject*>& statics) {
+	struct MergeBox {
+		Vector3 boxMin;
+		Vector3 boxMax;
+		int		group;
+		int		first;	//The objects making up the box are a list through next
+		int		last;
+	};
+	std::vector<MergeBox>		boxes;
+	std::vector<int>			next;
+	std::vector<GameObject*>	groups;
+	std::vector<GameObject*>	kept;
+
+	auto sameGroup = [](GameObject* a, GameObject* b) {
+		PhysicsObject* physA = a->GetPhysicsObject();
+		PhysicsObject* physB = b->GetPhysicsObject();
+		return	a->GetCollisionLayers() == b->GetCollisionLayers() && a->GetCollisionMask() == b->GetCollisionMask() &&
+				physA->GetElasticity() == physB->GetElasticity() && physA->GetFriction() == physB->GetFriction() &&
+				physA->GetCoeficient() == physB->GetCoeficient();
+	};
+	for (GameObject* o : statics) {
+		if (o->GetBoundingVolume()->type != VolumeType::AABB) {
+			kept.push_back(o);
 			continue;
 		}
-		RayCollision thisCollision;
-		if (CollisionDetection::RayIntersection(r, *i, thisCollision)) {
-				
-			if (!closestObject) {	
-				closestCollision		= collision;
-				closestCollision.node = i;
-				return true;
-			}
-			else {
-				if (thisCollision.rayDistance < collision.rayDistance) {
-					thisCollision.node = i;
-					collision = thisCollision;
+		int group = 0;
+		while (group < (int)groups.size() && !sameGroup(groups[group], o)) {
+			group++;
+		}
+		if (group == (int)groups.size()) {
+			groups.push_back(o);
+		}
+		Vector3 position	= o->GetTransform().GetPosition();
+		Vector3 halfSizes	= ((const AABBVolume*)o->GetBoundingVolume())->GetHalfDimensions();
+		int index = (int)next.size();
+		boxes.push_back({ position - halfSizes, position + halfSizes, group, index, index });
+		next.push_back(-1);
+	}
+
+	for (int axis : { 0, 2, 1 }) {
+		int across[2] = { (axis + 1) % 3, (axis + 2) % 3 };
+		std::stable_sort(boxes.begin(), boxes.end(),
+			[&](const MergeBox& a, const MergeBox& b) {
+				if (a.group != b.group) {
+					return a.group < b.group;
+				}
+				float keysA[5] = { a.boxMin[across[0]], a.boxMax[across[0]], a.boxMin[across[1]], a.boxMax[across[1]], a.boxMin[axis] };
+				float keysB[5] = { b.boxMin[across[0]], b.boxMax[across[0]], b.boxMin[across[1]], b.boxMax[across[1]], b.boxMin[axis] };
+				return std::lexicographical_compare(keysA, keysA + 5, keysB, keysB + 5);
+			});
+		std::vector<MergeBox> merged;
+		for (const MergeBox& b : boxes) {
+			if (!merged.empty()) {
+				MergeBox& run = merged.back();
+				bool lined = run.group == b.group;
+				for (int i : across) {
+					lined = lined && fabs(run.boxMin[i] - b.boxMin[i]) <= STATIC_MERGE_TOLERANCE &&
+						fabs(run.boxMax[i] - b.boxMax[i]) <= STATIC_MERGE_TOLERANCE;
+				}
+				if (lined && b.boxMin[axis] <= run.boxMax[axis] + STATIC_MERGE_TOLERANCE) {
+					run.boxMax[axis]	= std::max(run.boxMax[axis], b.boxMax[axis]);
+					next[run.last]		= b.first;
+					run.last			= b.last;
+					continue;
 				}
 			}
+			merged.push_back(b);
+		}
+		boxes.swap(merged);
+	}
+
+	std::vector<GameObject*> sources;
+	for (GameObject* o : statics) {
+		if (o->GetBoundingVolume()->type == VolumeType::AABB) {
+			sources.push_back(o);
 		}
 	}
+	for (const MergeBox& b : boxes) {
+		GameObject* source = sources[b.first];
+		if (b.first == b.last) {
+			kept.push_back(source);
+			continue;
+		}
+		Vector3 halfSizes = (b.boxMax - b.boxMin) * 0.5f;
+		GameObject* collider = new GameObject("StaticCollider");
+		collider->SetBoundingVolume((CollisionVolume*)new AABBVolume(halfSizes), halfSizes);
+		collider->GetTransform().SetPosition(b.boxMin + halfSizes).SetScale(halfSizes * 2.0f);
+		collider->SetPhysicsObject(new PhysicsObject(&collider->GetTransform(), collider->GetBoundingVolume()));
+		collider->SetCollisionLayers(source->GetCollisionLayers(), source->GetCollisionMask());
+
+		PhysicsObject* phys			= collider->GetPhysicsObject();
+		PhysicsObject* sourcePhys	= source->GetPhysicsObject();
+		phys->SetBodyType(BodyType::Static);
+		phys->SetElasticity(sourcePhys->GetElasticity());
+		phys->SetFriction(sourcePhys->GetFriction());
+		phys->SetCoeficient(sourcePhys->GetCoeficient());
+
+		for (int i = b.first; i != -1; i = next[i]) {
+			delete sources[i]->GetPhysicsObject();
+			delete sources[i]->GetBoundingVolume();
+			sources[i]->SetPhysicsObject(nullptr);
+			sources[i]->SetBoundingVolume(nullptr, sources[i]->GetBoundry());
+		}
+		//Added like any other object, so its body joins the world's store, then taken
+		//back out of the object tree, as it's baked along with everything else
+		AddGameObject(collider);
+		objectTree.Remove(collider->GetTreeProxy());
+		collider->SetTreeProxy(AABB_TREE_NULL_NODE);
+		kept.push_back(collider);
+	}
+	statics.swap(kept);
+}
+
+void GameWorld::BuildStaticTree() {
+	staticTree.Clear();
+	for (GameObject* o : gameObjects) {
+		Vector3 halfSizes;
+		if (o->IsBaked() && o->GetBroadphaseAABB(halfSizes)) {
+			staticTree.Add(o, o->GetTransform().GetPosition(), halfSizes);
+		}
+	}
+	staticTree.Build();
+}
+
+/*
+Rather than testing the ray against every object, the object tree is walked along it,
+and only the objects whose boxes the ray passes through get the exact test. Once the
+closest hit so far is known, anything further away than it is skipped - the static
+BVH is walked second, so only needs searching up to whatever the first walk hit.
+*/
+bool GameWorld::Raycast(Ray& r, RayCollision& closestCollision, bool closestObject, GameObject* ignoreThis, unsigned int layerMask) const {
+	RayCollision collision;
+
+	auto test = [&](GameObject* o, float maxDistance) {
+		RayCollision thisCollision;
+		if (o == ignoreThis || !(o->GetCollisionLayers() & layerMask) || !CollisionDetection::RayIntersection(r, *o, thisCollision)) {
+			return maxDistance;
+		}
+		if (thisCollision.rayDistance >= collision.rayDistance) {
+			return maxDistance;
+		}
+		thisCollision.node	= o;
+		collision			= thisCollision;
+		//Any hit will do, so there's no need to look any further
+		return closestObject ? collision.rayDistance : -1.0f;
+	};
+	objectTree.Raycast(r.GetPosition(), r.GetDirection(), FLT_MAX, test);
+	if (closestObject || !collision.node) {
+		staticTree.Raycast(r.GetPosition(), r.GetDirection(), collision.rayDistance, test);
+	}
+
 	if (collision.node) {
-		closestCollision		= collision;
-		closestCollision.node	= collision.node;
+		closestCollision = collision;
 		return true;
 	}
 	return false;
 }
 
+/*
+Rays are sent down the object tree in packets, with each node's box tested against
+the whole packet at once. When a packet reaches an object, the rays that got there
+are tested against it exactly, one at a time, and shortened to any hit they find.
+*/
+int GameWorld::RaycastBatch(const Ray* rays, int count, RayCollision* collisions, float maxDistance,
+	GameObject* const* ignoreList, int ignoreCount, unsigned int layerMask) const {
+	int hitCount = 0;
+	for (int first = 0; first < count; first += AABB_TREE_PACKET_SIZE) {
+		int packetSize = std::min(count - first, AABB_TREE_PACKET_SIZE);
+
+		Vector3	origins[AABB_TREE_PACKET_SIZE];
+		Vector3	directions[AABB_TREE_PACKET_SIZE];
+		float	distances[AABB_TREE_PACKET_SIZE];
+		for (int i = 0; i < packetSize; ++i) {
+			origins[i]		= rays[first + i].GetPosition();
+			directions[i]	= rays[first + i].GetDirection();
+			distances[i]	= maxDistance;
+			collisions[first + i] = RayCollision();
+		}
+
+		auto test = [&](GameObject* o, int rayMask) {
+			if (!(o->GetCollisionLayers() & layerMask)) {
+				return;
+			}
+			for (int i = 0; i < ignoreCount; ++i) {
+				if (ignoreList[i] == o) {
+					return;
+				}
+			}
+			for (int i = 0; i < packetSize; ++i) {
+				if (!(rayMask & (1 << i))) {
+					continue;
+				}
+				RayCollision thisCollision;
+				if (CollisionDetection::RayIntersection(rays[first + i], *o, thisCollision) &&
+					thisCollision.rayDistance < distances[i]) {
+					thisCollision.node		= o;
+					collisions[first + i]	= thisCollision;
+					distances[i]			= thisCollision.rayDistance;
+				}
+			}
+		};
+		objectTree.RaycastPacket(origins, directions, distances, packetSize, test);
+		staticTree.RaycastPacket(origins, directions, distances, packetSize, test);
+
+		for (int i = 0; i < packetSize; ++i) {
+			if (collisions[first + i].node) {
+				hitCount++;
+			}
+		}
+	}
+	return hitCount;
+}
+
+//The shape of an object's volume in the world - anything that isn't convex is just its box,
+//which is as close as a mesh or heightfield gets when it's the thing doing the querying
+static ConvexShape GetObjectShape(GameObject& o) {
+	const CollisionVolume* volume = o.GetBoundingVolume();
+	if (ConvexShape::IsConvex(volume->type)) {
+		return ConvexShape(*volume, o.GetTransform());
+	}
+	Vector3 halfSizes;
+	o.GetBroadphaseAABB(halfSizes);
+	return ConvexShape(VolumeType::AABB, o.GetTransform().GetPosition(), halfSizes, 0.0f);
+}
+
+int GameWorld::OverlapObject(GameObject* object, GameObject** results, int maxResults) const {
+	if (!object->GetBoundingVolume()) {
+		return 0;
+	}
+	return OverlapShape(GetObjectShape(*object), results, maxResults, object, object->GetCollisionMask());
+}
+
+//Meshes and heightfields are tested against the shape a triangle at a time
+static bool ShapeTouches(const ConvexShape& shape, GameObject& o) {
+	const CollisionVolume* volume = o.GetBoundingVolume();
+	if (ConvexShape::IsConcave(volume->type)) {
+		CollisionDetection::CollisionInfo info;
+		return CollisionDetection::ConcaveIntersection(shape, *volume, o.GetTransform(), info);
+	}
+	Vector3 pointA;
+	Vector3 pointB;
+	return GJK::Distance(shape, GetObjectShape(o), pointA, pointB) <= 0.0f;
+}
+
+/*
+The tree hands over every object whose box overlaps the shape's box, and GJK decides
+whether the volumes themselves touch - it never has to go on to EPA, as how far they
+overlap doesn't matter here.
+*/
+int GameWorld::OverlapShape(const ConvexShape& shape, GameObject** results, int maxResults, GameObject* ignore, unsigned int layerMask) const {
+	if (maxResults <= 0) {
+		return 0;
+	}
+	int found = 0;
+	Vector3 halfSizes = shape.GetBoundingHalfSizes();
+	auto test = [&](GameObject* o) {
+		if (o == ignore || !(o->GetCollisionLayers() & layerMask) || !ShapeTouches(shape, *o)) {
+			return true;
+		}
+		results[found++] = o;
+		return found < maxResults;
+	};
+	objectTree.Query(shape.position - halfSizes, shape.position + halfSizes, test);
+	if (found < maxResults) {
+		staticTree.Query(shape.position - halfSizes, shape.position + halfSizes, test);
+	}
+	return found;
+}
+
 void GameWorld::AddConstraint(Constraint* c) {
 	constraints.emplace_back(c);
 }
@@ -136,25 +485,6 @@ void GameWorld::GetConstraintIterators(
 	last	= constraints.end();
 }
 
-//Get all objects oriented in the direction of this vector
-//@param objects - return
-//@param pos - start point
-//@param vec - direction
-void GameWorld::GetObjectsInTargetView(vector<GameObject*> &objects, Vector3 pos, Vector3 vec, float distance) {
-	for (auto object : gameObjects) {
-		if (object->GetName() == "Player" || object->GetName() == "Enemy") { continue; }
-		Vector3 ObjPos = object->GetTransform().GetPosition();
-		Vector3 vecTtoO = ObjPos - pos;
-		float lenTO = NCL::Maths::Distance(ObjPos, pos);
-		if (distance < lenTO) { continue; } //too far
-		float cosTOtoV = Vector3::Dot(vec.Normalised(), vecTtoO.Normalised());
-		if (90.0f < acos(cosTOtoV) * 180.0f / M_PI) { continue; } // The angle with the vector should be less than 90 degree
-		objects.push_back(object);
-	}
-}
-
-
-
 ////Get all objects in the square range between two objects
 //void GameWorld::GetObjectSetRangeTwoObject(vector<GameObject*> objects, GameObject* objA, GameObject* objB) {
 //	if (!objA || !objB) { return; }
@@ -4,6 +4,9 @@
 #include "Ray.h"
 #include "CollisionDetection.h"
 #include "QuadTree.h"
+#include "AABBTree.h"
+#include "StaticBVH.h"
+#include "PhysicsBodyStore.h"
 namespace NCL {
 		class Camera;
 		using Maths::Ray;
@@ -11,6 +14,9 @@ namespace NCL {
 		class GameObject;
 		class Constraint;
 
+		//How far apart two static boxes can be and still be merged when they're baked
+		const float STATIC_MERGE_TOLERANCE	= 0.001f;
+
 		typedef std::function<void(GameObject*)> GameObjectFunc;
 		typedef std::vector<GameObject*>::const_iterator GameObjectIterator;
 
@@ -40,7 +46,55 @@ namespace NCL {
 				shuffleObjects = state;
 			}
 
-			bool Raycast(Ray& r, RayCollision& closestCollision, bool closestObject = false, GameObject* ignore = nullptr) const;
+			//Shuffles are seeded from the clock unless given a seed, which makes them repeatable
+			void SetShuffleSeed(unsigned int seed) {
+				shuffleRandom.seed(seed);
+			}
+
+			//Queries that take a layerMask only find objects in at least one of its layers
+			bool Raycast(Ray& r, RayCollision& closestCollision, bool closestObject = false, GameObject* ignore = nullptr,
+				unsigned int layerMask = ALL_COLLISION_LAYERS) const;
+
+			//Finds the closest hit of each of count rays, writing them into collisions - rays
+			//that hit nothing within maxDistance are left with a null node. Objects in the
+			//ignore list can't be hit. Returns how many of the rays hit something
+			int RaycastBatch(const Ray* rays, int count, RayCollision* collisions, float maxDistance = FLT_MAX,
+				GameObject* const* ignoreList = nullptr, int ignoreCount = 0, unsigned int layerMask = ALL_COLLISION_LAYERS) const;
+
+			//Objects whose volumes touch the given object's volume, other than the object itself,
+			//and are in the layers of its collision mask. Answered from the object tree and the
+			//static BVH, stopping once maxResults have been found - nothing is allocated, so
+			//it's fine to call every frame. Returns how many were found
+			int OverlapObject(GameObject* object, GameObject** results, int maxResults) const;
+
+			//Brings the object tree up to date with where everything is. The physics system
+			//calls this every update, so objects moved by hand between updates won't be
+			//found in their new place by queries until it's called again. Sleeping and static
+			//bodies are left where they were, so one moved by hand has to be woken first
+			void UpdateObjectTree();
+
+			AABBTree<GameObject*>& GetObjectTree() {
+				return objectTree;
+			}
+
+			/*
+			Takes every static object out of the object tree and bakes them all into the
+			static BVH, which is never updated again until the next bake. If mergeBoxes is
+			set, touching static AABBs are first merged into as few boxes as possible, each
+			of which becomes a new collision-only object - the objects they replace keep
+			their graphics but lose their volumes, so won't be told about collisions.
+			Objects made static later on stay in the object tree until the next bake.
+			*/
+			void BakeStaticObjects(bool mergeBoxes = true);
+
+			const StaticBVH<GameObject*>& GetStaticTree() const {
+				return staticTree;
+			}
+
+			//The bodies of this world's objects, which its PhysicsSystem steps
+			PhysicsBodyStore& GetBodyStore() {
+				return bodies;
+			}
 
 			virtual void UpdateWorld(float dt);
 
@@ -57,19 +111,29 @@ namespace NCL {
 			int GetWorldStateID() const {
 				return worldStateCounter;
 			}
-			void GetObjectsInTargetView(vector<GameObject*> &objects, Vector3 pos, Vector3 vec, float distance);
 
 			//void GetObjectSetRangeTwoObject(vector<GameObject*> objects, GameObject* objA, GameObject* objB);
 			//bool CheckObjectInRangePos(Vector3 boundryMax, Vector3 boundryMin, Vector3 posA, Vector3 posB);
 
 		protected:
+			int		OverlapShape(const ConvexShape& shape, GameObject** results, int maxResults, GameObject* ignore, unsigned int layerMask) const;
+
+			void	MergeStaticBoxes(std::vector<GameObject*>& statics);
+			void	BuildStaticTree();
+			void	DetachBody(GameObject* o);
+
 			std::vector<GameObject*> gameObjects;
 			std::vector<Constraint*> constraints;
 
+			AABBTree<GameObject*>	objectTree;
+			StaticBVH<GameObject*>	staticTree;
+			PhysicsBodyStore		bodies;
+
 			Camera* mainCamera;
 
 			bool shuffleConstraints;
 			bool shuffleObjects;
+			std::mt19937 shuffleRandom;
 			int	worldIDCounter;
 			int	worldStateCounter;
 		};
@@ -0,0 +1,86 @@
+#include "HeightfieldVolume.h"
+
+using namespace NCL;
+
+HeightfieldVolume::HeightfieldVolume(int columns, int rows, const float* heights, float spacing) {
+	type			= VolumeType::Heightfield;
+	this->columns	= columns;
+	this->rows		= rows;
+	this->spacing	= spacing;
+	blockColumns	= 0;
+	minHeight		= 0.0f;
+	maxHeight		= 0.0f;
+	heightStep		= 0.0f;
+	inverseStep		= 0.0f;
+
+	if (columns < 2 || rows < 2 || spacing <= 0.0f) {
+		this->columns	= 0;
+		this->rows		= 0;
+		return;
+	}
+	corner = Vector3((columns - 1) * spacing * -0.5f, 0.0f, (rows - 1) * spacing * -0.5f);
+
+	int sampleCount = columns * rows;
+	minHeight = heights[0];
+	maxHeight = heights[0];
+	for (int i = 1; i < sampleCount; ++i) {
+		minHeight = std::min(minHeight, heights[i]);
+		maxHeight = std::max(maxHeight, heights[i]);
+	}
+	heightStep	= (maxHeight - minHeight) / 65535.0f;
+	inverseStep	= heightStep > 0.0f ? 1.0f / heightStep : 0.0f;
+
+	samples.resize(sampleCount);
+	for (int i = 0; i < sampleCount; ++i) {
+		samples[i] = (unsigned short)std::min(roundf((heights[i] - minHeight) * inverseStep), 65535.0f);
+	}
+
+	//Each block covers the cells in it, and so the samples along its far edges too
+	blockColumns	= (columns - 2) / HEIGHTFIELD_BLOCK_SIZE + 1;
+	int blockRows	= (rows - 2) / HEIGHTFIELD_BLOCK_SIZE + 1;
+	blocks.resize(blockColumns * blockRows);
+	for (int blockRow = 0; blockRow < blockRows; ++blockRow) {
+		for (int blockColumn = 0; blockColumn < blockColumns; ++blockColumn) {
+			Block& block = blocks[blockRow * blockColumns + blockColumn];
+			block.minimum = 65535;
+			block.maximum = 0;
+			int rowEnd		= std::min((blockRow + 1) * HEIGHTFIELD_BLOCK_SIZE, rows - 1);
+			int columnEnd	= std::min((blockColumn + 1) * HEIGHTFIELD_BLOCK_SIZE, columns - 1);
+			for (int row = blockRow * HEIGHTFIELD_BLOCK_SIZE; row <= rowEnd; ++row) {
+				for (int column = blockColumn * HEIGHTFIELD_BLOCK_SIZE; column <= columnEnd; ++column) {
+					block.minimum = std::min(block.minimum, samples[row * columns + column]);
+					block.maximum = std::max(block.maximum, samples[row * columns + column]);
+				}
+			}
+		}
+	}
+	halfSizes = Vector3(-corner.x, std::max(fabsf(minHeight), fabsf(maxHeight)), -corner.z);
+}
+
+bool HeightfieldVolume::GetHeight(float x, float z, float& height) const {
+	if (samples.empty()) {
+		return false;
+	}
+	float u = (x - corner.x) / spacing;
+	float v = (z - corner.z) / spacing;
+	if (u < 0.0f || v < 0.0f || u > columns - 1 || v > rows - 1) {
+		return false;
+	}
+	int column	= std::min((int)u, columns - 2);
+	int row		= std::min((int)v, rows - 2);
+	u -= column;
+	v -= row;
+
+	float h00 = GetPoint(column, row).y;
+	float h11 = GetPoint(column + 1, row + 1).y;
+	//Which side of the cell's diagonal the point is on picks the triangle it's over
+	if (v >= u) {
+		float h01 = GetPoint(column, row + 1).y;
+		height = h00 + (h11 - h01) * u + (h01 - h00) * v;
+	}
+	else {
+		float h10 = GetPoint(column + 1, row).y;
+		height = h00 + (h10 - h00) * u + (h11 - h10) * v;
+	}
+	return true;
+}
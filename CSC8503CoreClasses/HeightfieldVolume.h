@@ -0,0 +1,182 @@
+#pragma once
+#include "CollisionVolume.h"
+#include "BoxTests.h"
+
+namespace NCL {
+	using namespace NCL::Maths;
+
+	//Cells are grouped into square blocks this many cells across, each knowing the range of heights in it
+	const int HEIGHTFIELD_BLOCK_SIZE = 8;
+
+	/*
+	Terrain, as a grid of heights spaced evenly along x and z and centred on the volume's
+	origin, with each cell of the grid split into two triangles from its first sample
+	to the one diagonally across from it. Heights are stored as 16 bit steps between
+	the lowest and highest of them, at two bytes a sample, and every block of cells
+	keeps the range of steps in it, so a query against the terrain can skip everything
+	that's nowhere near the height it's looking at without reading any samples.
+
+	Unlike a triangle mesh, a heightfield is solid all the way down - anything that
+	ends up underneath it is pushed back up, rather than out of the bottom.
+	*/
+	class HeightfieldVolume : CollisionVolume
+	{
+	public:
+		//heights holds columns * rows samples, a row at a time, spacing apart along x and z
+		HeightfieldVolume(int columns, int rows, const float* heights, float spacing);
+		~HeightfieldVolume() {
+		}
+
+		Vector3 GetHalfDimensions() const {
+			return halfSizes;
+		}
+
+		int GetColumns() const {
+			return columns;
+		}
+
+		int GetRows() const {
+			return rows;
+		}
+
+		float GetSpacing() const {
+			return spacing;
+		}
+
+		//A sample's position in the volume's local space, at the height it was quantized to
+		Vector3 GetPoint(int column, int row) const {
+			return Vector3(corner.x + column * spacing, minHeight + samples[row * columns + column] * heightStep, corner.z + row * spacing);
+		}
+
+		//The height of the surface directly above or below a local space point, if it's over the grid
+		bool GetHeight(float x, float z, float& height) const;
+
+		//Calls func with the corners of both triangles of every cell that might reach into the given box
+		template<class F>
+		void GetTriangles(const Vector3& queryMin, const Vector3& queryMax, F func) const {
+			if (samples.empty() || queryMax.y < minHeight || queryMin.y > maxHeight) {
+				return;
+			}
+			//Clamped before they're made ints, as a query box can be any size at all
+			int firstColumn	= (int)std::clamp(floorf((queryMin.x - corner.x) / spacing), 0.0f, (float)columns - 1);
+			int lastColumn	= (int)std::clamp(floorf((queryMax.x - corner.x) / spacing), -1.0f, (float)columns - 2);
+			int firstRow	= (int)std::clamp(floorf((queryMin.z - corner.z) / spacing), 0.0f, (float)rows - 1);
+			int lastRow		= (int)std::clamp(floorf((queryMax.z - corner.z) / spacing), -1.0f, (float)rows - 2);
+			if (firstColumn > lastColumn || firstRow > lastRow) {
+				return;
+			}
+			unsigned short low	= (unsigned short)std::max(floorf((queryMin.y - minHeight) * inverseStep), 0.0f);
+			unsigned short high	= (unsigned short)std::min(ceilf((queryMax.y - minHeight) * inverseStep), 65535.0f);
+
+			for (int blockRow = firstRow / HEIGHTFIELD_BLOCK_SIZE; blockRow <= lastRow / HEIGHTFIELD_BLOCK_SIZE; ++blockRow) {
+				for (int blockColumn = firstColumn / HEIGHTFIELD_BLOCK_SIZE; blockColumn <= lastColumn / HEIGHTFIELD_BLOCK_SIZE; ++blockColumn) {
+					const Block& block = blocks[blockRow * blockColumns + blockColumn];
+					if (block.minimum > high || block.maximum < low) {
+						continue;
+					}
+					int rowEnd		= std::min((blockRow + 1) * HEIGHTFIELD_BLOCK_SIZE - 1, lastRow);
+					int columnEnd	= std::min((blockColumn + 1) * HEIGHTFIELD_BLOCK_SIZE - 1, lastColumn);
+					for (int row = std::max(blockRow * HEIGHTFIELD_BLOCK_SIZE, firstRow); row <= rowEnd; ++row) {
+						for (int column = std::max(blockColumn * HEIGHTFIELD_BLOCK_SIZE, firstColumn); column <= columnEnd; ++column) {
+							const unsigned short* sample = &samples[row * columns + column];
+							unsigned short cellMin = std::min(std::min(sample[0], sample[1]), std::min(sample[columns], sample[columns + 1]));
+							unsigned short cellMax = std::max(std::max(sample[0], sample[1]), std::max(sample[columns], sample[columns + 1]));
+							if (cellMin > high || cellMax < low) {
+								continue;
+							}
+							CellTriangles(column, row, func);
+						}
+					}
+				}
+			}
+		}
+
+		//Calls func with the triangles of each cell the ray passes over, in order along it,
+		//with func returning the new maxDistance
+		template<class F>
+		void Raycast(const Vector3& origin, const Vector3& direction, float maxDistance, F func) const {
+			if (samples.empty()) {
+				return;
+			}
+			Vector3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+			Vector3 gridMin(corner.x, minHeight, corner.z);
+			Vector3 gridMax(corner.x + (columns - 1) * spacing, maxHeight, corner.z + (rows - 1) * spacing);
+			float entry;
+			if (!GameDemo::BoxTests::RayBox(origin, inverse, maxDistance, gridMin, gridMax, entry)) {
+				return;
+			}
+			Vector3 start	= origin + direction * entry;
+			int column		= std::clamp((int)floorf((start.x - corner.x) / spacing), 0, columns - 2);
+			int row			= std::clamp((int)floorf((start.z - corner.z) / spacing), 0, rows - 2);
+			int columnStep	= direction.x > 0.0f ? 1 : -1;
+			int rowStep		= direction.z > 0.0f ? 1 : -1;
+
+			//How far along the ray it crosses into the next column and row, and how far apart each crossing is
+			float nextColumn		= FLT_MAX;
+			float nextRow			= FLT_MAX;
+			float columnDistance	= FLT_MAX;
+			float rowDistance		= FLT_MAX;
+			if (direction.x != 0.0f) {
+				nextColumn		= (corner.x + (column + (columnStep > 0 ? 1 : 0)) * spacing - origin.x) * inverse.x;
+				columnDistance	= spacing * fabsf(inverse.x);
+			}
+			if (direction.z != 0.0f) {
+				nextRow		= (corner.z + (row + (rowStep > 0 ? 1 : 0)) * spacing - origin.z) * inverse.z;
+				rowDistance	= spacing * fabsf(inverse.z);
+			}
+			while (true) {
+				float exit = std::min(nextColumn, nextRow);
+				CellTriangles(column, row, [&](const Vector3& a, const Vector3& b, const Vector3& c) {
+					maxDistance = func(a, b, c, maxDistance);
+				});
+				//Nothing in a later cell can be nearer than a hit in this one
+				if (maxDistance <= exit) {
+					return;
+				}
+				if (nextColumn < nextRow) {
+					column		+= columnStep;
+					nextColumn	+= columnDistance;
+				}
+				else {
+					row		+= rowStep;
+					nextRow	+= rowDistance;
+				}
+				if (column < 0 || column > columns - 2 || row < 0 || row > rows - 2) {
+					return;
+				}
+			}
+		}
+
+	protected:
+		struct Block {
+			unsigned short minimum;
+			unsigned short maximum;
+		};
+
+		//Both triangles are wound so that their normals face up
+		template<class F>
+		void CellTriangles(int column, int row, F func) const {
+			Vector3 p00 = GetPoint(column, row);
+			Vector3 p10 = GetPoint(column + 1, row);
+			Vector3 p01 = GetPoint(column, row + 1);
+			Vector3 p11 = GetPoint(column + 1, row + 1);
+			func(p00, p01, p11);
+			func(p00, p11, p10);
+		}
+
+		std::vector<unsigned short>	samples;
+		std::vector<Block>			blocks;
+
+		int		columns;
+		int		rows;
+		int		blockColumns;
+		float	spacing;
+
+		Vector3 corner;			//The local position of the first sample, at a height of 0
+		float	minHeight;
+		float	maxHeight;
+		float	heightStep;		//The height of one step of a sample
+		float	inverseStep;
+		Vector3	halfSizes;
+	};
+}
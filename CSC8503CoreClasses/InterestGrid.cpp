@@ -0,0 +1,94 @@
+#include "InterestGrid.h"
+
+using namespace NCL;
+using namespace GameDemo;
+
+InterestGrid::InterestGrid(float radius, float fullRateRadius) {
+	this->radius			= std::max(radius, 0.0f);
+	this->fullRateRadius	= std::clamp(fullRateRadius, 0.001f, this->radius);
+	cellSize	= std::max(this->radius * 0.5f, 0.001f);
+	originX		= 0.0f;
+	originZ		= 0.0f;
+	columns		= 0;
+	rows		= 0;
+}
+
+/*
+A counting sort - one pass to count each cell's objects, a prefix sum to turn the counts
+into where each cell starts, and a second pass to put every object in its place - so
+the grid is rebuilt from scratch every tick in linear time, into the same arrays.
+*/
+void InterestGrid::Build(const std::vector<NetworkObject*>& objects) {
+	unsorted.clear();
+	float minX = FLT_MAX;
+	float minZ = FLT_MAX;
+	float maxX = -FLT_MAX;
+	float maxZ = -FLT_MAX;
+	for (NetworkObject* o : objects) {
+		const NetworkState* state = o->GetLatestNetworkState();
+		if (!state) {
+			continue;
+		}
+		unsorted.push_back({ o, state->position });
+		minX = std::min(minX, state->position.x);
+		minZ = std::min(minZ, state->position.z);
+		maxX = std::max(maxX, state->position.x);
+		maxZ = std::max(maxZ, state->position.z);
+	}
+	items.resize(unsorted.size());
+	if (items.empty()) {
+		columns = 0;
+		rows	= 0;
+		cellStarts.assign(1, 0);
+		return;
+	}
+	float extent = std::max(maxX - minX, maxZ - minZ);
+	cellSize	= std::max(radius * 0.5f, extent / (INTEREST_GRID_MAX_CELLS - 1));
+	cellSize	= std::max(cellSize, 0.001f);
+	originX		= minX;
+	originZ		= minZ;
+	columns		= std::min((int)((maxX - minX) / cellSize) + 1, INTEREST_GRID_MAX_CELLS);
+	rows		= std::min((int)((maxZ - minZ) / cellSize) + 1, INTEREST_GRID_MAX_CELLS);
+
+	cellStarts.assign(columns * rows + 1, 0);
+	itemCells.resize(unsorted.size());
+	for (size_t i = 0; i < unsorted.size(); ++i) {
+		int column	= std::min((int)((unsorted[i].position.x - originX) / cellSize), columns - 1);
+		int row		= std::min((int)((unsorted[i].position.z - originZ) / cellSize), rows - 1);
+		itemCells[i] = row * columns + column;
+		cellStarts[itemCells[i] + 1]++;
+	}
+	for (int i = 0; i < columns * rows; ++i) {
+		cellStarts[i + 1] += cellStarts[i];
+	}
+	//Placed from the back, counting each cell's end back down to where it starts
+	cellEnds.assign(cellStarts.begin() + 1, cellStarts.end());
+	for (size_t i = unsorted.size(); i-- > 0;) {
+		items[--cellEnds[itemCells[i]]] = unsorted[i];
+	}
+}
+
+void InterestGrid::GetCandidates(const Vector3& position, std::vector<SnapshotBuilder::Candidate>& candidates) const {
+	if (columns == 0) {
+		return;
+	}
+	int firstColumn	= (int)std::clamp(floorf((position.x - radius - originX) / cellSize), 0.0f, (float)columns);
+	int lastColumn	= (int)std::clamp(floorf((position.x + radius - originX) / cellSize), -1.0f, (float)columns - 1);
+	int firstRow	= (int)std::clamp(floorf((position.z - radius - originZ) / cellSize), 0.0f, (float)rows);
+	int lastRow		= (int)std::clamp(floorf((position.z + radius - originZ) / cellSize), -1.0f, (float)rows - 1);
+
+	float radiusSquared = radius * radius;
+	for (int row = firstRow; row <= lastRow; ++row) {
+		//A row's cells are next to each other, so its items are one unbroken run
+		int first	= cellStarts[row * columns + firstColumn];
+		int last	= cellStarts[row * columns + lastColumn + 1];
+		for (int i = first; i < last; ++i) {
+			float distanceSquared = (items[i].position - position).LengthSquared();
+			if (distanceSquared > radiusSquared) {
+				continue;
+			}
+			float distance = sqrtf(distanceSquared);
+			candidates.push_back({ items[i].object, distance <= fullRateRadius ? 1.0f : fullRateRadius / distance });
+		}
+	}
+}
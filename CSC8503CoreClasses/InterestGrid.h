@@ -0,0 +1,59 @@
+#pragma once
+#include "SnapshotBuilder.h"
+
+namespace NCL::GameDemo {
+	//However far apart the networked objects are, the grid is never more cells than this across
+	const int INTEREST_GRID_MAX_CELLS = 256;
+
+	/*
+	Decides which networked objects each client hears about, and how often, from how far
+	they are from that client's player. Once a tick, the objects' recorded positions are
+	bucketed into a flat grid of cells across x and z, half the interest radius wide, so
+	finding everything near a player only looks at the few cells around it - the cost of
+	a client's snapshot then depends on how crowded its surroundings are, not on how big
+	the level is.
+
+	Anything within fullRateRadius is a candidate for every tick. Past that, the rate
+	falls off with distance, so at twice that distance an object only earns an update
+	every other tick, and at four times every fourth, out to the interest radius, past
+	which the client isn't sent it at all.
+	*/
+	class InterestGrid {
+	public:
+		InterestGrid(float radius = 100.0f, float fullRateRadius = 25.0f);
+		~InterestGrid() {
+		}
+
+		//Objects without a recorded state are left out
+		void Build(const std::vector<NetworkObject*>& objects);
+
+		//Adds every object within the interest radius of position to candidates
+		void GetCandidates(const Vector3& position, std::vector<SnapshotBuilder::Candidate>& candidates) const;
+
+		float GetRadius() const {
+			return radius;
+		}
+
+	protected:
+		struct Item {
+			NetworkObject*	object;
+			Vector3			position;
+		};
+
+		std::vector<Item>	items;			//Sorted by cell
+		std::vector<int>	cellStarts;		//Each cell's first item, with one more at the end
+
+		//Only used while building, but kept so they don't have to be reallocated every tick
+		std::vector<Item>	unsorted;
+		std::vector<int>	itemCells;
+		std::vector<int>	cellEnds;
+
+		float	radius;
+		float	fullRateRadius;
+		float	cellSize;		//Of the last grid built, which can be bigger than half the radius
+		float	originX;
+		float	originZ;
+		int		columns;
+		int		rows;
+	};
+}
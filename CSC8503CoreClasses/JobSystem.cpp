@@ -0,0 +1,134 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+using namespace NCL;
+using namespace GameDemo;
+
+//Which system the current thread is working for, and its index within it
+static thread_local const JobSystem*	currentSystem = nullptr;
+static thread_local int					currentThread = 0;
+
+JobSystem::JobSystem(int workerCount) {
+	if (workerCount < 0) {
+		workerCount = std::max((int)std::thread::hardware_concurrency() - 1, 0);
+	}
+	queuedJobs	= 0;
+	quit		= false;
+
+	for (int i = 0; i <= workerCount; ++i) {
+		queues.emplace_back(new JobQueue());
+	}
+	for (int i = 1; i <= workerCount; ++i) {
+		workers.emplace_back(&JobSystem::WorkerThread, this, i);
+	}
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		quit = true;
+	}
+	wakeUp.notify_all();
+	for (std::thread& t : workers) {
+		t.join();
+	}
+	for (JobQueue* q : queues) {
+		delete q;
+	}
+}
+
+int JobSystem::GetCurrentThread() const {
+	return currentSystem == this ? currentThread : 0;
+}
+
+void JobSystem::ParallelFor(int count, int batchSize, const JobFunc& func) {
+	if (count <= 0) {
+		return;
+	}
+	int thread = GetCurrentThread();
+	batchSize = std::max(batchSize, 1);
+
+	//Not worth waking anyone up for
+	if (workers.empty() || count <= batchSize) {
+		func(0, count, thread);
+		return;
+	}
+
+	int batchCount = (count + batchSize - 1) / batchSize;
+	std::atomic<int> remaining(batchCount);
+	{
+		JobQueue& queue = *queues[thread];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		for (int first = 0; first < count; first += batchSize) {
+			queue.jobs.push_back({ &func, first, std::min(first + batchSize, count), &remaining });
+		}
+	}
+	{
+		//Taking the lock here means a worker can't miss the wake up between
+		//checking for jobs and going to sleep
+		std::lock_guard<std::mutex> guard(sleepLock);
+		queuedJobs += batchCount;
+	}
+	wakeUp.notify_all();
+
+	while (remaining > 0) {
+		if (!RunJob(thread)) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::WorkerThread(int thread) {
+	currentSystem = this;
+	currentThread = thread;
+
+	while (true) {
+		if (RunJob(thread)) {
+			continue;
+		}
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wakeUp.wait(guard, [&] { return quit || queuedJobs > 0; });
+		if (quit) {
+			return;
+		}
+	}
+}
+
+bool JobSystem::RunJob(int thread) {
+	Job job;
+	if (!PopJob(thread, job) && !StealJob(thread, job)) {
+		return false;
+	}
+	queuedJobs--;
+	(*job.func)(job.first, job.last, thread);
+	job.remaining->fetch_sub(1);
+	return true;
+}
+
+//Our own jobs are taken newest first, as they're the most likely to still be in cache
+bool JobSystem::PopJob(int thread, Job& job) {
+	JobQueue& queue = *queues[thread];
+	std::lock_guard<std::mutex> guard(queue.lock);
+	if (queue.jobs.empty()) {
+		return false;
+	}
+	job = queue.jobs.back();
+	queue.jobs.pop_back();
+	return true;
+}
+
+//...whereas other threads' jobs are taken oldest first, which tend to be the biggest
+bool JobSystem::StealJob(int thread, Job& job) {
+	int threadCount = (int)queues.size();
+	for (int i = 1; i < threadCount; ++i) {
+		JobQueue& queue = *queues[(thread + i) % threadCount];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		if (queue.jobs.empty()) {
+			continue;
+		}
+		job = queue.jobs.front();
+		queue.jobs.pop_front();
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace NCL {
+	namespace GameDemo {
+		/*
+		A small pool of worker threads for splitting up loops. Every thread (the one
+		that owns the system counts as thread 0) has its own deque of jobs - it takes
+		work from the back of its own, and when that runs dry, steals from the front
+		of someone else's. The thread that starts a ParallelFor works on it too, and
+		doesn't return until every job from it has finished.
+
+		Jobs are told which thread is running them, so they can write into per-thread
+		storage without any locking. ParallelFor should only be called from the thread
+		that created the system, or from inside one of its jobs.
+		*/
+		class JobSystem {
+		public:
+			typedef std::function<void(int first, int last, int thread)> JobFunc;
+
+			//A negative worker count means one per hardware thread, minus the caller
+			JobSystem(int workerCount = -1);
+			~JobSystem();
+
+			int GetThreadCount() const {
+				return (int)queues.size();
+			}
+
+			//Runs func over [0, count) in batches of up to batchSize indices
+			void ParallelFor(int count, int batchSize, const JobFunc& func);
+
+		protected:
+			struct Job {
+				const JobFunc*		func;
+				int					first;
+				int					last;
+				std::atomic<int>*	remaining;
+			};
+
+			struct JobQueue {
+				std::mutex		lock;
+				std::deque<Job>	jobs;
+			};
+
+			void WorkerThread(int thread);
+			bool RunJob(int thread);
+			bool PopJob(int thread, Job& job);
+			bool StealJob(int thread, Job& job);
+
+			int GetCurrentThread() const;
+
+			std::vector<JobQueue*>		queues;
+			std::vector<std::thread>	workers;
+
+			std::mutex				sleepLock;
+			std::condition_variable	wakeUp;
+			std::atomic<int>		queuedJobs;
+			std::atomic<bool>		quit;
+		};
+	}
+}
@@ -11,8 +11,9 @@ enum BasicNetworkMessages {
 	String_Message,
 	Delta_State,	//1 byte per channel since the last state
 	Full_State,		//Full transform etc
+	Snapshot_State,	//Many objects' full and delta states, packed together
 	Received_State, //received from a client, informs that its received packet n
-	Player_Connected,
+	Player_Connected,	//Also sent on by the server, to tell clients about the player it spawned
 	Player_Disconnected,
 	Shutdown
 };
@@ -1,127 +1,205 @@
 #include "NetworkObject.h"
 #include "./enet/enet.h"
+#include <algorithm>
 using namespace NCL;
 using namespace GameDemo;
 
-NetworkObject::NetworkObject(GameObject& o, int id) : object(o)	{
+NetworkObject::NetworkObject(GameObject& o, int id, const SnapshotQuantizer& quantizer) : object(o), quantizer(quantizer)	{
 	deltaErrors = 0;
 	fullErrors  = 0;
 	networkID   = id;
+	latestTick	= -1;
+	priority	= 1.0f;
 }
 
 NetworkObject::~NetworkObject()	{
 }
 
 bool NetworkObject::ReadPacket(GamePacket& p) {
+	if (p.type == Delta_State) {
+		return ReadDeltaPacket((DeltaPacket&)p);
+	}
+	if (p.type == Full_State) {
+		return ReadFullPacket((FullPacket&)p);
+	}
 	return false; //this isn't a packet we care about!
 }
 
 bool NetworkObject::WritePacket(GamePacket** p, bool deltaFrame, int stateID) {
-	if (deltaFrame) {
-		if (!WriteDeltaPacket(p, stateID)) {
-			return WriteFullPacket(p);
-		}
+	if (deltaFrame && WriteDeltaPacket(p, stateID)) {
+		return true;
 	}
 	return WriteFullPacket(p);
 }
-//Client objects receive these packets
-bool NetworkObject::ReadDeltaPacket(DeltaPacket &p) {
-	if (p.fullID != lastFullState.stateID) {
-		return false;
+
+/*
+A delta can only be read if this end still has the same baseline the server took it
+from - if it doesn't, the tick is lost, and the server will keep taking deltas from an
+older tick until it runs out of history and sends the whole state instead.
+*/
+bool NetworkObject::ReadState(BitReader& stream, int type, int tick, int baselineTick) {
+	QuantizedState state;
+	if (type == Delta_State) {
+		const NetworkState* baseline = GetNetworkState(baselineTick);
+		quantizer.ReadDelta(stream, baseline ? baseline->quantized : QuantizedState(), state);
+		if (stream.HasOverflowed() || !baseline) {
+			deltaErrors++;
+			return false;
+		}
+	}
+	else {
+		quantizer.ReadState(stream, state);
+		if (stream.HasOverflowed()) {
+			fullErrors++;
+			return false;
+		}
 	}
-	UpdateStateHistory(p.fullID);
+	StoreState(tick, state);
+	//Ticks can arrive out of order, so this isn't always the newest
+	latestTick = std::max(latestTick, tick);
+	return true;
+}
 
-	Vector3 fullPos = lastFullState.position;
-	Quaternion fullOrientation = lastFullState.orientation;
+int NetworkObject::WriteState(BitWriter& stream, const NetworkState* baseline) {
+	const NetworkState* state = GetLatestNetworkState();
+	if (!state) {
+		return None;
+	}
+	if (!baseline) {
+		quantizer.WriteState(stream, state->quantized);
+		return Full_State;
+	}
+	if (state->quantized == baseline->quantized) {
+		return None;
+	}
+	quantizer.WriteDelta(stream, baseline->quantized, state->quantized);
+	return Delta_State;
+}
 
-	fullPos.x += p.pos[0];
-	fullPos.y += p.pos[1];
-	fullPos.z += p.pos[2];
-	
-	fullOrientation.x += ((float)p.orientation[0]) / 127.0f;
-	fullOrientation.y += ((float)p.orientation[1]) / 127.0f;
-	fullOrientation.z += ((float)p.orientation[2]) / 127.0f;
-	fullOrientation.y += ((float)p.orientation[3]) / 127.0f;
+void NetworkObject::RecordState(int tick) {
+	Transform& transform	= object.GetTransform();
+	PhysicsObject* physics	= object.GetPhysicsObject();
+	Vector3 velocity		= physics ? physics->GetLinearVelocity() : Vector3();
+	StoreState(tick, quantizer.Quantize(transform.GetPosition(), transform.GetOrientation(), velocity));
+	latestTick = std::max(latestTick, tick);
+}
 
-	object.GetTransform().SetPosition(fullPos);
-	object.GetTransform().SetOrientation(fullOrientation);
-	return true;
+void NetworkObject::CopyState(int fromTick, int toTick) {
+	const NetworkState* state = GetNetworkState(fromTick);
+	if (state && !GetNetworkState(toTick)) {
+		StoreState(toTick, state->quantized).copied = true;
+	}
 }
 
-bool NetworkObject::ReadFullPacket(FullPacket &p) {
-	if (p.fullState.stateID < lastFullState.stateID) {
-		return false;
+/*
+Positions follow a cubic hermite curve between the states either side of the tick, which
+leaves and arrives at each state with the velocity the server had there, so objects
+don't visibly change direction at every state the way they would moving in straight
+lines. Orientations are just blended, as they don't turn far in a tick.
+
+A state that was only carried forward might not be where the object really was, as it
+may just not have been sent, so it's skipped - unless it's at rest, as anything that was
+sat still and then moved will move again from where it was sat.
+*/
+void NetworkObject::Interpolate(float tick, float tickLength, float maxExtrapolation) {
+	auto isKnown = [](const NetworkState* s) {
+		return s && (!s->copied || s->linearVelocity == Vector3());
+	};
+	const NetworkState* from	= nullptr;
+	const NetworkState* to		= nullptr;
+	int first = std::min((int)floorf(tick), latestTick);
+	for (int t = first; t >= 0 && t > latestTick - STATE_HISTORY_SIZE && !from; --t) {
+		const NetworkState* s = GetNetworkState(t);
+		from = isKnown(s) ? s : nullptr;
+	}
+	if (!from) {
+		return;	//Nothing old enough yet, or nothing new for so long that it's already where it'll stay
+	}
+	for (int t = from->stateID + 1; t <= latestTick && !to; ++t) {
+		const NetworkState* s = GetNetworkState(t);
+		to = isKnown(s) ? s : nullptr;
 	}
-	lastFullState = p.fullState;
 
-	object.GetTransform().SetPosition(lastFullState.position);
-	object.GetTransform().SetOrientation(lastFullState.orientation);
+	Transform& transform = object.GetTransform();
+	if (!to) {
+		float ahead = std::clamp(tick - from->stateID, 0.0f, maxExtrapolation) * tickLength;
+		transform.SetPosition(from->position + from->linearVelocity * ahead);
+		transform.SetOrientation(from->orientation);
+		return;
+	}
+	float duration	= (to->stateID - from->stateID) * tickLength;
+	float s			= std::clamp((tick - from->stateID) / (to->stateID - from->stateID), 0.0f, 1.0f);
+	float s2		= s * s;
+	float s3		= s2 * s;
+	transform.SetPosition(
+		from->position			* (2.0f * s3 - 3.0f * s2 + 1.0f) +
+		from->linearVelocity	* ((s3 - 2.0f * s2 + s) * duration) +
+		to->position			* (3.0f * s2 - 2.0f * s3) +
+		to->linearVelocity		* ((s3 - s2) * duration)
+	);
+	Quaternion orientation = Quaternion::Lerp(from->orientation, to->orientation, s);
+	orientation.Normalise();
+	transform.SetOrientation(orientation);
+}
 
-	stateHistory.emplace_back(lastFullState);
+//Client objects receive these packets
+bool NetworkObject::ReadDeltaPacket(DeltaPacket &p) {
+	BitReader stream(p.data, std::min((int)p.size, MAX_STATE_PACKET_BYTES));
+	if (stream.Read(NETWORK_ID_BITS) != (networkID & BitWriter::Mask(NETWORK_ID_BITS))) {
+		return false;
+	}
+	int tick = (int)stream.Read(32);
+	int age	 = (int)stream.Read(BASELINE_AGE_BITS);
+	return ReadState(stream, Delta_State, tick, tick - age);
+}
 
-	return true;
+bool NetworkObject::ReadFullPacket(FullPacket &p) {
+	BitReader stream(p.data, std::min((int)p.size, MAX_STATE_PACKET_BYTES));
+	if (stream.Read(NETWORK_ID_BITS) != (networkID & BitWriter::Mask(NETWORK_ID_BITS))) {
+		return false;
+	}
+	int tick = (int)stream.Read(32);
+	return ReadState(stream, Full_State, tick, -1);
 }
 
+//Server objects send these packets
 bool NetworkObject::WriteDeltaPacket(GamePacket**p, int stateID) {
-	DeltaPacket* dp = new DeltaPacket();
-	NetworkState state;
-	if (!GetNetworkState(stateID, state)) {
+	const NetworkState* baseline	= GetNetworkState(stateID);
+	const NetworkState* state		= GetLatestNetworkState();
+	if (!baseline || !state || state->stateID <= stateID || state->stateID - stateID >= STATE_HISTORY_SIZE) {
 		return false;
 	}
-
-	dp->fullID = stateID;
-	dp->objectID = networkID;
-
-	Vector3 currentPos = object.GetTransform().GetPosition();
-	Quaternion currentOrientation = object.GetTransform().GetOrientation();
-
-	currentPos -= state.position;
-	currentOrientation -= state.orientation;
-
-	dp->pos[0] = (char)currentPos.x;
-	dp->pos[1] = (char)currentPos.y;
-	dp->pos[2] = (char)currentPos.z;
-
-	dp->orientation[0] = (char)(currentOrientation.x * 127.0f);
-	dp->orientation[1] = (char)(currentOrientation.y * 127.0f);
-	dp->orientation[2] = (char)(currentOrientation.z * 127.0f);
-	dp->orientation[3] = (char)(currentOrientation.w * 127.0f);
+	DeltaPacket* dp = new DeltaPacket();
+	BitWriter stream(dp->data, MAX_STATE_PACKET_BYTES);
+	stream.Write(networkID, NETWORK_ID_BITS);
+	stream.Write(state->stateID, 32);
+	stream.Write(state->stateID - stateID, BASELINE_AGE_BITS);
+	quantizer.WriteDelta(stream, baseline->quantized, state->quantized);
+	dp->size = (short)stream.GetByteCount();
 	*p = dp;
 	return true;
 }
 
 bool NetworkObject::WriteFullPacket(GamePacket**p) {
+	const NetworkState* state = GetLatestNetworkState();
+	if (!state) {
+		return false;
+	}
 	FullPacket* fp = new FullPacket();
-
-	fp->objectID = networkID;
-	fp->fullState.position = object.GetTransform().GetPosition();
-	fp->fullState.orientation = object.GetTransform().GetOrientation();
-	fp->fullState.stateID = lastFullState.stateID++;
+	BitWriter stream(fp->data, MAX_STATE_PACKET_BYTES);
+	stream.Write(networkID, NETWORK_ID_BITS);
+	stream.Write(state->stateID, 32);
+	quantizer.WriteState(stream, state->quantized);
+	fp->size = (short)stream.GetByteCount();
 	*p = fp;
 	return true;
 }
 
-NetworkState& NetworkObject::GetLatestNetworkState() {
-	return lastFullState;
+NetworkState& NetworkObject::StoreState(int tick, const QuantizedState& quantized) {
+	NetworkState& state = stateHistory[tick & (STATE_HISTORY_SIZE - 1)];
+	state.stateID	= tick;
+	state.quantized = quantized;
+	state.copied	= false;
+	quantizer.Dequantize(quantized, state.position, state.orientation, state.linearVelocity);
+	return state;
 }
-
-bool NetworkObject::GetNetworkState(int stateID, NetworkState& state) {
-	for (auto i = stateHistory.begin(); i < stateHistory.end(); ++i) {
-		if ((*i).stateID == stateID) {
-			state = (*i);
-			return true;
-		}
-	}
-	return false;
-}
-
-void NetworkObject::UpdateStateHistory(int minID) {
-	for (auto i = stateHistory.begin(); i < stateHistory.end();) {
-		if ((*i).stateID < minID) {
-			i = stateHistory.erase(i);
-		}
-		else {
-			++i;
-		}
-	}
-}
\ No newline at end of file
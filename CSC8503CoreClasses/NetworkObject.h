@@ -6,70 +6,140 @@
 namespace NCL::GameDemo {
 	class GameObject;
 
-	struct FullPacket : public GamePacket {
-		int		objectID = -1;
-		NetworkState fullState;
+	//How many ticks of states each end keeps to take deltas from - at 20hz, a little over
+	//a second and a half, past which a client that hasn't acknowledged anything is sent
+	//whole states again. It has to be a power of two
+	const int STATE_HISTORY_SIZE = 32;
+	//A delta's baseline is sent as how many ticks older than the state it is
+	const int BASELINE_AGE_BITS = 5;
+	static_assert(STATE_HISTORY_SIZE <= (1 << BASELINE_AGE_BITS));
+	//Enough for a whole state, or the largest possible delta, with the object's ID - with
+	//the widest settings SnapshotQuantizer allows, a delta can take up to 273 bits
+	const int MAX_STATE_PACKET_BYTES = 40;
+
+	/*
+	An object's state, bit packed by its SnapshotQuantizer - the object's ID and the tick
+	of the state come first, then for a delta the age of the tick it was taken from, then
+	the state itself. size only counts the bytes the bits filled, so that's all that gets sent.
+	*/
+	struct StatePacket : public GamePacket {
+		unsigned char data[MAX_STATE_PACKET_BYTES];
+
+		StatePacket(short type) : GamePacket(type) {
+		}
 
-		FullPacket() {
-			type = Full_State;
-			size = sizeof(FullPacket) - sizeof(GamePacket);
+		//Which object it's for, so it can be handed to the right one
+		int GetObjectID() const {
+			BitReader stream(data, size);
+			return (int)stream.Read(NETWORK_ID_BITS);
 		}
 	};
 
-	struct DeltaPacket : public GamePacket {
-		int		fullID		= -1;
-		int		objectID	= -1;
-		char	pos[3];
-		char	orientation[4];
+	struct FullPacket : public StatePacket {
+		FullPacket() : StatePacket(Full_State) {
+		}
+	};
 
-		DeltaPacket() {
-			type = Delta_State;
-			size = sizeof(DeltaPacket) - sizeof(GamePacket);
+	struct DeltaPacket : public StatePacket {
+		DeltaPacket() : StatePacket(Delta_State) {
 		}
 	};
 
+	//Sent by clients every update, with lastID the latest tick they have all of, which the
+	//server then takes that client's deltas from
 	struct ClientPacket : public GamePacket {
 		int		lastID;
 		char	buttonstates[8];
 
-		ClientPacket() {
+		ClientPacket() : GamePacket(Received_State) {
+			lastID = -1;
+			for (char& b : buttonstates) {
+				b = 0;
+			}
 			size = sizeof(ClientPacket) - sizeof(GamePacket);
 		}
 	};
 
+	/*
+	Both ends keep the object's last STATE_HISTORY_SIZE states in a ring, each in the slot
+	of the tick it was for. A server records the object's state once a tick, however
+	many clients it then writes it for; a client stores each state it reads, or carries
+	the last one forward if a tick didn't mention the object, so that it always holds the
+	same baselines the server takes its deltas from.
+
+	Clients don't move the object as states arrive, but every frame, to wherever it was at
+	a point a little behind the newest state - see Interpolate.
+	*/
 	class NetworkObject		{
 	public:
-		NetworkObject(GameObject& o, int id);
+		NetworkObject(GameObject& o, int id, const SnapshotQuantizer& quantizer = SnapshotQuantizer::Default());
 		virtual ~NetworkObject();
 
 		//Called by clients
 		virtual bool ReadPacket(GamePacket& p);
-		//Called by servers
+		//Called by servers, with the latest recorded state, as a delta from stateID if it's still held
 		virtual bool WritePacket(GamePacket** p, bool deltaFrame, int stateID);
 
-		void UpdateStateHistory(int minID);
+		//The same, but as part of a bigger stream that says which ticks it's for, without
+		//the object's ID. type is the Full_State or Delta_State that was written, or None if
+		//the object hasn't changed since the baseline and so nothing needed to be
+		virtual bool	ReadState(BitReader& stream, int type, int tick, int baselineTick);
+		virtual int		WriteState(BitWriter& stream, const NetworkState* baseline);
+
+		//Called by servers once a tick, before writing anything for it
+		void RecordState(int tick);
+		//Called by clients for a tick that didn't include this object
+		void CopyState(int fromTick, int toTick);
+
+		//Called by clients every frame, with the tick to show the object at, which is usually
+		//between two that have arrived, and how long a tick is in seconds. Past the last
+		//state, the object carries on at its last velocity for up to maxExtrapolation ticks
+		void Interpolate(float tick, float tickLength, float maxExtrapolation);
+
+		//nullptr if the tick's slot has been reused since
+		const NetworkState* GetNetworkState(int tick) const {
+			const NetworkState& state = stateHistory[tick & (STATE_HISTORY_SIZE - 1)];
+			return tick >= 0 && state.stateID == tick ? &state : nullptr;
+		}
 
-	protected:
+		const NetworkState* GetLatestNetworkState() const {
+			return GetNetworkState(latestTick);
+		}
 
-		NetworkState& GetLatestNetworkState();
+		int GetNetworkID() const {
+			return networkID;
+		}
+
+		//Scales how often the object is sent - see SnapshotBuilder
+		float GetPriority() const {
+			return priority;
+		}
 
-		bool GetNetworkState(int frameID, NetworkState& state);
+		void SetPriority(float value) {
+			priority = value;
+		}
 
+	protected:
 		virtual bool ReadDeltaPacket(DeltaPacket &p);
 		virtual bool ReadFullPacket(FullPacket &p);
 
 		virtual bool WriteDeltaPacket(GamePacket**p, int stateID);
 		virtual bool WriteFullPacket(GamePacket**p);
 
+		NetworkState& StoreState(int tick, const QuantizedState& quantized);
+
 		GameObject& object;
 
-		NetworkState lastFullState;
+		const SnapshotQuantizer& quantizer;
 
-		std::vector<NetworkState> stateHistory;
+		NetworkState stateHistory[STATE_HISTORY_SIZE];
+		int latestTick;		//Of the newest state recorded, or read and applied to the object
 
 		int deltaErrors;
 		int fullErrors;
 
 		int networkID;
+
+		float priority;
 	};
-}
\ No newline at end of file
+}
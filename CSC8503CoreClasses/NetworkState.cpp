@@ -4,7 +4,9 @@ using namespace NCL;
 using namespace GameDemo;
 
 NetworkState::NetworkState()	{
-	stateID = 0;
+	stateID		= -1;	//Not the state of any tick yet
+	copied		= false;
+	quantized	= {};
 }
 
 NetworkState::~NetworkState()	{
@@ -1,4 +1,5 @@
 #pragma once
+#include "SnapshotQuantizer.h"
 
 namespace NCL {
 	using namespace Maths;
@@ -11,7 +12,14 @@ namespace NCL {
 
 			Vector3		position;
 			Quaternion	orientation;
+			Vector3		linearVelocity;
 			int			stateID;
+
+			//Carried forward from an earlier tick the server didn't send anything new for
+			bool		copied;
+
+			//Exactly what was sent, which deltas against this state are taken from
+			QuantizedState quantized;
 		};
 	}
 }
@@ -0,0 +1,170 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <utility>
+#include <functional>
+
+namespace NCL {
+	namespace GameDemo {
+		//For caches that only need to know which pairs are in them
+		struct PairCacheEmpty {
+		};
+
+		//What a pair's hash is built from - by default whatever std::hash gives, which
+		//for a pointer is its address
+		template<class T>
+		struct PairCacheKey {
+			uint64_t operator()(const T& t) const {
+				return (uint64_t)std::hash<T>()(t);
+			}
+		};
+
+		/*
+		A hash map from an ordered pair of objects to a value, built for the per-step
+		pair lists - the broadphase's candidate pairs and the collision list. Entries are
+		kept packed in one array, in the order they were added, so going through them is
+		a straight walk through memory, and the array doubles as the list handed to the
+		narrowphase. Finding a pair goes through a separate open addressing table of
+		entry indices, which is only ever half full, so lookups rarely probe far.
+
+		Nothing is allocated once the arrays have grown to fit the busiest step -
+		Clear and RemoveIf keep their capacity.
+
+		K turns each object of a pair into the number it's hashed by. Pairs are still
+		matched on the objects themselves, so K only has to be stable, not unique - but
+		keying on something like a world ID rather than an address means the table is
+		laid out, and probed, the same way every run.
+		*/
+		template<class T, class V = PairCacheEmpty, class K = PairCacheKey<T>>
+		class PairCache {
+		public:
+			struct Entry {
+				T a;
+				T b;
+				V value;
+			};
+
+			PairCache() {
+				mask = 0;
+			}
+			~PairCache() {
+			}
+
+			void Clear() {
+				entries.clear();
+				if (!table.empty()) {
+					memset(table.data(), 0xff, table.size() * sizeof(int));
+				}
+			}
+
+			V* Find(const T& a, const T& b) {
+				int slot = FindSlot(a, b);
+				return (slot < 0 || table[slot] < 0) ? nullptr : &entries[table[slot]].value;
+			}
+
+			const V* Find(const T& a, const T& b) const {
+				int slot = FindSlot(a, b);
+				return (slot < 0 || table[slot] < 0) ? nullptr : &entries[table[slot]].value;
+			}
+
+			//Returns the pair's value, and whether it's just been added with a default value
+			std::pair<V*, bool> Insert(const T& a, const T& b) {
+				if ((entries.size() + 1) * 2 > table.size()) {
+					Grow();
+				}
+				int slot = FindSlot(a, b);
+				if (table[slot] >= 0) {
+					return { &entries[table[slot]].value, false };
+				}
+				table[slot] = (int)entries.size();
+				entries.push_back({ a, b, V() });
+				return { &entries.back().value, true };
+			}
+
+			/*
+			Calls func(entry) on every entry, and removes those it returns true for, in
+			one pass - the entries left are slid down to stay packed and in order, and
+			the index table is rebuilt afterwards if anything was removed.
+			*/
+			template<class F>
+			void RemoveIf(F func) {
+				size_t kept = 0;
+				for (size_t i = 0; i < entries.size(); ++i) {
+					if (func(entries[i])) {
+						continue;
+					}
+					if (kept != i) {
+						entries[kept] = std::move(entries[i]);
+					}
+					kept++;
+				}
+				if (kept != entries.size()) {
+					entries.resize(kept);
+					Rebuild();
+				}
+			}
+
+			int GetSize() const {
+				return (int)entries.size();
+			}
+
+			Entry& operator[](int i) {
+				return entries[i];
+			}
+			const Entry& operator[](int i) const {
+				return entries[i];
+			}
+
+			typename std::vector<Entry>::iterator begin() {
+				return entries.begin();
+			}
+			typename std::vector<Entry>::iterator end() {
+				return entries.end();
+			}
+
+		protected:
+			static size_t Hash(const T& a, const T& b) {
+				uint64_t h = K()(a) * 0x9E3779B97F4A7C15ull;
+				h ^= K()(b) * 0xC2B2AE3D27D4EB4Full;
+				return (size_t)(h ^ (h >> 29));
+			}
+
+			//The slot holding the pair, or the empty slot it would go in
+			int FindSlot(const T& a, const T& b) const {
+				if (table.empty()) {
+					return -1;
+				}
+				size_t slot = Hash(a, b) & mask;
+				while (true) {
+					int index = table[slot];
+					if (index < 0 || (entries[index].a == a && entries[index].b == b)) {
+						return (int)slot;
+					}
+					slot = (slot + 1) & mask;
+				}
+			}
+
+			void Grow() {
+				table.resize(table.empty() ? 64 : table.size() * 2);
+				mask = table.size() - 1;
+				Rebuild();
+			}
+
+			void Rebuild() {
+				memset(table.data(), 0xff, table.size() * sizeof(int));
+				for (int i = 0; i < (int)entries.size(); ++i) {
+					size_t slot = Hash(entries[i].a, entries[i].b) & mask;
+					while (table[slot] >= 0) {
+						slot = (slot + 1) & mask;
+					}
+					table[slot] = i;
+				}
+			}
+
+			std::vector<Entry>	entries;
+			std::vector<int>	table;	//Indices into entries, or -1 for an empty slot
+			size_t				mask;
+		};
+	}
+}
@@ -0,0 +1,205 @@
+#include "PhysicsBodyStore.h"
+#include "PhysicsObject.h"
+#include "Transform.h"
+#include <algorithm>
+
+using namespace NCL;
+using namespace GameDemo;
+
+PhysicsBodyStore& PhysicsBodyStore::GetUnattached() {
+	static PhysicsBodyStore store;
+	return store;
+}
+
+int PhysicsBodyStore::AddBody(PhysicsObject* owner, Transform* transform) {
+	owners.emplace_back(owner);
+	transforms.emplace_back(transform);
+
+	linearVelocities.emplace_back();
+	forces.emplace_back();
+
+	angularVelocities.emplace_back();
+	torques.emplace_back();
+	inverseInertias.emplace_back();
+	inverseInertiaTensors.emplace_back();
+
+	inverseMasses.emplace_back(0.8f);
+	elasticities.emplace_back(0.8f);
+	frictions.emplace_back(0.8f);
+	coeficients.emplace_back(0.33f);
+
+	awake.emplace_back(1);
+	restingSteps.emplace_back(0);
+	sleepIslands.emplace_back(-1);
+	continuous.emplace_back(0);
+	bodyTypes.emplace_back((char)BodyType::Dynamic);
+
+	return (int)owners.size() - 1;
+}
+
+void PhysicsBodyStore::RemoveBody(int body) {
+	int last = (int)owners.size() - 1;
+	if (body != last) {
+		owners[body]		= owners[last];
+		transforms[body]	= transforms[last];
+
+		linearVelocities[body]	= linearVelocities[last];
+		forces[body]			= forces[last];
+
+		angularVelocities[body]		= angularVelocities[last];
+		torques[body]				= torques[last];
+		inverseInertias[body]		= inverseInertias[last];
+		inverseInertiaTensors[body] = inverseInertiaTensors[last];
+
+		inverseMasses[body] = inverseMasses[last];
+		elasticities[body]	= elasticities[last];
+		frictions[body]		= frictions[last];
+		coeficients[body]	= coeficients[last];
+
+		awake[body]			= awake[last];
+		restingSteps[body]	= restingSteps[last];
+		sleepIslands[body]	= sleepIslands[last];
+		continuous[body]	= continuous[last];
+		bodyTypes[body]		= bodyTypes[last];
+
+		owners[body]->SetBodyIndex(body);
+	}
+	owners.pop_back();
+	transforms.pop_back();
+
+	linearVelocities.pop_back();
+	forces.pop_back();
+
+	angularVelocities.pop_back();
+	torques.pop_back();
+	inverseInertias.pop_back();
+	inverseInertiaTensors.pop_back();
+
+	inverseMasses.pop_back();
+	elasticities.pop_back();
+	frictions.pop_back();
+	coeficients.pop_back();
+
+	awake.pop_back();
+	restingSteps.pop_back();
+	sleepIslands.pop_back();
+	continuous.pop_back();
+	bodyTypes.pop_back();
+
+	awakeCount = std::min(awakeCount, last);
+}
+
+int PhysicsBodyStore::MoveBody(int body, PhysicsBodyStore& to) {
+	if (&to == this) {
+		return body;
+	}
+	PhysicsObject* owner = owners[body];
+	int moved = to.AddBody(owner, transforms[body]);
+
+	to.linearVelocities[moved]	= linearVelocities[body];
+	to.forces[moved]			= forces[body];
+
+	to.angularVelocities[moved]		= angularVelocities[body];
+	to.torques[moved]				= torques[body];
+	to.inverseInertias[moved]		= inverseInertias[body];
+	to.inverseInertiaTensors[moved] = inverseInertiaTensors[body];
+
+	to.inverseMasses[moved] = inverseMasses[body];
+	to.elasticities[moved]	= elasticities[body];
+	to.frictions[moved]		= frictions[body];
+	to.coeficients[moved]	= coeficients[body];
+
+	to.awake[moved]			= awake[body];
+	to.restingSteps[moved]	= restingSteps[body];
+	to.continuous[moved]	= continuous[body];
+	to.bodyTypes[moved]		= bodyTypes[body];
+	if (bodyTypes[body] == (char)BodyType::Dynamic) {
+		to.WakeBody(moved);
+	}
+
+	RemoveBody(body);
+	owner->SetBodyStore(to, moved);
+	return moved;
+}
+
+void PhysicsBodyStore::SwapBodies(int a, int b) {
+	std::swap(owners[a], owners[b]);
+	std::swap(transforms[a], transforms[b]);
+
+	std::swap(linearVelocities[a], linearVelocities[b]);
+	std::swap(forces[a], forces[b]);
+
+	std::swap(angularVelocities[a], angularVelocities[b]);
+	std::swap(torques[a], torques[b]);
+	std::swap(inverseInertias[a], inverseInertias[b]);
+	std::swap(inverseInertiaTensors[a], inverseInertiaTensors[b]);
+
+	std::swap(inverseMasses[a], inverseMasses[b]);
+	std::swap(elasticities[a], elasticities[b]);
+	std::swap(frictions[a], frictions[b]);
+	std::swap(coeficients[a], coeficients[b]);
+
+	std::swap(awake[a], awake[b]);
+	std::swap(restingSteps[a], restingSteps[b]);
+	std::swap(sleepIslands[a], sleepIslands[b]);
+	std::swap(continuous[a], continuous[b]);
+	std::swap(bodyTypes[a], bodyTypes[b]);
+
+	owners[a]->SetBodyIndex(a);
+	owners[b]->SetBodyIndex(b);
+}
+
+int PhysicsBodyStore::PartitionAwake() {
+	int bodyCount = GetBodyCount();
+
+	//A sleeping body that's been woken up takes the rest of its island with it
+	wokenIslands.clear();
+	for (int i = 0; i < bodyCount; ++i) {
+		if (awake[i] && sleepIslands[i] >= 0) {
+			wokenIslands.emplace_back(sleepIslands[i]);
+			sleepIslands[i] = -1;
+		}
+	}
+	if (!wokenIslands.empty()) {
+		std::sort(wokenIslands.begin(), wokenIslands.end());
+		for (int i = 0; i < bodyCount; ++i) {
+			if (!awake[i] && std::binary_search(wokenIslands.begin(), wokenIslands.end(), sleepIslands[i])) {
+				WakeBody(i);
+				sleepIslands[i] = -1;
+			}
+		}
+	}
+
+	int front	= 0;
+	int back	= bodyCount - 1;
+	while (true) {
+		while (front <= back && awake[front]) {
+			front++;
+		}
+		while (front <= back && !awake[back]) {
+			back--;
+		}
+		if (front >= back) {
+			break;
+		}
+		SwapBodies(front, back);
+	}
+	awakeCount = front;
+	return awakeCount;
+}
+
+void PhysicsBodyStore::GatherTransforms(int bodyCount) {
+	positions.resize(bodyCount);
+	orientations.resize(bodyCount);
+	for (int i = 0; i < bodyCount; ++i) {
+		positions[i]	= transforms[i]->GetPosition();
+		orientations[i]	= transforms[i]->GetOrientation();
+	}
+}
+
+void PhysicsBodyStore::ScatterTransforms(int bodyCount) {
+	for (int i = 0; i < bodyCount; ++i) {
+		transforms[i]->SetPosition(positions[i]);
+		transforms[i]->SetOrientation(orientations[i]);
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+using namespace NCL::Maths;
+
+namespace NCL {
+	namespace GameDemo {
+		class Transform;
+		class PhysicsObject;
+
+		/*
+		Dynamic bodies are simulated as normal. Kinematic bodies only move by whatever
+		velocity they're given, and static bodies don't move at all - neither can be
+		pushed by anything, and two of them are never tested against each other.
+		*/
+		enum class BodyType {
+			Dynamic,
+			Kinematic,
+			Static
+		};
+
+		/*
+		Every PhysicsObject's simulation state lives here, in one set of tightly packed
+		arrays, rather than inside the objects themselves. A PhysicsObject is just a
+		handle holding an index into these arrays, so the integration steps can run
+		straight down them without chasing pointers or calling accessors per body.
+
+		Bodies are always kept packed at the front of the arrays - removing a body
+		moves the last one into its slot, and updates that body's handle. Bodies that
+		are awake are also kept ahead of sleeping ones by PartitionAwake, so the
+		integration steps can stop as soon as they reach the first sleeping body.
+
+		Each GameWorld has a store of its own, which only its objects' bodies are in,
+		so two worlds stepped in the same process never touch each other's bodies. A
+		PhysicsObject starts out in the unattached store, which nothing simulates, and
+		is moved across when its GameObject is added to a world.
+		*/
+		class PhysicsBodyStore {
+		public:
+			PhysicsBodyStore() {
+				awakeCount = 0;
+			}
+			~PhysicsBodyStore() {}
+
+			PhysicsBodyStore(const PhysicsBodyStore&) = delete;
+			PhysicsBodyStore& operator=(const PhysicsBodyStore&) = delete;
+
+			//Holds the bodies of objects that aren't in any world
+			static PhysicsBodyStore& GetUnattached();
+
+			int		AddBody(PhysicsObject* owner, Transform* transform);
+			void	RemoveBody(int body);
+
+			//Takes the body out of this store and adds it to another, updating its handle.
+			//Its island is forgotten, as island numbers mean nothing in another store, so a
+			//dynamic body is woken up to find its new one
+			int		MoveBody(int body, PhysicsBodyStore& to);
+
+			//Copies the first bodyCount bodies' positions and orientations into the
+			//staging arrays below, and back out again, so they can be integrated in batches
+			void	GatherTransforms(int bodyCount);
+			void	ScatterTransforms(int bodyCount);
+
+			//Only marks the body - the rest of its island is woken, and the body moved
+			//up with the awake ones, the next time the store is partitioned
+			void	WakeBody(int body) {
+				if (!awake[body]) {
+					awake[body]			= 1;
+					restingSteps[body]	= 0;
+				}
+			}
+
+			//Moves every awake body in front of every sleeping one, returning how many are awake
+			int		PartitionAwake();
+
+			int		GetBodyCount() const {
+				return (int)owners.size();
+			}
+			int		GetAwakeCount() const {
+				return awakeCount;
+			}
+
+			std::vector<PhysicsObject*>	owners;
+			std::vector<Transform*>		transforms;
+
+			std::vector<Vector3>	linearVelocities;
+			std::vector<Vector3>	forces;
+
+			std::vector<Vector3>	angularVelocities;
+			std::vector<Vector3>	torques;
+			std::vector<Vector3>	inverseInertias;
+			std::vector<Matrix3>	inverseInertiaTensors;
+
+			std::vector<float>		inverseMasses;
+			std::vector<float>		elasticities;
+			std::vector<float>		frictions;
+			std::vector<float>		coeficients;
+
+			std::vector<char>		awake;
+			std::vector<int>		restingSteps;	//How many steps in a row the body has been almost still
+			std::vector<int>		sleepIslands;	//Which island a sleeping body went to sleep with, or -1
+			std::vector<char>		continuous;		//Whether the body is swept against the world as it moves
+			std::vector<char>		bodyTypes;		//A BodyType
+
+			//Only valid between GatherTransforms and ScatterTransforms
+			std::vector<Vector3>	positions;
+			std::vector<Quaternion>	orientations;
+
+		protected:
+			void SwapBodies(int a, int b);
+
+			std::vector<int>	wokenIslands;
+			int					awakeCount;
+		};
+	}
+}
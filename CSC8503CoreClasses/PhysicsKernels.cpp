@@ -0,0 +1,393 @@
+#include "PhysicsKernels.h"
+#include "PhysicsBodyStore.h"
+#include "PhysicsKernelsSIMD.h"
+#include "GameTimer.h"
+
+#include <random>
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace NCL;
+using namespace GameDemo;
+
+namespace NCL {
+	namespace GameDemo {
+		//Built separately, with AVX2 and FMA enabled
+		extern const PhysicsKernels avx2PhysicsKernels;
+	}
+}
+
+/*
+The plain versions - these are exactly the steps the PhysicsSystem has always
+used, and are what the wider versions are checked against.
+*/
+static void IntegrateAccelScalar(PhysicsBodyStore& bodies, int first, int count, const Vector3& gravity, float dt) {
+	int last = first + count;
+
+	//Linear stuff
+	for (int i = first; i < last; ++i) {
+		float inverseMass = bodies.inverseMasses[i];
+		Vector3 accel = bodies.forces[i] * inverseMass;
+
+		if (inverseMass > 0) {
+			accel += gravity; //dont move infinitely heavy things
+		}
+		bodies.linearVelocities[i] += accel * dt; //integrate accel!
+	}
+
+	//Angular stuff
+	for (int i = first; i < last; ++i) {
+		//update tensor vs orientation
+		Quaternion q = bodies.orientations[i];
+		bodies.inverseInertiaTensors[i] = Matrix3(q) * Matrix3::Scale(bodies.inverseInertias[i]) * Matrix3(q.Conjugate());
+
+		//friction - infinitely heavy things keep whatever spin they've been given
+		float friction = bodies.inverseMasses[i] > 0 ? bodies.frictions[i] : 0.0f;
+		Vector3 angVel = bodies.angularVelocities[i] * (1.0f - friction * dt);
+		Vector3 angAccel = bodies.inverseInertiaTensors[i] * bodies.torques[i];
+		bodies.angularVelocities[i] = angVel + angAccel * dt; //integrate angular accel!
+	}
+}
+
+static void IntegrateVelocityScalar(PhysicsBodyStore& bodies, int first, int count, float dt, float linearDamping, float angularDamping) {
+	int last = first + count;
+	for (int i = first; i < last; ++i) {
+		//Kinematic bodies move exactly as they're told, so aren't damped
+		bool damped = bodies.inverseMasses[i] > 0;
+
+		//Position Stuff
+		Vector3 linearVel = bodies.linearVelocities[i];
+		bodies.positions[i] += linearVel * dt;
+		//Linear Damping
+		bodies.linearVelocities[i] = damped ? linearVel * linearDamping : linearVel;
+
+		//Orientation Stuff
+		Quaternion orientation = bodies.orientations[i];
+		Vector3 angVel = bodies.angularVelocities[i];
+
+		orientation = orientation + (Quaternion(angVel * dt * 0.5f, 0.0f) * orientation);
+		orientation.Normalise();
+
+		bodies.orientations[i] = orientation;
+
+		//Damp the angular velocity too
+		bodies.angularVelocities[i] = damped ? angVel * angularDamping : angVel;
+	}
+}
+
+/*
+SSE2 versions, 4 bodies at a time. Every x64 CPU has SSE2, so these are
+always available.
+*/
+static void IntegrateAccelSSE(PhysicsBodyStore& bodies, int first, int count, const Vector3& gravity, float dt) {
+	const __m128 zero	= _mm_setzero_ps();
+	const __m128 one	= _mm_set1_ps(1.0f);
+	const __m128 two	= _mm_set1_ps(2.0f);
+	const __m128 step	= _mm_set1_ps(dt);
+	const __m128 gx		= _mm_set1_ps(gravity.x);
+	const __m128 gy		= _mm_set1_ps(gravity.y);
+	const __m128 gz		= _mm_set1_ps(gravity.z);
+
+	alignas(16) float tensor[6][4];
+
+	int last = first + count;
+	for (int i = first; i < last; i += 4) {
+		//Linear stuff
+		__m128 inverseMass	= _mm_loadu_ps(&bodies.inverseMasses[i]);
+		__m128 hasMass		= _mm_cmpgt_ps(inverseMass, zero);
+
+		__m128 fx, fy, fz;
+		__m128 vx, vy, vz;
+		LoadVector3x4(&bodies.forces[i], fx, fy, fz);
+		LoadVector3x4(&bodies.linearVelocities[i], vx, vy, vz);
+
+		__m128 ax = _mm_add_ps(_mm_mul_ps(fx, inverseMass), _mm_and_ps(gx, hasMass));
+		__m128 ay = _mm_add_ps(_mm_mul_ps(fy, inverseMass), _mm_and_ps(gy, hasMass));
+		__m128 az = _mm_add_ps(_mm_mul_ps(fz, inverseMass), _mm_and_ps(gz, hasMass));
+
+		vx = _mm_add_ps(vx, _mm_mul_ps(ax, step));
+		vy = _mm_add_ps(vy, _mm_mul_ps(ay, step));
+		vz = _mm_add_ps(vz, _mm_mul_ps(az, step));
+		StoreVector3x4(&bodies.linearVelocities[i], vx, vy, vz);
+
+		//Angular stuff - the tensor is R * S * R^T, built from the same rotation matrix Matrix3(q) gives
+		__m128 qx, qy, qz, qw;
+		LoadQuaternionx4(&bodies.orientations[i], qx, qy, qz, qw);
+
+		__m128 xx = _mm_mul_ps(qx, qx);
+		__m128 yy = _mm_mul_ps(qy, qy);
+		__m128 zz = _mm_mul_ps(qz, qz);
+		__m128 xy = _mm_mul_ps(qx, qy);
+		__m128 xz = _mm_mul_ps(qx, qz);
+		__m128 yz = _mm_mul_ps(qy, qz);
+		__m128 xw = _mm_mul_ps(qx, qw);
+		__m128 yw = _mm_mul_ps(qy, qw);
+		__m128 zw = _mm_mul_ps(qz, qw);
+
+		//r[row][column]
+		__m128 r00 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+		__m128 r11 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+		__m128 r22 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+		__m128 r10 = _mm_mul_ps(two, _mm_add_ps(xy, zw));
+		__m128 r01 = _mm_mul_ps(two, _mm_sub_ps(xy, zw));
+		__m128 r20 = _mm_mul_ps(two, _mm_sub_ps(xz, yw));
+		__m128 r02 = _mm_mul_ps(two, _mm_add_ps(xz, yw));
+		__m128 r21 = _mm_mul_ps(two, _mm_add_ps(yz, xw));
+		__m128 r12 = _mm_mul_ps(two, _mm_sub_ps(yz, xw));
+
+		__m128 sx, sy, sz;
+		LoadVector3x4(&bodies.inverseInertias[i], sx, sy, sz);
+
+		__m128 a00 = _mm_mul_ps(r00, sx), a01 = _mm_mul_ps(r01, sy), a02 = _mm_mul_ps(r02, sz);
+		__m128 a10 = _mm_mul_ps(r10, sx), a11 = _mm_mul_ps(r11, sy), a12 = _mm_mul_ps(r12, sz);
+		__m128 a20 = _mm_mul_ps(r20, sx), a21 = _mm_mul_ps(r21, sy), a22 = _mm_mul_ps(r22, sz);
+
+		__m128 t00 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a00, r00), _mm_mul_ps(a01, r01)), _mm_mul_ps(a02, r02));
+		__m128 t11 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a10, r10), _mm_mul_ps(a11, r11)), _mm_mul_ps(a12, r12));
+		__m128 t22 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a20, r20), _mm_mul_ps(a21, r21)), _mm_mul_ps(a22, r22));
+		__m128 t01 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a00, r10), _mm_mul_ps(a01, r11)), _mm_mul_ps(a02, r12));
+		__m128 t02 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a00, r20), _mm_mul_ps(a01, r21)), _mm_mul_ps(a02, r22));
+		__m128 t12 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a10, r20), _mm_mul_ps(a11, r21)), _mm_mul_ps(a12, r22));
+
+		_mm_store_ps(tensor[0], t00);
+		_mm_store_ps(tensor[1], t11);
+		_mm_store_ps(tensor[2], t22);
+		_mm_store_ps(tensor[3], t01);
+		_mm_store_ps(tensor[4], t02);
+		_mm_store_ps(tensor[5], t12);
+		StoreSymmetricMatrix3(&bodies.inverseInertiaTensors[i], 4, tensor[0], tensor[1], tensor[2], tensor[3], tensor[4], tensor[5]);
+
+		__m128 tx, ty, tz;
+		__m128 wx, wy, wz;
+		LoadVector3x4(&bodies.torques[i], tx, ty, tz);
+		LoadVector3x4(&bodies.angularVelocities[i], wx, wy, wz);
+
+		//friction, leaving infinitely heavy things alone
+		__m128 damping = _mm_sub_ps(one, _mm_mul_ps(_mm_loadu_ps(&bodies.frictions[i]), step));
+		damping = _mm_or_ps(_mm_and_ps(hasMass, damping), _mm_andnot_ps(hasMass, one));
+
+		__m128 angAccelX = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, t00), _mm_mul_ps(ty, t01)), _mm_mul_ps(tz, t02));
+		__m128 angAccelY = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, t01), _mm_mul_ps(ty, t11)), _mm_mul_ps(tz, t12));
+		__m128 angAccelZ = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, t02), _mm_mul_ps(ty, t12)), _mm_mul_ps(tz, t22));
+
+		wx = _mm_add_ps(_mm_mul_ps(wx, damping), _mm_mul_ps(angAccelX, step));
+		wy = _mm_add_ps(_mm_mul_ps(wy, damping), _mm_mul_ps(angAccelY, step));
+		wz = _mm_add_ps(_mm_mul_ps(wz, damping), _mm_mul_ps(angAccelZ, step));
+		StoreVector3x4(&bodies.angularVelocities[i], wx, wy, wz);
+	}
+}
+
+static void IntegrateVelocitySSE(PhysicsBodyStore& bodies, int first, int count, float dt, float linearDamping, float angularDamping) {
+	const __m128 zero		= _mm_setzero_ps();
+	const __m128 one		= _mm_set1_ps(1.0f);
+	const __m128 half		= _mm_set1_ps(0.5f);
+	const __m128 step		= _mm_set1_ps(dt);
+	const __m128 linDamp	= _mm_set1_ps(linearDamping);
+	const __m128 angDamp	= _mm_set1_ps(angularDamping);
+
+	int last = first + count;
+	for (int i = first; i < last; i += 4) {
+		//Only bodies with mass are damped, as above
+		__m128 hasMass	= _mm_cmpgt_ps(_mm_loadu_ps(&bodies.inverseMasses[i]), zero);
+		__m128 linScale	= _mm_or_ps(_mm_and_ps(hasMass, linDamp), _mm_andnot_ps(hasMass, one));
+		__m128 angScale	= _mm_or_ps(_mm_and_ps(hasMass, angDamp), _mm_andnot_ps(hasMass, one));
+
+		//Position Stuff
+		__m128 px, py, pz;
+		__m128 vx, vy, vz;
+		LoadVector3x4(&bodies.positions[i], px, py, pz);
+		LoadVector3x4(&bodies.linearVelocities[i], vx, vy, vz);
+
+		px = _mm_add_ps(px, _mm_mul_ps(vx, step));
+		py = _mm_add_ps(py, _mm_mul_ps(vy, step));
+		pz = _mm_add_ps(pz, _mm_mul_ps(vz, step));
+		StoreVector3x4(&bodies.positions[i], px, py, pz);
+		StoreVector3x4(&bodies.linearVelocities[i], _mm_mul_ps(vx, linScale), _mm_mul_ps(vy, linScale), _mm_mul_ps(vz, linScale));
+
+		//Orientation Stuff - q += (w * dt * 0.5, 0) * q
+		__m128 qx, qy, qz, qw;
+		__m128 wx, wy, wz;
+		LoadQuaternionx4(&bodies.orientations[i], qx, qy, qz, qw);
+		LoadVector3x4(&bodies.angularVelocities[i], wx, wy, wz);
+
+		__m128 hx = _mm_mul_ps(_mm_mul_ps(wx, step), half);
+		__m128 hy = _mm_mul_ps(_mm_mul_ps(wy, step), half);
+		__m128 hz = _mm_mul_ps(_mm_mul_ps(wz, step), half);
+
+		__m128 dx = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(hx, qw), _mm_mul_ps(hy, qz)), _mm_mul_ps(hz, qy));
+		__m128 dy = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(hy, qw), _mm_mul_ps(hz, qx)), _mm_mul_ps(hx, qz));
+		__m128 dz = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(hz, qw), _mm_mul_ps(hx, qy)), _mm_mul_ps(hy, qx));
+		__m128 dw = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(zero, _mm_mul_ps(hx, qx)), _mm_mul_ps(hy, qy)), _mm_mul_ps(hz, qz));
+
+		qx = _mm_add_ps(qx, dx);
+		qy = _mm_add_ps(qy, dy);
+		qz = _mm_add_ps(qz, dz);
+		qw = _mm_add_ps(qw, dw);
+
+		//Normalise, leaving any zero length quaternions alone
+		__m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)), _mm_add_ps(_mm_mul_ps(qz, qz), _mm_mul_ps(qw, qw))));
+		__m128 valid	= _mm_cmpgt_ps(magnitude, zero);
+		__m128 scale	= _mm_or_ps(_mm_and_ps(valid, _mm_div_ps(one, magnitude)), _mm_andnot_ps(valid, one));
+
+		StoreQuaternionx4(&bodies.orientations[i], _mm_mul_ps(qx, scale), _mm_mul_ps(qy, scale), _mm_mul_ps(qz, scale), _mm_mul_ps(qw, scale));
+
+		//Damp the angular velocity too
+		StoreVector3x4(&bodies.angularVelocities[i], _mm_mul_ps(wx, angScale), _mm_mul_ps(wy, angScale), _mm_mul_ps(wz, angScale));
+	}
+}
+
+static const PhysicsKernels scalarPhysicsKernels	= { "Scalar",	1, IntegrateAccelScalar,	IntegrateVelocityScalar };
+static const PhysicsKernels ssePhysicsKernels		= { "SSE2",		4, IntegrateAccelSSE,		IntegrateVelocitySSE };
+
+static bool CPUSupportsAVX2() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return false;
+	}
+	__cpuid(info, 1);
+	bool osxsave	= (info[2] & (1 << 27)) != 0;
+	bool avx		= (info[2] & (1 << 28)) != 0;
+	bool fma		= (info[2] & (1 << 12)) != 0;
+	if (!osxsave || !avx || !fma) {
+		return false;
+	}
+	//The OS has to be saving the upper halves of the registers too
+	if ((_xgetbv(0) & 0x6) != 0x6) {
+		return false;
+	}
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+const PhysicsKernels& PhysicsKernels::Scalar() {
+	return scalarPhysicsKernels;
+}
+
+const PhysicsKernels& PhysicsKernels::Best() {
+	static const PhysicsKernels& best = CPUSupportsAVX2() ? avx2PhysicsKernels : ssePhysicsKernels;
+	return best;
+}
+
+std::vector<const PhysicsKernels*> PhysicsKernels::GetAvailable() {
+	std::vector<const PhysicsKernels*> available = { &scalarPhysicsKernels, &ssePhysicsKernels };
+	if (CPUSupportsAVX2()) {
+		available.emplace_back(&avx2PhysicsKernels);
+	}
+	return available;
+}
+
+/*
+Fills a store with bodies that have no owners or transforms, which is fine as the
+kernels only ever touch the arrays. They come from a fixed seed, so every set gets
+the same bodies. Every eighth body is infinitely heavy, so the gravity masking is
+checked too.
+*/
+static void AddTestBodies(PhysicsBodyStore& bodies, int bodyCount) {
+	std::mt19937 random(8503);
+	auto nextFloat = [&](float low, float high) {
+		return low + (high - low) * ((float)random() / (float)random.max());
+	};
+	auto nextVector = [&](float low, float high) {
+		return Vector3(nextFloat(low, high), nextFloat(low, high), nextFloat(low, high));
+	};
+
+	for (int i = 0; i < bodyCount; ++i) {
+		int body = bodies.AddBody(nullptr, nullptr);
+		bodies.linearVelocities[body]	= nextVector(-10.0f, 10.0f);
+		bodies.forces[body]				= nextVector(-50.0f, 50.0f);
+		bodies.angularVelocities[body]	= nextVector(-20.0f, 20.0f);
+		bodies.torques[body]			= nextVector(-5.0f, 5.0f);
+		bodies.inverseInertias[body]	= nextVector(0.1f, 2.0f);
+		bodies.inverseMasses[body]		= (i % 8 == 7) ? 0.0f : nextFloat(0.1f, 2.0f);
+		bodies.frictions[body]			= nextFloat(0.0f, 1.0f);
+	}
+	bodies.positions.resize(bodyCount);
+	bodies.orientations.resize(bodyCount);
+	for (int i = 0; i < bodyCount; ++i) {
+		bodies.positions[i] = nextVector(-100.0f, 100.0f);
+
+		Quaternion q(nextFloat(-1.0f, 1.0f), nextFloat(-1.0f, 1.0f), nextFloat(-1.0f, 1.0f), nextFloat(-1.0f, 1.0f));
+		q.Normalise();
+		bodies.orientations[i] = q;
+	}
+}
+
+static void IntegrateTestBodies(const PhysicsKernels& kernels, PhysicsBodyStore& bodies, int bodyCount, int steps) {
+	const float dt = 1.0f / 120.0f;
+	const float damping = 1.0f - (0.4f * dt);
+	for (int i = 0; i < steps; ++i) {
+		kernels.IntegrateAccel(bodies, bodyCount, Vector3(0, -9.8f, 0), dt);
+		kernels.IntegrateVelocity(bodies, bodyCount, dt, damping, damping);
+	}
+}
+
+static float LargestDifference(const Vector3& a, const Vector3& b) {
+	Vector3 d = a - b;
+	return std::max(std::abs(d.x), std::max(std::abs(d.y), std::abs(d.z)));
+}
+
+float PhysicsKernels::Compare(const PhysicsKernels& a, const PhysicsKernels& b, int bodyCount, int steps) {
+	PhysicsBodyStore bodiesA;
+	PhysicsBodyStore bodiesB;
+	AddTestBodies(bodiesA, bodyCount);
+	AddTestBodies(bodiesB, bodyCount);
+
+	IntegrateTestBodies(a, bodiesA, bodyCount, steps);
+	IntegrateTestBodies(b, bodiesB, bodyCount, steps);
+
+	float difference = 0.0f;
+	for (int i = 0; i < bodyCount; ++i) {
+		difference = std::max(difference, LargestDifference(bodiesA.linearVelocities[i], bodiesB.linearVelocities[i]));
+		difference = std::max(difference, LargestDifference(bodiesA.angularVelocities[i], bodiesB.angularVelocities[i]));
+		difference = std::max(difference, LargestDifference(bodiesA.positions[i], bodiesB.positions[i]));
+
+		const Quaternion& qa = bodiesA.orientations[i];
+		const Quaternion& qb = bodiesB.orientations[i];
+		difference = std::max(difference, LargestDifference(Vector3(qa.x, qa.y, qa.z), Vector3(qb.x, qb.y, qb.z)));
+		difference = std::max(difference, std::abs(qa.w - qb.w));
+
+		//Both should still be unit length, not just close to each other
+		difference = std::max(difference, std::abs(std::sqrt(Quaternion::Dot(qa, qa)) - 1.0f));
+		difference = std::max(difference, std::abs(std::sqrt(Quaternion::Dot(qb, qb)) - 1.0f));
+	}
+	return difference;
+}
+
+float PhysicsKernels::Benchmark(const PhysicsKernels& kernels, int bodyCount, int steps) {
+	PhysicsBodyStore bodies;
+	AddTestBodies(bodies, bodyCount);
+
+	GameTimer timer;
+	IntegrateTestBodies(kernels, bodies, bodyCount, steps);
+	timer.Tick();
+	return (bodyCount * (float)steps) / std::max(timer.GetTimeDeltaSeconds() * 1000.0f, 1e-6f);
+}
+
+void PhysicsKernels::IntegrateAccel(PhysicsBodyStore& bodies, int bodyCount, const Vector3& gravity, float dt) const {
+	int batched		= bodyCount - (bodyCount % width);
+	if (batched > 0) {
+		integrateAccel(bodies, 0, batched, gravity, dt);
+	}
+	if (batched < bodyCount) {
+		IntegrateAccelScalar(bodies, batched, bodyCount - batched, gravity, dt);
+	}
+}
+
+void PhysicsKernels::IntegrateVelocity(PhysicsBodyStore& bodies, int bodyCount, float dt, float linearDamping, float angularDamping) const {
+	int batched		= bodyCount - (bodyCount % width);
+	if (batched > 0) {
+		integrateVelocity(bodies, 0, batched, dt, linearDamping, angularDamping);
+	}
+	if (batched < bodyCount) {
+		IntegrateVelocityScalar(bodies, batched, bodyCount - batched, dt, linearDamping, angularDamping);
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "Vector3.h"
+#include <vector>
+
+namespace NCL {
+	using namespace NCL::Maths;
+	namespace GameDemo {
+		class PhysicsBodyStore;
+
+		/*
+		The integration steps, written to run straight down the PhysicsBodyStore
+		arrays. There's a plain version, plus SSE and AVX2 versions which integrate
+		4 or 8 bodies at a time - Best() picks the widest set the CPU can run.
+
+		Bodies past the last full batch are finished off by the plain version, so
+		a kernel set only ever sees counts that are a multiple of its width.
+
+		Only the integration is vectorised - the contact and constraint solving stays
+		scalar. Each solver row reads and writes two bodies picked from anywhere in the
+		store, so it's spread over threads in coloured batches instead.
+		*/
+		struct PhysicsKernels {
+			typedef void(*IntegrateAccelFunc)(PhysicsBodyStore& bodies, int first, int count, const Vector3& gravity, float dt);
+			typedef void(*IntegrateVelocityFunc)(PhysicsBodyStore& bodies, int first, int count, float dt, float linearDamping, float angularDamping);
+
+			const char*				name;
+			int						width;
+			IntegrateAccelFunc		integrateAccel;
+			IntegrateVelocityFunc	integrateVelocity;
+
+			//Both integrate the first bodyCount bodies in the store. Gravity, friction and
+			//damping are only applied to bodies with a non-zero inverse mass, so kinematic
+			//bodies keep exactly the velocity they've been given
+			void IntegrateAccel(PhysicsBodyStore& bodies, int bodyCount, const Vector3& gravity, float dt) const;
+			//Expects the store's positions and orientations to have been gathered first
+			void IntegrateVelocity(PhysicsBodyStore& bodies, int bodyCount, float dt, float linearDamping, float angularDamping) const;
+
+			static const PhysicsKernels& Scalar();
+			static const PhysicsKernels& Best();
+			//Every set this CPU can run, plain first and widest last
+			static std::vector<const PhysicsKernels*> GetAvailable();
+
+			//Integrates the same made up bodies with both sets for a number of steps, and
+			//returns the largest difference in any velocity, position or orientation, or
+			//how far any orientation has drifted from unit length. The bodies spin quickly,
+			//so every step has to renormalise their orientations
+			static float Compare(const PhysicsKernels& a, const PhysicsKernels& b, int bodyCount, int steps);
+			//How many bodies the set integrates per millisecond, over both steps
+			static float Benchmark(const PhysicsKernels& kernels, int bodyCount, int steps);
+		};
+	}
+}
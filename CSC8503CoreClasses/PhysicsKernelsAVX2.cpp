@@ -0,0 +1,210 @@
+/*
+This file is built with AVX2 and FMA enabled, and without the precompiled header
+(which is built without them). Nothing in here may be called unless
+PhysicsKernels::Best() has checked that the CPU supports both.
+*/
+#include <vector>
+#include "Vector3.h"
+#include "Quaternion.h"
+#include "Matrix3.h"
+
+#include "PhysicsKernels.h"
+#include "PhysicsBodyStore.h"
+#include "PhysicsKernelsSIMD.h"
+
+#include <immintrin.h>
+
+using namespace NCL;
+using namespace GameDemo;
+
+static __m256 Combine(__m128 low, __m128 high) {
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+}
+
+static void LoadVector3x8(const Vector3* v, __m256& x, __m256& y, __m256& z) {
+	__m128 x0, y0, z0;
+	__m128 x1, y1, z1;
+	LoadVector3x4(v, x0, y0, z0);
+	LoadVector3x4(v + 4, x1, y1, z1);
+	x = Combine(x0, x1);
+	y = Combine(y0, y1);
+	z = Combine(z0, z1);
+}
+
+static void StoreVector3x8(Vector3* v, __m256 x, __m256 y, __m256 z) {
+	StoreVector3x4(v,		_mm256_castps256_ps128(x),		_mm256_castps256_ps128(y),		_mm256_castps256_ps128(z));
+	StoreVector3x4(v + 4,	_mm256_extractf128_ps(x, 1),	_mm256_extractf128_ps(y, 1),	_mm256_extractf128_ps(z, 1));
+}
+
+static void LoadQuaternionx8(const Quaternion* q, __m256& x, __m256& y, __m256& z, __m256& w) {
+	__m128 x0, y0, z0, w0;
+	__m128 x1, y1, z1, w1;
+	LoadQuaternionx4(q, x0, y0, z0, w0);
+	LoadQuaternionx4(q + 4, x1, y1, z1, w1);
+	x = Combine(x0, x1);
+	y = Combine(y0, y1);
+	z = Combine(z0, z1);
+	w = Combine(w0, w1);
+}
+
+static void StoreQuaternionx8(Quaternion* q, __m256 x, __m256 y, __m256 z, __m256 w) {
+	StoreQuaternionx4(q,		_mm256_castps256_ps128(x),		_mm256_castps256_ps128(y),		_mm256_castps256_ps128(z),		_mm256_castps256_ps128(w));
+	StoreQuaternionx4(q + 4,	_mm256_extractf128_ps(x, 1),	_mm256_extractf128_ps(y, 1),	_mm256_extractf128_ps(z, 1),	_mm256_extractf128_ps(w, 1));
+}
+
+static void IntegrateAccelAVX2(PhysicsBodyStore& bodies, int first, int count, const Vector3& gravity, float dt) {
+	const __m256 zero	= _mm256_setzero_ps();
+	const __m256 one	= _mm256_set1_ps(1.0f);
+	const __m256 two	= _mm256_set1_ps(2.0f);
+	const __m256 step	= _mm256_set1_ps(dt);
+	const __m256 gx		= _mm256_set1_ps(gravity.x);
+	const __m256 gy		= _mm256_set1_ps(gravity.y);
+	const __m256 gz		= _mm256_set1_ps(gravity.z);
+
+	alignas(32) float tensor[6][8];
+
+	int last = first + count;
+	for (int i = first; i < last; i += 8) {
+		//Linear stuff
+		__m256 inverseMass	= _mm256_loadu_ps(&bodies.inverseMasses[i]);
+		__m256 hasMass		= _mm256_cmp_ps(inverseMass, zero, _CMP_GT_OQ);
+
+		__m256 fx, fy, fz;
+		__m256 vx, vy, vz;
+		LoadVector3x8(&bodies.forces[i], fx, fy, fz);
+		LoadVector3x8(&bodies.linearVelocities[i], vx, vy, vz);
+
+		__m256 ax = _mm256_fmadd_ps(fx, inverseMass, _mm256_and_ps(gx, hasMass));
+		__m256 ay = _mm256_fmadd_ps(fy, inverseMass, _mm256_and_ps(gy, hasMass));
+		__m256 az = _mm256_fmadd_ps(fz, inverseMass, _mm256_and_ps(gz, hasMass));
+
+		StoreVector3x8(&bodies.linearVelocities[i], _mm256_fmadd_ps(ax, step, vx), _mm256_fmadd_ps(ay, step, vy), _mm256_fmadd_ps(az, step, vz));
+
+		//Angular stuff - the tensor is R * S * R^T, built from the same rotation matrix Matrix3(q) gives
+		__m256 qx, qy, qz, qw;
+		LoadQuaternionx8(&bodies.orientations[i], qx, qy, qz, qw);
+
+		__m256 xx = _mm256_mul_ps(qx, qx);
+		__m256 yy = _mm256_mul_ps(qy, qy);
+		__m256 zz = _mm256_mul_ps(qz, qz);
+		__m256 xy = _mm256_mul_ps(qx, qy);
+		__m256 xz = _mm256_mul_ps(qx, qz);
+		__m256 yz = _mm256_mul_ps(qy, qz);
+		__m256 xw = _mm256_mul_ps(qx, qw);
+		__m256 yw = _mm256_mul_ps(qy, qw);
+		__m256 zw = _mm256_mul_ps(qz, qw);
+
+		//r[row][column]
+		__m256 r00 = _mm256_fnmadd_ps(two, _mm256_add_ps(yy, zz), one);
+		__m256 r11 = _mm256_fnmadd_ps(two, _mm256_add_ps(xx, zz), one);
+		__m256 r22 = _mm256_fnmadd_ps(two, _mm256_add_ps(xx, yy), one);
+		__m256 r10 = _mm256_mul_ps(two, _mm256_add_ps(xy, zw));
+		__m256 r01 = _mm256_mul_ps(two, _mm256_sub_ps(xy, zw));
+		__m256 r20 = _mm256_mul_ps(two, _mm256_sub_ps(xz, yw));
+		__m256 r02 = _mm256_mul_ps(two, _mm256_add_ps(xz, yw));
+		__m256 r21 = _mm256_mul_ps(two, _mm256_add_ps(yz, xw));
+		__m256 r12 = _mm256_mul_ps(two, _mm256_sub_ps(yz, xw));
+
+		__m256 sx, sy, sz;
+		LoadVector3x8(&bodies.inverseInertias[i], sx, sy, sz);
+
+		__m256 a00 = _mm256_mul_ps(r00, sx), a01 = _mm256_mul_ps(r01, sy), a02 = _mm256_mul_ps(r02, sz);
+		__m256 a10 = _mm256_mul_ps(r10, sx), a11 = _mm256_mul_ps(r11, sy), a12 = _mm256_mul_ps(r12, sz);
+		__m256 a20 = _mm256_mul_ps(r20, sx), a21 = _mm256_mul_ps(r21, sy), a22 = _mm256_mul_ps(r22, sz);
+
+		__m256 t00 = _mm256_fmadd_ps(a02, r02, _mm256_fmadd_ps(a01, r01, _mm256_mul_ps(a00, r00)));
+		__m256 t11 = _mm256_fmadd_ps(a12, r12, _mm256_fmadd_ps(a11, r11, _mm256_mul_ps(a10, r10)));
+		__m256 t22 = _mm256_fmadd_ps(a22, r22, _mm256_fmadd_ps(a21, r21, _mm256_mul_ps(a20, r20)));
+		__m256 t01 = _mm256_fmadd_ps(a02, r12, _mm256_fmadd_ps(a01, r11, _mm256_mul_ps(a00, r10)));
+		__m256 t02 = _mm256_fmadd_ps(a02, r22, _mm256_fmadd_ps(a01, r21, _mm256_mul_ps(a00, r20)));
+		__m256 t12 = _mm256_fmadd_ps(a12, r22, _mm256_fmadd_ps(a11, r21, _mm256_mul_ps(a10, r20)));
+
+		_mm256_store_ps(tensor[0], t00);
+		_mm256_store_ps(tensor[1], t11);
+		_mm256_store_ps(tensor[2], t22);
+		_mm256_store_ps(tensor[3], t01);
+		_mm256_store_ps(tensor[4], t02);
+		_mm256_store_ps(tensor[5], t12);
+		StoreSymmetricMatrix3(&bodies.inverseInertiaTensors[i], 8, tensor[0], tensor[1], tensor[2], tensor[3], tensor[4], tensor[5]);
+
+		__m256 tx, ty, tz;
+		__m256 wx, wy, wz;
+		LoadVector3x8(&bodies.torques[i], tx, ty, tz);
+		LoadVector3x8(&bodies.angularVelocities[i], wx, wy, wz);
+
+		//friction, leaving infinitely heavy things alone
+		__m256 damping = _mm256_fnmadd_ps(_mm256_loadu_ps(&bodies.frictions[i]), step, one);
+		damping = _mm256_blendv_ps(one, damping, hasMass);
+
+		__m256 angAccelX = _mm256_fmadd_ps(tz, t02, _mm256_fmadd_ps(ty, t01, _mm256_mul_ps(tx, t00)));
+		__m256 angAccelY = _mm256_fmadd_ps(tz, t12, _mm256_fmadd_ps(ty, t11, _mm256_mul_ps(tx, t01)));
+		__m256 angAccelZ = _mm256_fmadd_ps(tz, t22, _mm256_fmadd_ps(ty, t12, _mm256_mul_ps(tx, t02)));
+
+		StoreVector3x8(&bodies.angularVelocities[i],
+			_mm256_fmadd_ps(angAccelX, step, _mm256_mul_ps(wx, damping)),
+			_mm256_fmadd_ps(angAccelY, step, _mm256_mul_ps(wy, damping)),
+			_mm256_fmadd_ps(angAccelZ, step, _mm256_mul_ps(wz, damping)));
+	}
+}
+
+static void IntegrateVelocityAVX2(PhysicsBodyStore& bodies, int first, int count, float dt, float linearDamping, float angularDamping) {
+	const __m256 zero		= _mm256_setzero_ps();
+	const __m256 one		= _mm256_set1_ps(1.0f);
+	const __m256 halfStep	= _mm256_set1_ps(dt * 0.5f);
+	const __m256 step		= _mm256_set1_ps(dt);
+	const __m256 linDamp	= _mm256_set1_ps(linearDamping);
+	const __m256 angDamp	= _mm256_set1_ps(angularDamping);
+
+	int last = first + count;
+	for (int i = first; i < last; i += 8) {
+		//Only bodies with mass are damped, as in the plain version
+		__m256 hasMass	= _mm256_cmp_ps(_mm256_loadu_ps(&bodies.inverseMasses[i]), zero, _CMP_GT_OQ);
+		__m256 linScale	= _mm256_blendv_ps(one, linDamp, hasMass);
+		__m256 angScale	= _mm256_blendv_ps(one, angDamp, hasMass);
+
+		//Position Stuff
+		__m256 px, py, pz;
+		__m256 vx, vy, vz;
+		LoadVector3x8(&bodies.positions[i], px, py, pz);
+		LoadVector3x8(&bodies.linearVelocities[i], vx, vy, vz);
+
+		StoreVector3x8(&bodies.positions[i], _mm256_fmadd_ps(vx, step, px), _mm256_fmadd_ps(vy, step, py), _mm256_fmadd_ps(vz, step, pz));
+		StoreVector3x8(&bodies.linearVelocities[i], _mm256_mul_ps(vx, linScale), _mm256_mul_ps(vy, linScale), _mm256_mul_ps(vz, linScale));
+
+		//Orientation Stuff - q += (w * dt * 0.5, 0) * q
+		__m256 qx, qy, qz, qw;
+		__m256 wx, wy, wz;
+		LoadQuaternionx8(&bodies.orientations[i], qx, qy, qz, qw);
+		LoadVector3x8(&bodies.angularVelocities[i], wx, wy, wz);
+
+		__m256 hx = _mm256_mul_ps(wx, halfStep);
+		__m256 hy = _mm256_mul_ps(wy, halfStep);
+		__m256 hz = _mm256_mul_ps(wz, halfStep);
+
+		__m256 dx = _mm256_fnmadd_ps(hz, qy, _mm256_fmadd_ps(hy, qz, _mm256_mul_ps(hx, qw)));
+		__m256 dy = _mm256_fnmadd_ps(hx, qz, _mm256_fmadd_ps(hz, qx, _mm256_mul_ps(hy, qw)));
+		__m256 dz = _mm256_fnmadd_ps(hy, qx, _mm256_fmadd_ps(hx, qy, _mm256_mul_ps(hz, qw)));
+		__m256 dw = _mm256_fmadd_ps(hz, qz, _mm256_fmadd_ps(hy, qy, _mm256_mul_ps(hx, qx)));
+
+		qx = _mm256_add_ps(qx, dx);
+		qy = _mm256_add_ps(qy, dy);
+		qz = _mm256_add_ps(qz, dz);
+		qw = _mm256_sub_ps(qw, dw);
+
+		//Normalise, leaving any zero length quaternions alone
+		__m256 magnitude = _mm256_sqrt_ps(_mm256_fmadd_ps(qw, qw, _mm256_fmadd_ps(qz, qz, _mm256_fmadd_ps(qy, qy, _mm256_mul_ps(qx, qx)))));
+		__m256 valid	= _mm256_cmp_ps(magnitude, zero, _CMP_GT_OQ);
+		__m256 scale	= _mm256_blendv_ps(one, _mm256_div_ps(one, magnitude), valid);
+
+		StoreQuaternionx8(&bodies.orientations[i], _mm256_mul_ps(qx, scale), _mm256_mul_ps(qy, scale), _mm256_mul_ps(qz, scale), _mm256_mul_ps(qw, scale));
+
+		//Damp the angular velocity too
+		StoreVector3x8(&bodies.angularVelocities[i], _mm256_mul_ps(wx, angScale), _mm256_mul_ps(wy, angScale), _mm256_mul_ps(wz, angScale));
+	}
+}
+
+namespace NCL {
+	namespace GameDemo {
+		extern const PhysicsKernels avx2PhysicsKernels = { "AVX2", 8, IntegrateAccelAVX2, IntegrateVelocityAVX2 };
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <emmintrin.h>
+
+/*
+Helpers shared by the SSE and AVX2 integration kernels, for turning runs of
+Vector3s and Quaternions into one register per component and back again.
+
+These are deliberately static rather than inline - each kernel file is built
+with different instruction sets enabled, and must end up with its own copy.
+*/
+namespace NCL {
+	namespace GameDemo {
+		static_assert(sizeof(Vector3)		== 3 * sizeof(float), "Vector3 must be tightly packed");
+		static_assert(sizeof(Quaternion)	== 4 * sizeof(float), "Quaternion must be tightly packed");
+
+		//(x0 y0 z0 x1)(y1 z1 x2 y2)(z2 x3 y3 z3) -> (x0 x1 x2 x3)(y0 y1 y2 y3)(z0 z1 z2 z3)
+		static void LoadVector3x4(const Vector3* v, __m128& x, __m128& y, __m128& z) {
+			const float* f = &v->x;
+			__m128 a = _mm_loadu_ps(f);
+			__m128 b = _mm_loadu_ps(f + 4);
+			__m128 c = _mm_loadu_ps(f + 8);
+
+			x = _mm_shuffle_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 0, 0)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0));
+			y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+			z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+		}
+
+		static void StoreVector3x4(Vector3* v, __m128 x, __m128 y, __m128 z) {
+			float* f = &v->x;
+			_mm_storeu_ps(f,		_mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(f + 4,	_mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(f + 8,	_mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+		}
+
+		static void LoadQuaternionx4(const Quaternion* q, __m128& x, __m128& y, __m128& z, __m128& w) {
+			x = _mm_loadu_ps(q[0].array);
+			y = _mm_loadu_ps(q[1].array);
+			z = _mm_loadu_ps(q[2].array);
+			w = _mm_loadu_ps(q[3].array);
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+		}
+
+		static void StoreQuaternionx4(Quaternion* q, __m128 x, __m128 y, __m128 z, __m128 w) {
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+			_mm_storeu_ps(q[0].array, x);
+			_mm_storeu_ps(q[1].array, y);
+			_mm_storeu_ps(q[2].array, z);
+			_mm_storeu_ps(q[3].array, w);
+		}
+
+		//Writes out the 6 unique entries of a batch of symmetric tensors
+		static void StoreSymmetricMatrix3(Matrix3* m, int count, const float* xx, const float* yy, const float* zz, const float* xy, const float* xz, const float* yz) {
+			for (int i = 0; i < count; ++i) {
+				m[i].array[0][0] = xx[i];
+				m[i].array[1][1] = yy[i];
+				m[i].array[2][2] = zz[i];
+				m[i].array[0][1] = m[i].array[1][0] = xy[i];
+				m[i].array[0][2] = m[i].array[2][0] = xz[i];
+				m[i].array[1][2] = m[i].array[2][1] = yz[i];
+			}
+		}
+	}
+}
@@ -7,46 +7,85 @@ using namespace GameDemo;
 PhysicsObject::PhysicsObject(Transform* parentTransform, const CollisionVolume* parentVolume)	{
 	transform	= parentTransform;
 	volume		= parentVolume;
+	store		= &PhysicsBodyStore::GetUnattached();
 
-	inverseMass = 0.8f;
-	elasticity	= 0.8f;
-	friction	= 0.8f;
+	body = store->AddBody(this, transform);
+
+	dynamicInverseMass = store->inverseMasses[body];
 }
 
 PhysicsObject::~PhysicsObject()	{
-
+	store->RemoveBody(body);
 }
 
+//Infinitely heavy objects are never written to by impulses, which lets the
+//solver batches share them between threads
 void PhysicsObject::ApplyAngularImpulse(const Vector3& force) {
-	angularVelocity += inverseInteriaTensor * force;
+	if (store->inverseMasses[body] == 0.0f) {
+		return;
+	}
+	store->WakeBody(body);
+	store->angularVelocities[body] += store->inverseInertiaTensors[body] * force;
 }
 
 void PhysicsObject::ApplyLinearImpulse(const Vector3& force) {
-	linearVelocity += force * inverseMass;
+	if (store->inverseMasses[body] == 0.0f) {
+		return;
+	}
+	store->WakeBody(body);
+	store->linearVelocities[body] += force * store->inverseMasses[body];
 }
 
 void PhysicsObject::AddForce(const Vector3& addedForce) {
-	force += addedForce;
+	store->WakeBody(body);
+	store->forces[body] += addedForce;
 }
 
 void PhysicsObject::PrintForce() {
+	Vector3 force = store->forces[body];
 	std::cout << "force: x: " << force.x << ", y: " << force.y << ", z: " << force.z << std::endl;
 }
 
 void PhysicsObject::AddForceAtPosition(const Vector3& addedForce, const Vector3& position) {
 	Vector3 localPos = position - transform->GetPosition();
 
-	force  += addedForce;
-	torque += Vector3::Cross(localPos, addedForce);
+	store->WakeBody(body);
+	store->forces[body]  += addedForce;
+	store->torques[body] += Vector3::Cross(localPos, addedForce);
 }
 
 void PhysicsObject::AddTorque(const Vector3& addedTorque) {
-	torque += addedTorque;
+	store->WakeBody(body);
+	store->torques[body] += addedTorque;
 }
 
 void PhysicsObject::ClearForces() {
-	force				= Vector3();
-	torque				= Vector3();
+	store->forces[body]	= Vector3();
+	store->torques[body]	= Vector3();
+}
+
+void PhysicsObject::SetBodyType(BodyType type) {
+	BodyType oldType = GetBodyType();
+	store->bodyTypes[body] = (char)type;
+	if (type == BodyType::Dynamic) {
+		if (oldType != BodyType::Dynamic) {
+			store->inverseMasses[body]		= dynamicInverseMass;
+			store->inverseInertias[body]	= dynamicInverseInertia;
+			store->WakeBody(body);
+		}
+		return;
+	}
+	if (oldType == BodyType::Dynamic) {
+		dynamicInverseMass		= store->inverseMasses[body];
+		dynamicInverseInertia	= store->inverseInertias[body];
+	}
+	store->inverseMasses[body]	= 0.0f;
+	store->inverseInertias[body] = Vector3();
+	if (type == BodyType::Static) {
+		store->linearVelocities[body]	= Vector3();
+		store->angularVelocities[body]	= Vector3();
+		store->awake[body]				= 0;
+	}
 }
 
 void PhysicsObject::InitCubeInertia() {
@@ -56,6 +95,9 @@ void PhysicsObject::InitCubeInertia() {
 
 	Vector3 dimsSqr		= fullWidth * fullWidth;
 
+	float inverseMass	= store->inverseMasses[body];
+	Vector3& inverseInertia = store->inverseInertias[body];
+
 	inverseInertia.x = (12.0f * inverseMass) / (dimsSqr.y + dimsSqr.z);
 	inverseInertia.y = (12.0f * inverseMass) / (dimsSqr.x + dimsSqr.z);
 	inverseInertia.z = (12.0f * inverseMass) / (dimsSqr.x + dimsSqr.y);
@@ -63,9 +105,9 @@ void PhysicsObject::InitCubeInertia() {
 
 void PhysicsObject::InitSphereInertia() {
 	float radius	= transform->GetScale().GetMaxElement();
-	float i			= 2.5f * inverseMass / (radius*radius);
+	float i			= 2.5f * store->inverseMasses[body] / (radius*radius);
 
-	inverseInertia	= Vector3(i, i, i);
+	store->inverseInertias[body]	= Vector3(i, i, i);
 }
 
 void PhysicsObject::UpdateInertiaTensor() {
@@ -74,5 +116,5 @@ void PhysicsObject::UpdateInertiaTensor() {
 	Matrix3 invOrientation	= Matrix3(q.Conjugate());
 	Matrix3 orientation		= Matrix3(q);
 
-	inverseInteriaTensor = orientation * Matrix3::Scale(inverseInertia) *invOrientation;
-}
\ No newline at end of file
+	store->inverseInertiaTensors[body] = orientation * Matrix3::Scale(store->inverseInertias[body]) *invOrientation;
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include "PhysicsBodyStore.h"
 
 using namespace NCL::Maths;
 
@@ -8,42 +9,51 @@ namespace NCL {
 	namespace GameDemo {
 		class Transform;
 
+		/*
+		A handle to a body in a PhysicsBodyStore - all of the simulation state is
+		kept in the store's arrays, so that the PhysicsSystem can integrate every
+		body in one pass. Which store that is changes as the object is added to and
+		removed from worlds.
+		*/
 		class PhysicsObject	{
 		public:
 			PhysicsObject(Transform* parentTransform, const CollisionVolume* parentVolume);
 			~PhysicsObject();
 
+			PhysicsObject(const PhysicsObject&) = delete;
+			PhysicsObject& operator=(const PhysicsObject&) = delete;
+
 			Vector3 GetLinearVelocity() const {
-				return linearVelocity;
+				return store->linearVelocities[body];
 			}
 
 			Vector3 GetAngularVelocity() const {
-				return angularVelocity;
+				return store->angularVelocities[body];
 			}
 
 			Vector3 GetTorque() const {
-				return torque;
+				return store->torques[body];
 			}
 
 			Vector3 GetForce() const {
-				return force;
+				return store->forces[body];
 			}
 
 			void SetInverseMass(float invMass) {
-				inverseMass = invMass;
+				store->inverseMasses[body] = invMass;
 			}
 
 			float GetInverseMass() const {
-				return inverseMass;
+				return store->inverseMasses[body];
 			}
 
-			void SetElasticity(float e) { elasticity = e > 1.0f ? 1.0f : e; }
+			void SetElasticity(float e) { store->elasticities[body] = e > 1.0f ? 1.0f : e; }
 
-			float GetElasticity() { return elasticity; }
+			float GetElasticity() { return store->elasticities[body]; }
 
-			void SetFriction(float f) { friction = f > 1.0f ? 1.0f : f; }
+			void SetFriction(float f) { store->frictions[body] = f > 1.0f ? 1.0f : f; }
 
-			float GetFriction() { return friction; }
+			float GetFriction() { return store->frictions[body]; }
 
 			void ApplyAngularImpulse(const Vector3& force);
 
@@ -59,15 +69,45 @@ namespace NCL {
 
 			void ClearForces();
 
-			void SetCoeficient(float c) { coeficient = c; }
-			float GetCoeficient() { return coeficient; }
+			void SetCoeficient(float c) { store->coeficients[body] = c; }
+			float GetCoeficient() { return store->coeficients[body]; }
 
 			void SetLinearVelocity(const Vector3& v) {
-				linearVelocity = v;
+				store->WakeBody(body);
+				store->linearVelocities[body] = v;
 			}
 
 			void SetAngularVelocity(const Vector3& v) {
-				angularVelocity = v;
+				store->WakeBody(body);
+				store->angularVelocities[body] = v;
+			}
+
+			//Sleeping objects aren't moved or collided with each other until something wakes them
+			bool IsAwake() const {
+				return store->awake[body] != 0;
+			}
+
+			void Wake() {
+				store->WakeBody(body);
+			}
+
+			//Continuous objects are swept along their path each step, and stopped at the
+			//first thing they'd hit, so fast ones can't pass through thin objects
+			void SetContinuous(bool state) {
+				store->continuous[body] = state ? 1 : 0;
+			}
+
+			bool IsContinuous() const {
+				return store->continuous[body] != 0;
+			}
+
+			//Static and kinematic bodies are given an inverse mass of 0, and static ones
+			//are stopped and put to sleep straight away. The mass and inertia they had
+			//as a dynamic body are kept, and given back if they're made dynamic again
+			void SetBodyType(BodyType type);
+
+			BodyType GetBodyType() const {
+				return (BodyType)store->bodyTypes[body];
 			}
 
 			void InitCubeInertia();
@@ -76,28 +116,40 @@ namespace NCL {
 			void UpdateInertiaTensor();
 
 			Matrix3 GetInertiaTensor() const {
-				return inverseInteriaTensor;
+				return store->inverseInertiaTensors[body];
+			}
+
+			const CollisionVolume* GetVolume() const {
+				return volume;
+			}
+
+			int GetBodyIndex() const {
+				return body;
+			}
+
+			void SetBodyIndex(int index) {
+				body = index;
+			}
+
+			PhysicsBodyStore& GetBodyStore() const {
+				return *store;
+			}
+
+			void SetBodyStore(PhysicsBodyStore& newStore, int index) {
+				store	= &newStore;
+				body	= index;
 			}
 
 		protected:
 			const CollisionVolume* volume;
 			Transform*		transform;
-			
-			//coefficient
-			float coeficient = 0.33f;
-			float inverseMass;
-			float elasticity;
-			float friction;
-
-			//linear stuff
-			Vector3 linearVelocity;
-			Vector3 force;
-			
-			//angular stuff
-			Vector3 angularVelocity;
-			Vector3 torque;
-			Vector3 inverseInertia;
-			Matrix3 inverseInteriaTensor;
+
+			PhysicsBodyStore*	store;
+			int					body;
+
+			//What the body had before it was last made static or kinematic
+			float	dynamicInverseMass;
+			Vector3	dynamicInverseInertia;
 		};
 	}
 }
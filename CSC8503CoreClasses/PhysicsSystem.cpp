@@ -9,6 +9,9 @@
 #include "Debug.h"
 #include "Window.h"
 #include <functional>
+#include <algorithm>
+#include <climits>
+#include <cstring>
 using namespace NCL;
 using namespace GameDemo;
 
@@ -18,6 +21,7 @@ PhysicsSystem::PhysicsSystem(GameWorld& g) : gameWorld(g)	{
 	dTOffset		= 0.0f;
 	globalDamping	= 0.995f;
 	SetGravity(GRAVITY);
+	UseSIMDIntegration(true);
 }
 
 PhysicsSystem::~PhysicsSystem()	{
@@ -38,7 +42,24 @@ any collisions they are in.
 
 */
 void PhysicsSystem::Clear() {
-	allCollisions.clear();
+	allCollisions.Clear();
+	broadPhaseSweep.Clear();
+}
+
+void PhysicsSystem::RemoveCollisions(GameObject* o) {
+	auto isInPair = [&](auto& entry) {
+		return entry.a == o || entry.b == o;
+	};
+	allCollisions.RemoveIf(isInPair);
+	broadphaseCollisions.RemoveIf(isInPair);
+	mergedContacts.erase(std::remove_if(mergedContacts.begin(), mergedContacts.end(),
+		[&](const NarrowPhaseContact& c) {
+			return isInPair(c.second);
+		}), mergedContacts.end());
+
+	if (broadPhaseSweep.IsValid(o->GetBroadphaseProxy(), o)) {
+		broadPhaseSweep.Remove(o->GetBroadphaseProxy());
+	}
 }
 
 /*
@@ -47,100 +68,176 @@ This is the core of the physics engine update
 
 */
 
-bool useSimpleContainer = false;
-
-int constraintIterationCount = 10;
-
 //This is the fixed timestep we'd LIKE to have
 const int   idealHZ = 120;
 const float idealDT = 1.0f / idealHZ;
 
-/*
-This is the fixed update we actually have...
-If physics takes too long it starts to kill the framerate, it'll drop the 
-iteration count down until the FPS stabilises, even if that ends up
-being at a low rate. 
-*/
-int realHZ		= idealHZ;
-float realDT	= idealDT;
-
-void PhysicsSystem::Update(float dt) {	
+void PhysicsSystem::UpdateKeys() {
 	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::B)) {
 		useBroadPhase = !useBroadPhase;
 		std::cout << "Setting broad phase to " << useBroadPhase << std::endl;
 	}
 	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::N)) {
-		useSimpleContainer = !useSimpleContainer;
-		std::cout << "Setting broad container to " << useSimpleContainer << std::endl;
+		broadPhaseType = (BroadPhaseType)(((int)broadPhaseType + 1) % (int)BroadPhaseType::Max);
+		std::cout << "Setting broad container to " << (int)broadPhaseType << std::endl;
+	}
+	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::M)) {
+		UseSIMDIntegration(integrationKernels == &PhysicsKernels::Scalar());
+		std::cout << "Setting integration kernels to " << integrationKernels->name << std::endl;
 	}
 	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::I)) {
-		constraintIterationCount--;
+		SetConstraintIterationCount(constraintIterationCount - 1);
 		std::cout << "Setting constraint iterations to " << constraintIterationCount << std::endl;
 	}
 	if (Window::GetKeyboard()->KeyPressed(KeyboardKeys::O)) {
 		constraintIterationCount++;
 		std::cout << "Setting constraint iterations to " << constraintIterationCount << std::endl;
 	}
+}
+
+void PhysicsSystem::Update(float dt) {	
+	UpdateKeys();
 
 	dTOffset += dt; //We accumulate time delta here - there might be remainders from previous frame!
 
-	GameTimer t;
-	t.GetTimeDeltaSeconds();
+	//If physics takes too long it starts to kill the framerate, so the scheduler
+	//trades away solver iterations, and then steps, until it fits in its budget
+	scheduler.SetIterationLimits(MIN_SOLVER_ITERATIONS, constraintIterationCount);
+	int steps = scheduler.BeginFrame(dTOffset, idealDT);
+
+	BeginSteps();
+	for (int i = 0; i < steps; ++i) {
+		Substep(idealDT, scheduler.GetIterationCount());
+	}
+	EndSteps();
+
+	scheduler.EndFrame(steps, stageTimes);
+}
+
+/*
+Advances the simulation by exactly one step of fixedDt, with none of Update's
+reliance on the keyboard or on how long anything takes. Given the same world, set
+up in the same order, and the same inputs between steps, every run gives the same
+results down to the last bit - which lets a server run at a fixed tick, and lets
+sessions be replayed or checked against each other in lockstep. The one caveat is
+the integration kernels, which can round differently from each other, so machines
+meant to agree should be made to use the same ones with UseSIMDIntegration.
+*/
+void PhysicsSystem::Step(float fixedDt) {
+	BeginSteps();
+	Substep(fixedDt, constraintIterationCount);
+	EndSteps();
+}
+
+void PhysicsSystem::BeginSteps() {
+	broadPhasePairCount = 0;
+	integratedBodyCount	= 0;
+	collisionListTime	= 0.0f;
+	for (float& time : stageTimes) {
+		time = 0.0f;
+	}
 
 	if (useBroadPhase) {
 		UpdateObjectAABBs();
 	}
-	int iteratorCount = 0;
-	
-	while(dTOffset > realDT) {
-		IntegrateAccel(realDT); //Update accelerations from external forces
-		if (useBroadPhase) {
-			BroadPhase();
-			NarrowPhase();
-		}
-		else {
-			BasicCollisionDetection();
-		}
+	BuildConstraintBatches();
+}
 
-		//This is our simple iterative solver - 
-		//we just run things multiple times, slowly moving things forward
-		//and then rechecking that the constraints have been met		
-		float constraintDt = realDT /  (float)constraintIterationCount;
-		for (int i = 0; i < constraintIterationCount; ++i) {
-			UpdateConstraints(constraintDt);	
-		}
-		IntegrateVelocity(realDT); //update positions from new velocity changes
+void PhysicsSystem::Substep(float dt, int iterations) {
+	GameTimer timer;
+	IntegrateAccel(dt); //Update accelerations from external forces
+	timer.Tick();
+	stageTimes[(int)PhysicsStage::Integrate] += timer.GetTimeDeltaSeconds();
 
-		dTOffset -= realDT;
-		iteratorCount++;
+	if (useBroadPhase) {
+		BroadPhase();
+		timer.Tick();
+		stageTimes[(int)PhysicsStage::BroadPhase] += timer.GetTimeDeltaSeconds();
+		broadPhasePairCount += broadphaseCollisions.GetSize();
+		NarrowPhase();
+	}
+	else {
+		BasicCollisionDetection();
+	}
+	timer.Tick();
+	stageTimes[(int)PhysicsStage::NarrowPhase] += timer.GetTimeDeltaSeconds();
+
+	//This is our simple iterative solver - 
+	//we just run things multiple times, slowly moving things forward
+	//and then rechecking that the constraints have been met		
+	PrepareContacts(dt);
+	float constraintDt = dt /  (float)iterations;
+	for (int i = 0; i < iterations; ++i) {
+		UpdateConstraints(constraintDt);	
+		SolveContacts();
+	}
+	StoreContacts();
+	timer.Tick();
+	stageTimes[(int)PhysicsStage::Solve] += timer.GetTimeDeltaSeconds();
+
+	IntegrateVelocity(dt); //update positions from new velocity changes
+	timer.Tick();
+	stageTimes[(int)PhysicsStage::Integrate] += timer.GetTimeDeltaSeconds();
+
+	if (UsesObjectTree()) {
+		gameWorld.UpdateObjectTree();
+		timer.Tick();
+		stageTimes[(int)PhysicsStage::BroadPhase] += timer.GetTimeDeltaSeconds();
 	}
 
+	if (useSleeping) {
+		UpdateIslands();
+		timer.Tick();
+		stageTimes[(int)PhysicsStage::Solve] += timer.GetTimeDeltaSeconds();
+	}
+	stepCount++;
+}
+
+void PhysicsSystem::EndSteps() {
 	ClearForces();	//Once we've finished with the forces, reset them to zero
 
+	GameTimer listTimer;
 	UpdateCollisionList(); //Remove any old collisions
+	listTimer.Tick();
+	collisionListTime += listTimer.GetTimeDeltaSeconds();
 
-	t.Tick();
-	float updateTime = t.GetTimeDeltaSeconds();
-
-	//Uh oh, physics is taking too long...
-	if (updateTime > realDT) {
-		realHZ /= 2;
-		realDT *= 2;
-		std::cout << "Dropping iteration count due to long physics time...(now " << realHZ << ")\n";
+	if (!UsesObjectTree()) {
+		gameWorld.UpdateObjectTree(); //So queries see where everything ended up
 	}
-	else if(dt*2 < realDT) { //we have plenty of room to increase iteration count!
-		int temp = realHZ;
-		realHZ *= 2;
-		realDT /= 2;
+}
 
-		if (realHZ > idealHZ) {
-			realHZ = idealHZ;
-			realDT = idealDT;
+/*
+A hash of every object's position, orientation and velocities, in world order. Two
+runs that are meant to be in lockstep should agree on this after every step, and
+the first step they don't points at where a replay went wrong.
+*/
+unsigned int PhysicsSystem::GetStateChecksum() const {
+	unsigned int hash = 2166136261u;
+	auto addFloats = [&](const float* values, int count) {
+		for (int i = 0; i < count; ++i) {
+			unsigned int bits;
+			memcpy(&bits, &values[i], sizeof(bits));
+			hash = (hash ^ bits) * 16777619u;
 		}
-		if (temp != realHZ) {
-			std::cout << "Raising iteration count due to short physics time...(now " << realHZ << ")\n";
+	};
+	std::vector<GameObject*>::const_iterator first;
+	std::vector<GameObject*>::const_iterator last;
+	gameWorld.GetObjectIterators(first, last);
+	for (auto i = first; i != last; ++i) {
+		const Transform& transform = (*i)->GetTransform();
+		Vector3		position	= transform.GetPosition();
+		Quaternion	orientation = transform.GetOrientation();
+		addFloats(&position.x, 3);
+		addFloats(&orientation.x, 4);
+
+		if (PhysicsObject* phys = (*i)->GetPhysicsObject()) {
+			Vector3 linear	= phys->GetLinearVelocity();
+			Vector3 angular = phys->GetAngularVelocity();
+			addFloats(&linear.x, 3);
+			addFloats(&angular.x, 3);
 		}
 	}
+	return hash;
 }
 
 /*
@@ -155,30 +252,32 @@ OnCollisionBegin / OnCollisionEnd functions (removing health when hit by a
 rocket launcher, gaining a point when the player hits the gold coin, and so on).
 */
 void PhysicsSystem::UpdateCollisionList() {
-	for (std::set<CollisionDetection::CollisionInfo>::iterator i = allCollisions.begin(); i != allCollisions.end(); ) {
-		if ((*i).framesLeft == numCollisionFrames) {
-			i->a->OnCollisionBegin(i->b);
-			i->b->OnCollisionBegin(i->a);
-		}
+	allCollisions.RemoveIf(
+		[&](auto& entry) {
+			CollisionDetection::CollisionInfo& in = entry.value;
+			if (in.framesLeft == numCollisionFrames) {
+				in.a->OnCollisionBegin(in.b);
+				in.b->OnCollisionBegin(in.a);
+			}
 
-		CollisionDetection::CollisionInfo& in = const_cast<CollisionDetection::CollisionInfo&>(*i);
-		in.framesLeft--;
+			in.framesLeft--;
 
-		if ((*i).framesLeft < 0) {
-			i->a->OnCollisionEnd(i->b);
-			i->b->OnCollisionEnd(i->a);
-			i = allCollisions.erase(i);
-		}
-		else {
-			++i;
-		}
-	}
+			if (in.framesLeft < 0) {
+				in.a->OnCollisionEnd(in.b);
+				in.b->OnCollisionEnd(in.a);
+				return true;
+			}
+			return false;
+		});
 }
 
+//Baked objects never move, so their boxes never need updating
 void PhysicsSystem::UpdateObjectAABBs() {
 	gameWorld.OperateOnContents(
 		[](GameObject* g) {
-			g->UpdateBroadphaseAABB();
+			if (!g->IsBaked()) {
+				g->UpdateBroadphaseAABB();
+			}
 		}
 	);
 }
@@ -197,6 +296,7 @@ void PhysicsSystem::BasicCollisionDetection() {
 	std::vector<GameObject*>::const_iterator last;
 	gameWorld.GetObjectIterators(first, last);
 
+	mergedContacts.clear();
 	for (auto i = first; i != last; ++i) {
 		if ((*i)->GetPhysicsObject() == nullptr) {
 			continue;
@@ -205,84 +305,234 @@ void PhysicsSystem::BasicCollisionDetection() {
 			if ((*j)->GetPhysicsObject() == nullptr) {
 				continue;
 			}
+			if (!IsAwake(*i) && !IsAwake(*j)) {
+				continue;
+			}
+			if (!GameObject::ShouldCollide(**i, **j)) {
+				continue;
+			}
 			CollisionDetection::CollisionInfo info;
 			if (CollisionDetection::ObjectIntersection(*i, *j, info)) {
-				ImpulseResolveCollision(*info.a, *info.b, info.point);
-				info.framesLeft = numCollisionFrames;
-				allCollisions.insert(info);
+				WarmStartContact(info);
+				mergedContacts.emplace_back((int)mergedContacts.size(), info);
 			}
 		}
 	}
 }
 
 /*
-
-In tutorial 5, we start determining the correct response to a collision,
-so that objects separate back out. 
-
+A pair that was touching last step is likely to still need about the same impulses
+to hold it apart, so any of its contact points that haven't moved far pick up the
+impulses they ended up with last time, which the solver then corrects from.
+Only reads the manifold cache, so it's safe to call from the narrowphase jobs.
 */
-void PhysicsSystem::ImpulseResolveCollision(GameObject& a, GameObject& b, CollisionDetection::ContactPoint& p) const {
-	PhysicsObject* physA = a.GetPhysicsObject();
-	PhysicsObject* physB = b.GetPhysicsObject();
-
-	Transform& transformA = a.GetTransform();
-	Transform& transformB = b.GetTransform();
-
-	float totalMass = physA->GetInverseMass() + physB->GetInverseMass();
-
-	if (totalMass == 0) {
-		return; //two static objects??
+void PhysicsSystem::WarmStartContact(CollisionDetection::CollisionInfo& info) const {
+	const CollisionDetection::CollisionInfo* cached = allCollisions.Find(info.a, info.b);
+	//Pairs that weren't touching this frame or last have nothing useful to offer
+	if (cached && cached->framesLeft >= numCollisionFrames - 2) {
+		info.WarmStartFrom(*cached);
 	}
+}
 
-	// Separate them out using projection
-	transformA.SetPosition(transformA.GetPosition() - (p.normal * p.penetration * (physA->GetInverseMass() / totalMass)));
-	transformB.SetPosition(transformB.GetPosition() + (p.normal * p.penetration * (physB->GetInverseMass() / totalMass)));
+/*
+Keeps this step's manifold for the pair. A pair new to the list starts at numCollisionFrames,
+which is what tells UpdateCollisionList to send OnCollisionBegin - one that's already begun
+is only topped back up to just under that.
+*/
+void PhysicsSystem::StoreContact(const CollisionDetection::CollisionInfo& info) {
+	auto inserted = allCollisions.Insert(info.a, info.b);
+	CollisionDetection::CollisionInfo& stored = *inserted.first;
+	int framesLeft = inserted.second ? numCollisionFrames : std::max(stored.framesLeft, numCollisionFrames - 1);
+	stored				= info;
+	stored.framesLeft	= framesLeft;
+}
 
-	Vector3 relativeA = p.localA;
-	Vector3 relativeB = p.localB;
+/*
 
-	Vector3 angVelocityA = Vector3::Cross(physA->GetAngularVelocity(), relativeA);
-	Vector3 angVelocityB = Vector3::Cross(physB->GetAngularVelocity(), relativeB);
+In tutorial 5, we start determining the correct response to a collision,
+so that objects separate back out. 
 
-	Vector3 fullVelocityA = physA->GetLinearVelocity() + angVelocityA;
-	Vector3 fullVelocityB = physB->GetLinearVelocity() + angVelocityB;
+Rather than fixing each contact in one go, every contact point is given a small
+impulse on each solver iteration, alongside the constraints, with the total applied
+at each point kept track of. Fixing one contact upsets its neighbours, but going
+round them all a few times settles on impulses that suit every contact at once.
 
-	Vector3 contactVelocity = fullVelocityB - fullVelocityA;
+The totals are clamped rather than each impulse, so a contact can give back an
+impulse it applied earlier, as long as overall it's only ever pushing the pair
+apart. Rather than moving overlapping objects straight back out, they're given a
+little extra separating velocity (Baumgarte stabilisation), so the velocities the
+solver works with stay valid.
+*/
+void PhysicsSystem::PrepareContacts(float dt) {
+	contactConstraints.resize(mergedContacts.size() * CollisionDetection::MAX_CONTACT_POINTS);
+
+	contactBatches.Build((int)mergedContacts.size(), gameWorld.GetBodyStore().GetBodyCount(),
+		[&](int item, int& bodyA, int& bodyB) {
+			const CollisionDetection::CollisionInfo& info = mergedContacts[item].second;
+			bodyA = GetSolverBody(info.a);
+			bodyB = GetSolverBody(info.b);
+		});
+	//Warm starting moves bodies, so this has to stick to the batches as well
+	contactBatches.Solve(jobSystem, SOLVER_BATCH_SIZE,
+		[&](int item) {
+			PrepareContact(item, dt);
+		});
+}
 
-	float impulseForce = Vector3::Dot(contactVelocity, p.normal);
-	//now to work out the effect of inertia ....
-	Vector3 inertiaA = Vector3::Cross(physA->GetInertiaTensor() * Vector3::Cross(relativeA, p.normal), relativeA);
-	Vector3 inertiaB = Vector3::Cross(physB->GetInertiaTensor() * Vector3::Cross(relativeB, p.normal), relativeB);
-	float angularEffect = Vector3::Dot(inertiaA + inertiaB, p.normal);
+void PhysicsSystem::SolveContacts() {
+	contactBatches.Solve(jobSystem, SOLVER_BATCH_SIZE,
+		[&](int item) {
+			SolveContact(item);
+		});
+}
 
-	float cRestitution = physA->GetCoeficient() + physB->GetCoeficient(); //use coeficient to lose energy
+//Hands the final impulses back to the manifolds, to warm start the next step
+void PhysicsSystem::StoreContacts() {
+	GameTimer listTimer;
+	for (int item = 0; item < (int)mergedContacts.size(); ++item) {
+		CollisionDetection::CollisionInfo& info = mergedContacts[item].second;
+		for (int i = 0; i < info.pointCount; ++i) {
+			const ContactConstraint& c = contactConstraints[item * CollisionDetection::MAX_CONTACT_POINTS + i];
+			info.points[i].normalImpulse	= c.normalImpulse;
+			info.points[i].frictionImpulse	= c.tangents[0] * c.tangentImpulses[0] + c.tangents[1] * c.tangentImpulses[1];
+		}
+		StoreContact(info); //insert info our main set
+	}
+	listTimer.Tick();
+	collisionListTime += listTimer.GetTimeDeltaSeconds();
+}
 
-	float j = (-(1.0f + cRestitution) * impulseForce) / (totalMass + angularEffect);
+void PhysicsSystem::PrepareContact(int item, float dt) {
+	PhysicsBodyStore& bodies = gameWorld.GetBodyStore();
+	const CollisionDetection::CollisionInfo& info = mergedContacts[item].second;
+
+	PhysicsObject* physA = info.a->GetPhysicsObject();
+	PhysicsObject* physB = info.b->GetPhysicsObject();
+
+	int bodyA = GetSolverBody(info.a);
+	int bodyB = GetSolverBody(info.b);
+
+	//Anything the solver can't move counts as having no mass, and not moving
+	float	invMassA = 0.0f;
+	float	invMassB = 0.0f;
+	Matrix3 inertiaA;
+	Matrix3 inertiaB;
+	inertiaA.ToZero();
+	inertiaB.ToZero();
+	if (bodyA >= 0) {
+		invMassA = bodies.inverseMasses[bodyA];
+		inertiaA = bodies.inverseInertiaTensors[bodyA];
+		bodies.WakeBody(bodyA);
+	}
+	if (bodyB >= 0) {
+		invMassB = bodies.inverseMasses[bodyB];
+		inertiaB = bodies.inverseInertiaTensors[bodyB];
+		bodies.WakeBody(bodyB);
+	}
 
-	Vector3 fullImpulse = p.normal * j;
-	physA->ApplyLinearImpulse(-fullImpulse * physB->GetElasticity());
-	physB->ApplyLinearImpulse(fullImpulse * physA->GetElasticity());
+	//A kinematic body can't be pushed, but still moves the way it's been told to, and
+	//nothing the solver does changes that over the step, so its part is worked out here
+	auto kinematicVelocity = [&](PhysicsObject* phys, const Vector3& relative) {
+		if (phys->GetBodyType() != BodyType::Kinematic) {
+			return Vector3();
+		}
+		int body = phys->GetBodyIndex();
+		return bodies.linearVelocities[body] + Vector3::Cross(bodies.angularVelocities[body], relative);
+	};
+
+	float cRestitution	= (physA->GetCoeficient() + physB->GetCoeficient()) * physA->GetElasticity() * physB->GetElasticity();
+	float cFriction		= physA->GetFriction() * physB->GetFriction();
+
+	//How much an impulse along a direction at a point changes the speed the pair close at
+	auto effectiveMass = [&](const Vector3& rA, const Vector3& rB, const Vector3& dir) {
+		Vector3 angularA = Vector3::Cross(inertiaA * Vector3::Cross(rA, dir), rA);
+		Vector3 angularB = Vector3::Cross(inertiaB * Vector3::Cross(rB, dir), rB);
+		float k = invMassA + invMassB + Vector3::Dot(angularA + angularB, dir);
+		return k > 0.0f ? 1.0f / k : 0.0f;
+	};
+
+	for (int i = 0; i < info.pointCount; ++i) {
+		const CollisionDetection::ContactPoint& p = info.points[i];
+		ContactConstraint& c = contactConstraints[item * CollisionDetection::MAX_CONTACT_POINTS + i];
+
+		c.bodyA		= bodyA;
+		c.bodyB		= bodyB;
+		c.relativeA	= p.localA;
+		c.relativeB	= p.localB;
+		c.normal	= p.normal;
+		c.friction	= cFriction;
+		c.kinematicVelocity = kinematicVelocity(physB, c.relativeB) - kinematicVelocity(physA, c.relativeA);
+
+		//Any pair of directions across the contact plane will do for friction
+		if (fabsf(c.normal.x) > 0.57735f) {
+			c.tangents[0] = Vector3(c.normal.y, -c.normal.x, 0.0f).Normalised();
+		}
+		else {
+			c.tangents[0] = Vector3(0.0f, c.normal.z, -c.normal.y).Normalised();
+		}
+		c.tangents[1] = Vector3::Cross(c.normal, c.tangents[0]);
 
-	physA->ApplyAngularImpulse(Vector3::Cross(relativeA, -fullImpulse));
-	physB->ApplyAngularImpulse(Vector3::Cross(relativeB, fullImpulse));
+		c.normalMass		= effectiveMass(c.relativeA, c.relativeB, c.normal);
+		c.tangentMasses[0]	= effectiveMass(c.relativeA, c.relativeB, c.tangents[0]);
+		c.tangentMasses[1]	= effectiveMass(c.relativeA, c.relativeB, c.tangents[1]);
 
+		//Bouncing is decided by how fast the point was closing before anything was solved
+		Vector3 velocityA = bodyA < 0 ? Vector3() : bodies.linearVelocities[bodyA] + Vector3::Cross(bodies.angularVelocities[bodyA], c.relativeA);
+		Vector3 velocityB = bodyB < 0 ? Vector3() : bodies.linearVelocities[bodyB] + Vector3::Cross(bodies.angularVelocities[bodyB], c.relativeB);
+		float closingSpeed = Vector3::Dot(velocityB - velocityA + c.kinematicVelocity, c.normal);
 
-	float cFriction = physA->GetFriction() * physB->GetFriction();
-	Vector3 tangent = contactVelocity - (p.normal * Vector3::Dot(contactVelocity, p.normal));
+		float bounce	= closingSpeed < -RESTITUTION_THRESHOLD ? -cRestitution * closingSpeed : 0.0f;
+		float push		= (CONTACT_BAUMGARTE / dt) * std::max(p.penetration - CONTACT_SLOP, 0.0f);
+		c.bias = std::max(bounce, push);
 
-	Vector3 TinertiaA = Vector3::Cross(physA->GetInertiaTensor() * Vector3::Cross(relativeA, tangent), relativeA);
-	Vector3 TinertiaB = Vector3::Cross(physB->GetInertiaTensor() * Vector3::Cross(relativeB, tangent), relativeB);
+		c.normalImpulse			= p.normalImpulse;
+		c.tangentImpulses[0]	= Vector3::Dot(p.frictionImpulse, c.tangents[0]);
+		c.tangentImpulses[1]	= Vector3::Dot(p.frictionImpulse, c.tangents[1]);
 
-	float TangularEffect = Vector3::Dot(TinertiaA + TinertiaB, tangent);
-	float jt = -(cFriction * Vector3::Dot(contactVelocity, tangent.Normalised()) / (totalMass + TangularEffect));
+		Vector3 impulse = c.normal * c.normalImpulse + c.tangents[0] * c.tangentImpulses[0] + c.tangents[1] * c.tangentImpulses[1];
+		ApplyContactImpulse(bodies, c, impulse);
+	}
+}
 
-	Vector3 frictionImpulse = tangent.Normalised() * jt;
-	physA->ApplyLinearImpulse(-frictionImpulse);
-	physB->ApplyLinearImpulse(frictionImpulse);
+void PhysicsSystem::SolveContact(int item) {
+	PhysicsBodyStore& bodies = gameWorld.GetBodyStore();
+	int pointCount = mergedContacts[item].second.pointCount;
+
+	for (int i = 0; i < pointCount; ++i) {
+		ContactConstraint& c = contactConstraints[item * CollisionDetection::MAX_CONTACT_POINTS + i];
+
+		auto contactVelocity = [&]() {
+			Vector3 velocityA = c.bodyA < 0 ? Vector3() : bodies.linearVelocities[c.bodyA] + Vector3::Cross(bodies.angularVelocities[c.bodyA], c.relativeA);
+			Vector3 velocityB = c.bodyB < 0 ? Vector3() : bodies.linearVelocities[c.bodyB] + Vector3::Cross(bodies.angularVelocities[c.bodyB], c.relativeB);
+			return velocityB - velocityA + c.kinematicVelocity;
+		};
+
+		//Friction first, as it's the less important of the two to get right
+		float maxFriction = c.friction * c.normalImpulse;
+		for (int t = 0; t < 2; ++t) {
+			float j			= -Vector3::Dot(contactVelocity(), c.tangents[t]) * c.tangentMasses[t];
+			float oldImpulse = c.tangentImpulses[t];
+			c.tangentImpulses[t] = std::clamp(oldImpulse + j, -maxFriction, maxFriction);
+			ApplyContactImpulse(bodies, c, c.tangents[t] * (c.tangentImpulses[t] - oldImpulse));
+		}
 
-	physA->ApplyAngularImpulse(Vector3::Cross(relativeA, -frictionImpulse));
-	physB->ApplyAngularImpulse(Vector3::Cross(relativeB, frictionImpulse));
+		float j			= (c.bias - Vector3::Dot(contactVelocity(), c.normal)) * c.normalMass;
+		float oldImpulse = c.normalImpulse;
+		c.normalImpulse	= std::max(oldImpulse + j, 0.0f);
+		ApplyContactImpulse(bodies, c, c.normal * (c.normalImpulse - oldImpulse));
+	}
+}
 
+//Impulses push B along the contact normal, and A the other way
+void PhysicsSystem::ApplyContactImpulse(PhysicsBodyStore& bodies, const ContactConstraint& c, const Vector3& impulse) {
+	if (c.bodyA >= 0) {
+		bodies.linearVelocities[c.bodyA]	-= impulse * bodies.inverseMasses[c.bodyA];
+		bodies.angularVelocities[c.bodyA]	-= bodies.inverseInertiaTensors[c.bodyA] * Vector3::Cross(c.relativeA, impulse);
+	}
+	if (c.bodyB >= 0) {
+		bodies.linearVelocities[c.bodyB]	+= impulse * bodies.inverseMasses[c.bodyB];
+		bodies.angularVelocities[c.bodyB]	+= bodies.inverseInertiaTensors[c.bodyB] * Vector3::Cross(c.relativeB, impulse);
+	}
 }
 //	//physA->ApplyAngularImpulse(Vector3::Cross(relativeA, -physA->GetLinearVelocity()));
 //	//physB->ApplyAngularImpulse(Vector3::Cross(relativeB, -physB->GetLinearVelocity()));
@@ -310,7 +560,17 @@ compare the collisions that we absolutely need to.
 
 */
 void PhysicsSystem::BroadPhase() {
-	broadphaseCollisions.clear();
+	broadphaseCollisions.Clear();
+	switch (broadPhaseType) {
+		case BroadPhaseType::QuadTree:	QuadTreeBroadPhase(); break;
+		case BroadPhaseType::AABBTree:	AABBTreeBroadPhase(); break;
+		case BroadPhaseType::SweepAndPrune:	SweepAndPruneBroadPhase(); break;
+		default: break;
+	}
+	StaticBroadPhase();
+}
+
+void PhysicsSystem::QuadTreeBroadPhase() {
 	QuadTree<GameObject*> tree(Vector2(1024, 1024), 7, 6);
 
 	std::vector<GameObject*>::const_iterator first;
@@ -318,7 +578,7 @@ void PhysicsSystem::BroadPhase() {
 	gameWorld.GetObjectIterators(first, last);
 	for (auto i = first; i != last; ++i) {
 		Vector3 halfSizes;
-		if (!(*i)->GetBroadphaseAABB(halfSizes)) {
+		if ((*i)->IsBaked() || !(*i)->GetBroadphaseAABB(halfSizes)) {
 			continue;
 		}
 		Vector3 pos = (*i)->GetTransform().GetPosition();
@@ -326,33 +586,272 @@ void PhysicsSystem::BroadPhase() {
 	}
 	tree.OperateOnContents(
 		[&](std::list<QuadTreeEntry<GameObject*>>& data) {
-			CollisionDetection::CollisionInfo info;
 			for (auto i = data.begin(); i != data.end(); ++i) {
 				for (auto j = std::next(i); j != data.end(); ++j) {
+					if (!IsAwake((*i).object) && !IsAwake((*j).object)) {
+						continue;
+					}
+					if (!GameObject::ShouldCollide(*(*i).object, *(*j).object)) {
+						continue;
+					}
 					// is this pair of items already in the collision set, if the same pair is in another quadtree node together etc
-					info.a = std::min((*i).object, (*j).object);
-					info.b = std::max((*i).object, (*j).object);
-					broadphaseCollisions.insert(info);
+					AddBroadPhasePair((*i).object, (*j).object);
 				}
 			}
 		});
 }
 
+/*
+Pairs are always put the same way round, whatever order the broadphase found them in.
+This goes by world ID rather than address, so that which object ends up as 'a' - and
+so the direction every contact is solved in - doesn't change from run to run.
+*/
+void PhysicsSystem::AddBroadPhasePair(GameObject* a, GameObject* b) {
+	if (b->GetWorldID() < a->GetWorldID()) {
+		std::swap(a, b);
+	}
+	broadphaseCollisions.Insert(a, b);
+}
+
+/*
+The persistent broadphase containers keep their contents between steps. Each object
+keeps a handle to its proxy, which is updated with the object's latest box - sleeping
+objects haven't moved, so are skipped. Any proxy that didn't get touched this step
+belongs to an object that has left the world, so gets removed.
+*/
+template<class C>
+void PhysicsSystem::UpdateBroadPhaseProxies(C& container) {
+	broadPhaseStamp++;
+
+	std::vector<GameObject*>::const_iterator first;
+	std::vector<GameObject*>::const_iterator last;
+	gameWorld.GetObjectIterators(first, last);
+	for (auto i = first; i != last; ++i) {
+		Vector3 halfSizes;
+		if ((*i)->IsBaked() || !(*i)->GetBroadphaseAABB(halfSizes)) {
+			continue;
+		}
+		Vector3 pos = (*i)->GetTransform().GetPosition();
+		int proxy	= (*i)->GetBroadphaseProxy();
+
+		if (container.IsValid(proxy, *i)) {
+			if (IsAwake(*i)) {
+				container.Update(proxy, pos, halfSizes);
+			}
+		}
+		else {
+			proxy = container.Insert(*i, pos, halfSizes);
+			(*i)->SetBroadphaseProxy(proxy);
+		}
+		container.SetStamp(proxy, broadPhaseStamp);
+	}
+	container.RemoveStale(broadPhaseStamp);
+}
+
+/*
+Rather than building a new QuadTree every step, the world's object tree persists between
+steps, and objects are only moved around the tree when they leave their fattened box. It's
+the same tree the world's ray casts use, so is kept up to date either way - Substep does it
+once each step has moved everything, which leaves it ready for both the next step's pairs
+and any queries between updates. The tree knows every object's layers and body type, so
+pairs that shouldn't collide never reach us here.
+*/
+void PhysicsSystem::AABBTreeBroadPhase() {
+
+	gameWorld.GetObjectTree().OperateOnPairs(
+		[&](GameObject*& a, GameObject*& b) {
+			if (!IsAwake(a) && !IsAwake(b)) {
+				return;
+			}
+			AddBroadPhasePair(a, b);
+		});
+}
+
+/*
+Sort and sweep keeps its endpoint lists sorted from the previous step, so for the
+grid and stacking scenes, where most objects barely move, re-sorting costs very little.
+*/
+void PhysicsSystem::SweepAndPruneBroadPhase() {
+	UpdateBroadPhaseProxies(broadPhaseSweep);
+
+	broadPhaseSweep.OperateOnPairs(
+		[&](GameObject*& a, GameObject*& b) {
+			if (!IsAwake(a) && !IsAwake(b)) {
+				return;
+			}
+			if (!GameObject::ShouldCollide(*a, *b)) {
+				return;
+			}
+			AddBroadPhasePair(a, b);
+		});
+}
+
+/*
+Baked static objects aren't in any of the broadphases above. Instead, every awake
+dynamic object looks itself up in the world's static BVH, which is never rebuilt or
+updated, so static geometry costs nothing until something comes close to it.
+*/
+void PhysicsSystem::StaticBroadPhase() {
+	const StaticBVH<GameObject*>& staticTree = gameWorld.GetStaticTree();
+	if (staticTree.GetItemCount() == 0) {
+		return;
+	}
+	std::vector<GameObject*>::const_iterator first;
+	std::vector<GameObject*>::const_iterator last;
+	gameWorld.GetObjectIterators(first, last);
+	for (auto i = first; i != last; ++i) {
+		GameObject* object = *i;
+		Vector3 halfSizes;
+		if (object->IsBaked() || object->GetBodyType() != BodyType::Dynamic || !IsAwake(object) ||
+			!object->GetBroadphaseAABB(halfSizes)) {
+			continue;
+		}
+		Vector3 pos = object->GetTransform().GetPosition();
+		staticTree.Query(pos - halfSizes, pos + halfSizes,
+			[&](GameObject* other) {
+				if (GameObject::ShouldCollide(*object, *other)) {
+					AddBroadPhasePair(object, other);
+				}
+				return true;
+			});
+	}
+}
+
 /*
 
 The broadphase will now only give us likely collisions, so we can now go through them,
 and work out if they are truly colliding, and if so, add them into the main collision list
+
+The pairs are only read while testing them, so they're split up across the job threads,
+each collecting its contacts separately. These are then put back into broadphase order
+before the solver sees them, so the result doesn't depend on which thread tested what.
 */
 void PhysicsSystem::NarrowPhase() {
-	for (auto i = broadphaseCollisions.begin(); i != broadphaseCollisions.end(); ++i) {
-		i = broadphaseCollisions.begin();
-		auto info = *i;
-		if (CollisionDetection::ObjectIntersection(info.a, info.b, info)) {
-			info.framesLeft = numCollisionFrames;
-			ImpulseResolveCollision(*info.a, *info.b, info.point);
-			allCollisions.insert(info); //insert info our main set
-		 }
+	narrowPhaseContacts.resize(jobSystem.GetThreadCount());
+	for (auto& contacts : narrowPhaseContacts) {
+		contacts.clear();
+	}
+
+	jobSystem.ParallelFor(broadphaseCollisions.GetSize(), NARROWPHASE_BATCH_SIZE,
+		[&](int first, int last, int thread) {
+			std::vector<NarrowPhaseContact>& contacts = narrowPhaseContacts[thread];
+			for (int i = first; i < last; ++i) {
+				const auto& pair = broadphaseCollisions[i];
+				CollisionDetection::CollisionInfo info;
+				if (CollisionDetection::ObjectIntersection(pair.a, pair.b, info)) {
+					WarmStartContact(info);
+					contacts.emplace_back(i, info);
+				}
+			}
+		});
+
+	mergedContacts.clear();
+	for (auto& contacts : narrowPhaseContacts) {
+		mergedContacts.insert(mergedContacts.end(), contacts.begin(), contacts.end());
+	}
+	std::sort(mergedContacts.begin(), mergedContacts.end(),
+		[](const NarrowPhaseContact& a, const NarrowPhaseContact& b) {
+			return a.first < b.first;
+		});
+}
+
+//Objects that can't be moved by the solver don't stop others being solved alongside them
+int PhysicsSystem::GetSolverBody(GameObject* object) {
+	PhysicsObject* phys = object->GetPhysicsObject();
+	if (!phys || phys->GetInverseMass() == 0.0f) {
+		return -1;
+	}
+	return phys->GetBodyIndex();
+}
+
+bool PhysicsSystem::IsAwake(GameObject* object) {
+	PhysicsObject* phys = object->GetPhysicsObject();
+	return phys && phys->IsAwake();
+}
+
+/*
+Bodies that are touching or constrained together form an island, which can only go to
+sleep as a whole - otherwise a sleeping body could be left holding up an awake one. The
+islands are found with a union-find over this step's contacts and the world's constraints.
+Static bodies never join islands together, as nothing they touch can move them.
+*/
+void PhysicsSystem::UpdateIslands() {
+	PhysicsBodyStore& bodies = gameWorld.GetBodyStore();
+	int bodyCount = bodies.GetBodyCount();
+
+	float linearLimit	= SLEEP_LINEAR_VELOCITY * SLEEP_LINEAR_VELOCITY;
+	float angularLimit	= SLEEP_ANGULAR_VELOCITY * SLEEP_ANGULAR_VELOCITY;
+
+	islandParents.resize(bodyCount);
+	islandRestingSteps.assign(bodyCount, INT_MAX);
+	islandLabels.assign(bodyCount, -1);
+	for (int i = 0; i < bodyCount; ++i) {
+		islandParents[i] = i;
+		if (!bodies.awake[i]) {
+			continue;
+		}
+		bool resting =	bodies.linearVelocities[i].LengthSquared() < linearLimit &&
+						bodies.angularVelocities[i].LengthSquared() < angularLimit;
+		bodies.restingSteps[i] = resting ? bodies.restingSteps[i] + 1 : 0;
+	}
+
+	for (const NarrowPhaseContact& contact : mergedContacts) {
+		JoinIslands(GetSolverBody(contact.second.a), GetSolverBody(contact.second.b));
+	}
+	std::vector<Constraint*>::const_iterator first;
+	std::vector<Constraint*>::const_iterator last;
+	gameWorld.GetConstraintIterators(first, last);
+	for (auto i = first; i != last; ++i) {
+		JoinIslands(GetSolverBody((*i)->GetObjectA()), GetSolverBody((*i)->GetObjectB()));
+	}
+
+	for (int i = 0; i < bodyCount; ++i) {
+		if (bodies.awake[i]) {
+			int island = FindIsland(i);
+			islandRestingSteps[island] = std::min(islandRestingSteps[island], bodies.restingSteps[i]);
+		}
+	}
+	for (int i = 0; i < bodyCount; ++i) {
+		if (!bodies.awake[i]) {
+			continue;
+		}
+		int island = FindIsland(i);
+		if (islandRestingSteps[island] < SLEEP_STEPS) {
+			continue;
+		}
+		if (islandLabels[island] < 0) {
+			islandLabels[island] = nextSleepIsland++;
+		}
+		bodies.awake[i]				= 0;
+		bodies.sleepIslands[i]		= islandLabels[island];
+		bodies.linearVelocities[i]	= Vector3();
+		bodies.angularVelocities[i] = Vector3();
+	}
+}
+
+//Anything touching or constrained to an awake body can't stay asleep
+void PhysicsSystem::JoinIslands(int bodyA, int bodyB) {
+	if (bodyA < 0 || bodyB < 0) {
+		return;
+	}
+	PhysicsBodyStore& bodies = gameWorld.GetBodyStore();
+	if (bodies.awake[bodyA] != bodies.awake[bodyB]) {
+		bodies.WakeBody(bodyA);
+		bodies.WakeBody(bodyB);
 	}
+	int islandA = FindIsland(bodyA);
+	int islandB = FindIsland(bodyB);
+	if (islandA != islandB) {
+		islandParents[std::max(islandA, islandB)] = std::min(islandA, islandB);
+	}
+}
+
+int PhysicsSystem::FindIsland(int body) {
+	while (islandParents[body] != body) {
+		islandParents[body] = islandParents[islandParents[body]];
+		body = islandParents[body];
+	}
+	return body;
 }
 
 /*
@@ -365,39 +864,11 @@ based on any forces that have been accumulated in the objects during
 the course of the previous game frame.
 */
 void PhysicsSystem::IntegrateAccel(float dt) {
-	std::vector<GameObject*>::const_iterator first;
-	std::vector<GameObject*>::const_iterator last;
-	gameWorld.GetObjectIterators(first, last);
-
-	for (auto i = first; i != last; ++i) {
-		PhysicsObject* object = (*i)->GetPhysicsObject();
-		if (object == nullptr) {
-			continue; //No physics object for this GameObject!
-		}
-		float inverseMass = object->GetInverseMass();
-
-		Vector3 linearVel = object->GetLinearVelocity();
-		Vector3 force = object->GetForce();
-		Vector3 accel = force * inverseMass;
-
-		if (applyGravity && inverseMass > 0) {
-			accel += gravity; //dont move infinitely heavy things
-		}
+	PhysicsBodyStore& bodies = gameWorld.GetBodyStore();
 
-		
-		linearVel += accel * dt; //integrate accel!
-		object->SetLinearVelocity(linearVel);
-		
-		//Angular stuff
-		Vector3 torque = object->GetTorque();
-		//friction
-		object->SetAngularVelocity(object->GetAngularVelocity() * (1.0f - object->GetFriction() * dt));
-		Vector3 angVel = object->GetAngularVelocity();
-		object->UpdateInertiaTensor(); //update tensor vs orientation
-		Vector3 angAccel = object->GetInertiaTensor() * torque;
-		angVel += angAccel * dt; //integrate angular accel!
-		object->SetAngularVelocity(angVel);
-	}
+	int awakeCount = bodies.PartitionAwake();
+	bodies.GatherTransforms(awakeCount);
+	integrationKernels->IntegrateAccel(bodies, awakeCount, applyGravity ? gravity : Vector3(), dt);
 }
 
 /*
@@ -407,39 +878,119 @@ throughout a physics update, to slowly move the objects through
 the world, looking for collisions.
 */
 void PhysicsSystem::IntegrateVelocity(float dt) {
+	PhysicsBodyStore& bodies = gameWorld.GetBodyStore();
+
+	float frameLinearDamping = 1.0f - (0.4f * dt);
+	float frameAngularDamping = 1.0f - (0.4f * dt);
+
+	int awakeCount = bodies.PartitionAwake(); //Anything hit since IntegrateAccel will have been woken up
+	bodies.GatherTransforms(awakeCount);
+	integrationKernels->IntegrateVelocity(bodies, awakeCount, dt, frameLinearDamping, frameAngularDamping);
+	SweepContinuousBodies(awakeCount);
+	bodies.ScatterTransforms(awakeCount);
+	integratedBodyCount += awakeCount;
+}
+
+/*
+Fast bodies can move further than their own size in a single step, and go straight
+through thin objects without ever being seen overlapping them. Continuous bodies
+are swept from where they were (still held in their transforms) to where they've
+just been integrated to, against every other object, and are pulled back to the
+first thing they hit - just far enough into it that the next step's narrowphase
+picks up the contact, so bouncing and friction are left to the solver as usual.
+
+Other objects are treated as standing still where they were at the start of the
+step, and the swept body's rotation over the step is ignored. Objects it isn't allowed
+to collide with are passed straight through.
+*/
+void PhysicsSystem::SweepContinuousBodies(int awakeCount) {
+	PhysicsBodyStore& bodies = gameWorld.GetBodyStore();
+
 	std::vector<GameObject*>::const_iterator first;
 	std::vector<GameObject*>::const_iterator last;
 	gameWorld.GetObjectIterators(first, last);
-	float frameLinearDamping = 1.0f - (0.4f * dt);
-	float frameAngularDamping = 1.0f - (0.4f * dt);
-	for (auto i = first; i != last; ++i) {
-		PhysicsObject* object = (*i)->GetPhysicsObject();
-		if (object == nullptr) {
+
+	for (auto o = first; o != last; ++o) {
+		PhysicsObject* phys = (*o)->GetPhysicsObject();
+		if (!phys || !(*o)->GetBoundingVolume()) {
 			continue;
 		}
-		Transform& transform = (*i)->GetTransform();
-		//Position Stuff
-		Vector3 position = transform.GetPosition();
-		Vector3 linearVel = object->GetLinearVelocity();
-		position += linearVel * dt;
-		transform.SetPosition(position);
-		//Linear Damping
-		linearVel = linearVel * frameLinearDamping;
-		object->SetLinearVelocity(linearVel);
-
-		//Orientation Stuff
-		Quaternion orientation = transform.GetOrientation();
-		Vector3 angVel = object->GetAngularVelocity();
-
-		orientation = orientation + (Quaternion(angVel  * dt * 0.5f, 0.0f) * orientation);
-		orientation.Normalise();
+		int i = phys->GetBodyIndex();
+		if (i >= awakeCount || !bodies.continuous[i]) {
+			continue;
+		}
+		const Transform& transform = *bodies.transforms[i];
+		Vector3 start	= transform.GetPosition();
+		Vector3 motion	= bodies.positions[i] - start;
+		float	length	= motion.Length();
+
+		Vector3 offsets[3];
+		float	radius = 0.0f;
+		int		sphereCount = GetSweepSpheres(*bodies.owners[i]->GetVolume(), transform.GetOrientation(), offsets, radius);
+		if (sphereCount == 0 || length <= radius * CONTINUOUS_MOTION_FRACTION) {
+			continue;
+		}
+		float reach = radius + offsets[0].Length();
 
-		transform.SetOrientation(orientation);
+		float toi = 1.0f;
+		for (auto j = first; j != last; ++j) {
+			const CollisionVolume* volume = (*j)->GetBoundingVolume();
+			if (!volume || j == o || !GameObject::ShouldCollide(**o, **j)) {
+				continue;
+			}
+			const Transform& otherTransform = (*j)->GetTransform();
+			Vector3 otherPosition	= otherTransform.GetPosition();
+			float	otherReach		= reach + CollisionDetection::GetBoundingRadius(*volume);
+			Vector3 closest = CollisionDetection::ClosestPointOnLine(start, start + motion, otherPosition);
+			if ((closest - otherPosition).LengthSquared() > otherReach * otherReach) {
+				continue;
+			}
+			for (int k = 0; k < sphereCount; ++k) {
+				float hit;
+				if (CollisionDetection::SweptSphereIntersection(start + offsets[k], motion, radius,
+					*volume, otherTransform, CONTINUOUS_TOLERANCE, hit)) {
+					toi = std::min(toi, hit);
+				}
+			}
+		}
+		if (toi < 1.0f) {
+			bodies.positions[i] = start + motion * std::min(1.0f, toi + CONTINUOUS_PENETRATION / length);
+		}
+	}
+}
 
-		//Damp the angular velocity too
-		angVel = angVel * frameAngularDamping;
-		object->SetAngularVelocity(angVel);
+/*
+The spheres a body is swept as, as offsets from its centre - a capsule is swept as
+the spheres at either end of it and one in the middle, and a box as the largest
+sphere that fits inside it, which is enough to stop it getting through anything
+thinner than itself. The furthest offset is always first.
+*/
+int PhysicsSystem::GetSweepSpheres(const CollisionVolume& volume, const Quaternion& orientation, Vector3* offsets, float& radius) {
+	switch (volume.type) {
+		case VolumeType::Capsule: {
+			const CapsuleVolume& capsule = (const CapsuleVolume&)volume;
+			radius = capsule.GetRadius();
+			Vector3 segment = orientation * Vector3(0, std::max(capsule.GetHalfHeight() - radius, 0.0f), 0);
+			offsets[0] = segment;
+			offsets[1] = -segment;
+			offsets[2] = Vector3();
+			return 3;
+		}
+		case VolumeType::AABB:
+		case VolumeType::OBB: {
+			Vector3 halfSize = volume.type == VolumeType::AABB ?
+				((const AABBVolume&)volume).GetHalfDimensions() : ((const OBBVolume&)volume).GetHalfDimensions();
+			radius = std::min(halfSize.x, std::min(halfSize.y, halfSize.z));
+			break;
+		}
+		case VolumeType::Sphere:
+			radius = ((const SphereVolume&)volume).GetRadius();
+			break;
+		default:
+			return 0;
 	}
+	offsets[0] = Vector3();
+	return 1;
 }
 
 /*
@@ -448,11 +999,9 @@ clear out any accumulated forces, ready to receive new
 ones in the next 'game' frame.
 */
 void PhysicsSystem::ClearForces() {
-	gameWorld.OperateOnContents(
-		[](GameObject* o) {
-			o->GetPhysicsObject()->ClearForces();
-		}
-	);
+	PhysicsBodyStore& bodies = gameWorld.GetBodyStore();
+	std::fill(bodies.forces.begin(), bodies.forces.end(), Vector3());
+	std::fill(bodies.torques.begin(), bodies.torques.end(), Vector3());
 }
 
 
@@ -468,7 +1017,28 @@ void PhysicsSystem::UpdateConstraints(float dt) {
 	std::vector<Constraint*>::const_iterator last;
 	gameWorld.GetConstraintIterators(first, last);
 
-	for (auto i = first; i != last; ++i) {
-		(*i)->UpdateConstraint(dt);
-	}
+	constraintBatches.Solve(jobSystem, SOLVER_BATCH_SIZE,
+		[&](int item) {
+			Constraint* c = *(first + item);
+			if (IsAwake(c->GetObjectA()) || IsAwake(c->GetObjectB())) {
+				c->UpdateConstraint(dt);
+			}
+		});
+}
+
+/*
+Constraints are only added and removed between physics updates, so the batches
+they're solved in only need working out once per update, rather than every iteration.
+*/
+void PhysicsSystem::BuildConstraintBatches() {
+	std::vector<Constraint*>::const_iterator first;
+	std::vector<Constraint*>::const_iterator last;
+	gameWorld.GetConstraintIterators(first, last);
+
+	constraintBatches.Build((int)(last - first), gameWorld.GetBodyStore().GetBodyCount(),
+		[&](int item, int& bodyA, int& bodyB) {
+			Constraint* c = *(first + item);
+			bodyA = GetSolverBody(c->GetObjectA());
+			bodyB = GetSolverBody(c->GetObjectB());
+		});
 }
\ No newline at end of file
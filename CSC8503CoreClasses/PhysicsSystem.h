@@ -1,18 +1,81 @@
 #pragma once
 #include "GameWorld.h"
+#include "SweepAndPrune.h"
+#include "PhysicsKernels.h"
+#include "JobSystem.h"
+#include "SolverBatches.h"
+#include "PairCache.h"
+#include "StepScheduler.h"
 
 namespace NCL {
 	namespace GameDemo {
 		const Vector3 GRAVITY = Vector3(0.0f, -9.8f, 0.0f);
 
+		//How many candidate pairs each narrowphase job tests
+		const int NARROWPHASE_BATCH_SIZE = 32;
+		//How many contacts or constraints from one solver batch each job handles
+		const int SOLVER_BATCH_SIZE = 64;
+
+		//Each step, contacts are pushed apart by this fraction of however far they
+		//overlap, past the first CONTACT_SLOP which is left alone to stop jittering
+		const float CONTACT_BAUMGARTE	= 0.2f;
+		const float CONTACT_SLOP		= 0.01f;
+		//Contacts closing slower than this don't bounce, so resting objects can settle
+		const float RESTITUTION_THRESHOLD = 1.0f;
+
+		//Continuous bodies are only swept once they move further than this fraction of
+		//their radius in a step - anything slower can't get through something unnoticed
+		const float CONTINUOUS_MOTION_FRACTION	= 0.5f;
+		//How close a sweep gets before it counts as touching, and how far past that a
+		//swept body is left, so the next step's narrowphase finds the contact
+		const float CONTINUOUS_TOLERANCE		= 0.005f;
+		const float CONTINUOUS_PENETRATION		= 0.01f;
+
+		//The fewest solver iterations Update will drop to when it's over its time budget
+		const int MIN_SOLVER_ITERATIONS = 4;
+
+		//An island goes to sleep once all of its bodies have been moving slower
+		//than this for SLEEP_STEPS physics steps in a row
+		const float	SLEEP_LINEAR_VELOCITY	= 0.1f;
+		const float	SLEEP_ANGULAR_VELOCITY	= 0.1f;
+		const int	SLEEP_STEPS				= 60;
+
+		enum class BroadPhaseType {
+			QuadTree,
+			AABBTree,
+			SweepAndPrune,
+			Max
+		};
+
+		//Pairs of objects are hashed by world ID rather than address, which changes from run to run
+		struct WorldIDPairKey {
+			uint64_t operator()(const GameObject* o) const {
+				return (uint64_t)o->GetWorldID();
+			}
+		};
+
 		class PhysicsSystem	{
 		public:
 			PhysicsSystem(GameWorld& g);
 			~PhysicsSystem();
 
 			void Clear();
+			//Forgets every pair and contact the object is in, and its broadphase proxy, so it can
+			//be deleted once it's left the world
+			void RemoveCollisions(GameObject* o);
 
 			void Update(float dt);
+			void Step(float fixedDt);
+
+			//Physics steps taken so far, whether by Update or Step
+			int GetStepCount() const { return stepCount; }
+			unsigned int GetStateChecksum() const;
+
+			//How many times a step's contacts and constraints are solved, each over an equal share of it
+			void SetConstraintIterationCount(int count) {
+				constraintIterationCount = std::max(count, 1);
+			}
+			int GetConstraintIterationCount() const { return constraintIterationCount; }
 
 			void UseGravity(bool state) {
 				applyGravity = state;
@@ -24,22 +87,113 @@ namespace NCL {
 			}
 
 			void SetGravity(const Vector3& g);
+
+			void UseBroadPhase(bool state) {
+				useBroadPhase = state;
+			}
+
+			void SetBroadPhaseType(BroadPhaseType type) {
+				broadPhaseType = type;
+			}
+			BroadPhaseType GetBroadPhaseType() const { return broadPhaseType; }
+
+			//Candidate pairs found by the broadphase in the last Update, and the time it took
+			int		GetBroadPhasePairCount() const { return broadPhasePairCount; }
+			float	GetBroadPhaseTime() const { return stageTimes[(int)PhysicsStage::BroadPhase]; }
+
+			//Switches between the widest integration kernels the CPU supports and the plain ones
+			void UseSIMDIntegration(bool state) {
+				integrationKernels = state ? &PhysicsKernels::Best() : &PhysicsKernels::Scalar();
+			}
+			const PhysicsKernels& GetIntegrationKernels() const { return *integrationKernels; }
+
+			void UseSleeping(bool state) {
+				useSleeping = state;
+			}
+
+			//Pairs in the collision list, and the time spent keeping it up to date in the last Update
+			int		GetCollisionListSize() const { return allCollisions.GetSize(); }
+			float	GetCollisionListTime() const { return collisionListTime; }
+
+			//Bodies integrated in the last Update (once per substep), and the time it took
+			int		GetIntegratedBodyCount() const { return integratedBodyCount; }
+			float	GetIntegrationTime() const { return stageTimes[(int)PhysicsStage::Integrate]; }
+
+			//Controls how Update fits its steps into each frame's time budget
+			StepScheduler&			GetScheduler() { return scheduler; }
+			const StepScheduler&	GetScheduler() const { return scheduler; }
 		protected:
+			void UpdateKeys();
+			void BeginSteps();
+			void Substep(float dt, int iterations);
+			void EndSteps();
+
+			//Whether the broadphase is the world's object tree, which each step then refreshes
+			bool UsesObjectTree() const {
+				return useBroadPhase && broadPhaseType == BroadPhaseType::AABBTree;
+			}
+
+			//A contact point made ready for the solver - everything but the impulses stays the
+			//same over a step's iterations. Bodies the solver can't move have an index of -1,
+			//but any kinematic one's velocity at the point is still added to the pair's.
+			struct ContactConstraint {
+				int		bodyA;
+				int		bodyB;
+				Vector3	relativeA;
+				Vector3	relativeB;
+				Vector3	kinematicVelocity;
+				Vector3	normal;
+				Vector3	tangents[2];
+				float	normalMass;
+				float	tangentMasses[2];
+				float	normalImpulse;
+				float	tangentImpulses[2];
+				float	bias;		//How fast the solver tries to separate the point
+				float	friction;
+			};
+
 			void BasicCollisionDetection();
 			void BroadPhase();
+			void QuadTreeBroadPhase();
+			void AABBTreeBroadPhase();
+			void SweepAndPruneBroadPhase();
+			void StaticBroadPhase();
+
+			template<class C>
+			void UpdateBroadPhaseProxies(C& container);
+			void AddBroadPhasePair(GameObject* a, GameObject* b);
 			void NarrowPhase();
 
 			void ClearForces();
 
 			void IntegrateAccel(float dt);
 			void IntegrateVelocity(float dt);
+			void SweepContinuousBodies(int awakeCount);
+			static int GetSweepSpheres(const CollisionVolume& volume, const Quaternion& orientation, Vector3* offsets, float& radius);
 
 			void UpdateConstraints(float dt);
+			void BuildConstraintBatches();
+
+			static int GetSolverBody(GameObject* object);
+			static bool IsAwake(GameObject* object);
+
+			void UpdateIslands();
+			void JoinIslands(int bodyA, int bodyB);
+			int  FindIsland(int body);
 
 			void UpdateCollisionList();
 			void UpdateObjectAABBs();
 
-			void ImpulseResolveCollision(GameObject& a , GameObject&b, CollisionDetection::ContactPoint& p) const;
+			void WarmStartContact(CollisionDetection::CollisionInfo& info) const;
+			void StoreContact(const CollisionDetection::CollisionInfo& info);
+
+			void PrepareContacts(float dt);
+			void SolveContacts();
+			void StoreContacts();
+
+			void PrepareContact(int item, float dt);
+			void SolveContact(int item);
+			static void ApplyContactImpulse(PhysicsBodyStore& bodies, const ContactConstraint& c, const Vector3& impulse);
 
 			GameWorld& gameWorld;
 
@@ -48,11 +202,45 @@ namespace NCL {
 			float	dTOffset;
 			float	globalDamping;
 
-			std::set<CollisionDetection::CollisionInfo> allCollisions;
-			std::set<CollisionDetection::CollisionInfo> broadphaseCollisions;
-			std::vector<CollisionDetection::CollisionInfo> broadphaseCollisionsVec;
+			//Every pair's contact manifold, kept across frames until the pair separates
+			PairCache<GameObject*, CollisionDetection::CollisionInfo, WorldIDPairKey> allCollisions;
+			PairCache<GameObject*, PairCacheEmpty, WorldIDPairKey> broadphaseCollisions;
+
+			//Contacts found by each job thread, tagged with their broadphase pair index
+			typedef std::pair<int, CollisionDetection::CollisionInfo> NarrowPhaseContact;
+			std::vector<std::vector<NarrowPhaseContact>> narrowPhaseContacts;
+			std::vector<NarrowPhaseContact> mergedContacts;
+			//Point i of mergedContacts[item] is at item * MAX_CONTACT_POINTS + i
+			std::vector<ContactConstraint> contactConstraints;
 			bool useBroadPhase		= true;
 			int numCollisionFrames	= 5;
+			int constraintIterationCount = 10;
+			int stepCount			= 0;
+
+			BroadPhaseType			broadPhaseType = BroadPhaseType::QuadTree;
+			SweepAndPrune<GameObject*> broadPhaseSweep;
+			int						broadPhaseStamp = 0;
+
+			int		broadPhasePairCount = 0;
+
+			JobSystem		jobSystem;
+			SolverBatches	contactBatches;
+			SolverBatches	constraintBatches;
+
+			bool				useSleeping = true;
+			std::vector<int>	islandParents;
+			std::vector<int>	islandRestingSteps;
+			std::vector<int>	islandLabels;
+			int					nextSleepIsland = 0;
+
+			const PhysicsKernels*	integrationKernels;
+			int		integratedBodyCount = 0;
+
+			float	collisionListTime	= 0.0f;
+
+			StepScheduler	scheduler;
+			//Seconds spent on each stage over the last Update's steps
+			float			stageTimes[(int)PhysicsStage::Max] = {};
 		};
 	}
 }
@@ -0,0 +1,170 @@
+#include "SnapshotBuilder.h"
+
+using namespace NCL;
+using namespace GameDemo;
+
+SnapshotBuilder::SnapshotBuilder(int maxPackets) {
+	this->maxPackets = std::clamp(maxPackets, 1, 1 << SNAPSHOT_INDEX_BITS);
+	entryCount		= 0;
+	packetCount		= 0;
+	droppedCount	= 0;
+}
+
+SnapshotBuilder::~SnapshotBuilder() {
+}
+
+void SnapshotBuilder::AddClient(int clientID) {
+	ClientRecord& client = clients[clientID];
+	client.ackedTick = -1;
+	for (int i = 0; i < STATE_HISTORY_SIZE; ++i) {
+		client.frameTicks[i] = -1;
+		client.heldTicks[i].clear();
+	}
+	client.accumulators.clear();
+}
+
+void SnapshotBuilder::RemoveClient(int clientID) {
+	clients.erase(clientID);
+}
+
+void SnapshotBuilder::Acknowledge(int clientID, int tick) {
+	auto i = clients.find(clientID);
+	if (i == clients.end() || tick <= i->second.ackedTick || tick < 0) {
+		return;
+	}
+	//Only a tick that was actually built for this client can be a baseline
+	if (i->second.frameTicks[tick & (STATE_HISTORY_SIZE - 1)] == tick) {
+		i->second.ackedTick = tick;
+	}
+}
+
+int SnapshotBuilder::GetAcknowledgedTick(int clientID) const {
+	auto i = clients.find(clientID);
+	return i == clients.end() ? -1 : i->second.ackedTick;
+}
+
+/*
+Entries are only ever appended to the last packet, so one that won't fit starts a new
+packet even if an earlier one still has room - but as no entry is more than a few dozen
+bytes, that never wastes more than a few dozen bytes of a packet.
+*/
+void SnapshotBuilder::Build(int clientID, int tick, const std::vector<Candidate>& candidates) {
+	entryCount		= 0;
+	packetCount		= 0;
+	droppedCount	= 0;
+
+	auto c = clients.find(clientID);
+	if (c == clients.end()) {
+		return;
+	}
+	ClientRecord& client = c->second;
+	int baselineTick = client.ackedTick;
+	if (baselineTick < 0 || baselineTick >= tick || tick - baselineTick >= STATE_HISTORY_SIZE ||
+		client.frameTicks[baselineTick & (STATE_HISTORY_SIZE - 1)] != baselineTick) {
+		baselineTick = -1;
+	}
+	std::vector<int>& held = client.heldTicks[tick & (STATE_HISTORY_SIZE - 1)];
+	client.frameTicks[tick & (STATE_HISTORY_SIZE - 1)] = tick;
+	if (baselineTick >= 0) {
+		held = client.heldTicks[baselineTick & (STATE_HISTORY_SIZE - 1)];
+	}
+	else {
+		held.clear();
+	}
+
+	std::vector<float>& accumulators = client.accumulators;
+	for (const Candidate& c : candidates) {
+		NetworkObject* o = c.object;
+		int id = o->GetNetworkID();
+		if (id < 0) {
+			continue;
+		}
+		if (id >= (int)held.size()) {
+			held.resize(id + 1, -1);
+		}
+		if (id >= (int)accumulators.size()) {
+			accumulators.resize(id + 1, 0.0f);
+		}
+		const NetworkState* baseline = held[id] >= 0 ? o->GetNetworkState(held[id]) : nullptr;
+		accumulators[id] += c.rate * o->GetPriority();
+		//Something the client has nothing for at all is always due
+		if (accumulators[id] < 1.0f && baseline) {
+			continue;
+		}
+		//Nothing written, as the client already has this tick's state
+		if (AddEntry(*o, baseline, accumulators[id]) == None && baseline && o->GetNetworkState(tick)) {
+			held[id]			= tick;
+			accumulators[id]	= 0.0f;
+		}
+	}
+
+	order.resize(entryCount);
+	for (int i = 0; i < entryCount; ++i) {
+		order[i] = i;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+		return entries[a].priority > entries[b].priority;
+	});
+
+	BitWriter stream(nullptr, 0);
+	for (int i : order) {
+		const Entry& e = entries[i];
+		if (packetCount == 0 || stream.GetBitCount() + SNAPSHOT_LENGTH_BITS + e.bits > SNAPSHOT_PACKET_BYTES * 8) {
+			if (packetCount == maxPackets) {
+				droppedCount++;
+				continue;
+			}
+			if (packetCount == (int)packets.size()) {
+				packets.emplace_back();
+			}
+			stream = BitWriter(packets[packetCount++].data, SNAPSHOT_PACKET_BYTES);
+			stream.Write(0, 32);
+			stream.Write(0, SNAPSHOT_HEADER_BITS - 32);
+		}
+		stream.Write(e.bits, SNAPSHOT_LENGTH_BITS);
+		stream.WriteStream(e.data, e.bits);
+		packets[packetCount - 1].size = (short)stream.GetByteCount();
+		held[e.objectID]			= tick;
+		accumulators[e.objectID]	= 0.0f;
+	}
+	//Even with nothing to send, the client needs to hear of the tick to acknowledge it
+	if (packetCount == 0) {
+		packets.resize(std::max((int)packets.size(), 1));
+		packets[0].size = SNAPSHOT_HEADER_BITS / 8;
+		packetCount = 1;
+	}
+	for (int i = 0; i < packetCount; ++i) {
+		BitWriter header(packets[i].data, SNAPSHOT_HEADER_BITS / 8);
+		header.Write(tick, 32);
+		header.Write(baselineTick >= 0 ? tick - baselineTick : 0, 8);
+		header.Write(i, SNAPSHOT_INDEX_BITS);
+		header.Write(packetCount - 1, SNAPSHOT_INDEX_BITS);
+	}
+}
+
+int SnapshotBuilder::AddEntry(NetworkObject& o, const NetworkState* baseline, float priority) {
+	if (entryCount == (int)entries.size()) {
+		entries.emplace_back();
+	}
+	Entry& e = entries[entryCount];
+	BitWriter stream(e.data, MAX_STATE_PACKET_BYTES);
+	stream.WriteBool(true);		//Filled in once the object says what it wrote
+	stream.Write(o.GetNetworkID(), NETWORK_ID_BITS);
+
+	int type = o.WriteState(stream, baseline);
+	if (type == None) {
+		return type;
+	}
+	if (type != Full_State) {
+		e.data[0] &= ~1;
+	}
+	if (stream.HasOverflowed()) {
+		droppedCount++;
+		return type;
+	}
+	e.priority	= priority;
+	e.bits		= stream.GetBitCount();
+	e.objectID	= o.GetNetworkID();
+	entryCount++;
+	return type;
+}
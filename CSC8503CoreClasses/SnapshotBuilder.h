@@ -0,0 +1,120 @@
+#pragma once
+#include "NetworkObject.h"
+#include <algorithm>
+
+namespace NCL::GameDemo {
+	//Leaves room under ENet's default 1400 byte MTU for its own headers, so a snapshot
+	//packet is never split into fragments
+	const int SNAPSHOT_PACKET_BYTES = 1200;
+	//Each entry starts with how many bits follow it, so a client can skip objects it doesn't have.
+	//It has to be able to count every bit of a full entry
+	const int SNAPSHOT_LENGTH_BITS = 9;
+	static_assert(MAX_STATE_PACKET_BYTES * 8 < (1 << SNAPSHOT_LENGTH_BITS));
+	//A tick's packets are numbered, so a client can tell when it has all of them
+	const int SNAPSHOT_INDEX_BITS = 4;
+	//The tick, the age of its baseline, and the packet's index and count, in whole bytes
+	//so the header can be written once the count is known without touching the entries
+	const int SNAPSHOT_HEADER_BITS = 32 + 8 + 2 * SNAPSHOT_INDEX_BITS;
+
+	struct SnapshotPacket : public GamePacket {
+		unsigned char data[SNAPSHOT_PACKET_BYTES];
+
+		SnapshotPacket() : GamePacket(Snapshot_State) {
+		}
+	};
+
+	/*
+	Packs the states of the networked objects due an update this tick into as few MTU
+	sized packets as they'll fit in, rather than sending each as a packet of its own.
+	Each object is written as it's added, into its own entry, and once they've all been
+	added the entries are sorted by priority and copied into packets one after another,
+	starting a new packet whenever the next entry won't fit in the current one. If the
+	tick's packet budget runs out first, the lowest priority objects are left until a
+	later tick.
+
+	Which objects are due is up to a priority accumulator per object per client. Each
+	tick an object is a candidate for, its accumulator grows by its rate for that client
+	times its own priority, and once it reaches 1 the object is due, with the largest
+	accumulators going first. Only sending, or finding there's nothing new to send,
+	resets it - so an object that keeps missing out on a busy client's budget is sure to
+	come first eventually, however low its priority.
+
+	Every client gets its own snapshot, with deltas taken from the latest tick that client
+	has acknowledged having all of. For each of the last STATE_HISTORY_SIZE ticks, the
+	builder remembers which tick's state of each object the client was left holding -
+	the tick itself for anything sent or unchanged, or whatever it had before for anything
+	there wasn't room for - and the objects' own histories hold the states themselves.
+	Until a client acknowledges something, or if it falls so far behind that its baseline
+	is no longer held, it's sent whole states.
+
+	Entries, packets and client records are kept from one tick to the next, so once
+	they've grown to the size of the level nothing else is allocated.
+
+	A packet is a header, then entries of their length in bits, a bit saying whether
+	it's a full state or a delta, the object's ID, and then whatever the object wrote.
+	*/
+	class SnapshotBuilder {
+	public:
+		SnapshotBuilder(int maxPackets = 8);
+		~SnapshotBuilder();
+
+		void AddClient(int clientID);
+		void RemoveClient(int clientID);
+
+		//Acknowledgements of ticks older than one already acknowledged are ignored
+		void Acknowledge(int clientID, int tick);
+		int GetAcknowledgedTick(int clientID) const;
+
+		//An object that might be relevant to a client, with how much of an update it earns
+		//each tick - 1 for every tick, 0.25 for every fourth tick, and so on
+		struct Candidate {
+			NetworkObject*	object;
+			float			rate;
+		};
+
+		//Candidates must have all recorded their states for the tick already. Anything that
+		//isn't a candidate is left as the client last had it
+		void Build(int clientID, int tick, const std::vector<Candidate>& candidates);
+
+		int GetPacketCount() const {
+			return packetCount;
+		}
+
+		SnapshotPacket& GetPacket(int i) {
+			return packets[i];
+		}
+
+		//How many objects there wasn't room for in the last snapshot built
+		int GetDroppedCount() const {
+			return droppedCount;
+		}
+
+	protected:
+		struct Entry {
+			float			priority;
+			int				bits;
+			int				objectID;
+			unsigned char	data[MAX_STATE_PACKET_BYTES];
+		};
+
+		struct ClientRecord {
+			int					ackedTick;
+			int					frameTicks[STATE_HISTORY_SIZE];
+			std::vector<int>	heldTicks[STATE_HISTORY_SIZE];	//By network ID, or -1 if it has nothing
+			std::vector<float>	accumulators;					//By network ID
+		};
+
+		//Returns what the object wrote, or None if it didn't need to
+		int AddEntry(NetworkObject& o, const NetworkState* baseline, float priority);
+
+		std::vector<Entry>			entries;
+		std::vector<int>			order;
+		std::vector<SnapshotPacket>	packets;
+		std::map<int, ClientRecord>	clients;
+
+		int maxPackets;
+		int entryCount;
+		int packetCount;
+		int droppedCount;
+	};
+}
@@ -0,0 +1,236 @@
+#include "SnapshotQuantizer.h"
+#include <algorithm>
+
+using namespace NCL;
+using namespace GameDemo;
+
+namespace {
+	//The furthest from 0 any of the smallest three components of a unit quaternion can be
+	const float SMALLEST_THREE_RANGE = 0.70710678f;
+
+	unsigned int QuantizeUnit(float value, float maxValue) {
+		return (unsigned int)(std::clamp(value, 0.0f, 1.0f) * maxValue + 0.5f);
+	}
+}
+
+SnapshotQuantizer::SnapshotQuantizer(const Vector3& boundsMin, const Vector3& boundsMax, int positionBits, int orientationBits,
+	float maxSpeed, int velocityBits) {
+	this->boundsMin			= boundsMin;
+	this->boundsMax			= boundsMax;
+	this->positionBits		= std::clamp(positionBits, 1, 31);
+	this->orientationBits	= std::clamp(orientationBits, 1, 31);
+	this->velocityBits		= std::clamp(velocityBits, 2, 16);
+	//Steps either side of the middle one, which is zero
+	velocityStep = std::max(maxSpeed, 0.0f) / (float)((1 << (this->velocityBits - 1)) - 1);
+
+	float steps = (float)BitWriter::Mask(this->positionBits);
+	for (int i = 0; i < 3; ++i) {
+		positionStep[i] = std::max(boundsMax[i] - boundsMin[i], 0.0f) / steps;
+		inverseStep[i]	= positionStep[i] > 0.0f ? 1.0f / positionStep[i] : 0.0f;
+	}
+}
+
+const SnapshotQuantizer& SnapshotQuantizer::Default() {
+	//Around 2mm steps across the width of the floor, and 1mm up and down, and velocities in 3cm/s steps
+	static SnapshotQuantizer quantizer(Vector3(-256, -64, -256), Vector3(256, 192, 256));
+	return quantizer;
+}
+
+QuantizedState SnapshotQuantizer::Quantize(const Vector3& position, const Quaternion& orientation, const Vector3& velocity) const {
+	QuantizedState state;
+
+	float maxPosition = (float)BitWriter::Mask(positionBits);
+	for (int i = 0; i < 3; ++i) {
+		state.position[i] = (unsigned int)(std::clamp((position[i] - boundsMin[i]) * inverseStep[i], 0.0f, maxPosition) + 0.5f);
+	}
+
+	Quaternion q = orientation.Normalised();
+	state.largest = 0;
+	for (unsigned int i = 1; i < 4; ++i) {
+		if (fabsf(q.array[i]) > fabsf(q.array[state.largest])) {
+			state.largest = i;
+		}
+	}
+	float sign			= q.array[state.largest] < 0.0f ? -1.0f : 1.0f;
+	float maxRotation	= (float)BitWriter::Mask(orientationBits);
+	for (unsigned int i = 0, j = 0; i < 4; ++i) {
+		if (i == state.largest) {
+			continue;
+		}
+		float unit = (q.array[i] * sign / SMALLEST_THREE_RANGE + 1.0f) * 0.5f;
+		state.orientation[j++] = QuantizeUnit(unit, maxRotation);
+	}
+
+	float zero		= (float)(1 << (velocityBits - 1));
+	float maxSteps	= zero - 1.0f;
+	for (int i = 0; i < 3; ++i) {
+		float steps = velocityStep > 0.0f ? std::clamp(velocity[i] / velocityStep, -maxSteps, maxSteps) : 0.0f;
+		state.velocity[i] = (unsigned int)(zero + floorf(steps + 0.5f));
+	}
+	return state;
+}
+
+void SnapshotQuantizer::Dequantize(const QuantizedState& state, Vector3& position, Quaternion& orientation, Vector3& velocity) const {
+	for (int i = 0; i < 3; ++i) {
+		position[i] = boundsMin[i] + state.position[i] * positionStep[i];
+	}
+
+	float inverseMax	= 1.0f / (float)BitWriter::Mask(orientationBits);
+	float sumSquares	= 0.0f;
+	for (unsigned int i = 0, j = 0; i < 4; ++i) {
+		if (i == state.largest) {
+			continue;
+		}
+		float value = (state.orientation[j++] * inverseMax * 2.0f - 1.0f) * SMALLEST_THREE_RANGE;
+		orientation.array[i] = value;
+		sumSquares += value * value;
+	}
+	orientation.array[state.largest & 3] = sqrtf(std::max(1.0f - sumSquares, 0.0f));
+	orientation.Normalise();
+
+	int zero = 1 << (velocityBits - 1);
+	for (int i = 0; i < 3; ++i) {
+		velocity[i] = ((int)state.velocity[i] - zero) * velocityStep;
+	}
+}
+
+void SnapshotQuantizer::WriteState(BitWriter& stream, const QuantizedState& state) const {
+	for (int i = 0; i < 3; ++i) {
+		stream.Write(state.position[i], positionBits);
+	}
+	stream.Write(state.largest, 2);
+	for (int i = 0; i < 3; ++i) {
+		stream.Write(state.orientation[i], orientationBits);
+	}
+	for (int i = 0; i < 3; ++i) {
+		stream.Write(state.velocity[i], velocityBits);
+	}
+}
+
+void SnapshotQuantizer::ReadState(BitReader& stream, QuantizedState& state) const {
+	for (int i = 0; i < 3; ++i) {
+		state.position[i] = stream.Read(positionBits);
+	}
+	state.largest = stream.Read(2);
+	for (int i = 0; i < 3; ++i) {
+		state.orientation[i] = stream.Read(orientationBits);
+	}
+	for (int i = 0; i < 3; ++i) {
+		state.velocity[i] = stream.Read(velocityBits);
+	}
+}
+
+/*
+The position, velocity and orientation each get a bit saying whether they've changed at
+all, as most objects in a level are sat still most of the time. If a rotation has moved far
+enough that a different component is now the largest, the step values aren't measuring
+the same things any more, so the whole orientation is sent instead.
+*/
+void SnapshotQuantizer::WriteDelta(BitWriter& stream, const QuantizedState& baseline, const QuantizedState& state) const {
+	bool positionChanged = false;
+	for (int i = 0; i < 3; ++i) {
+		positionChanged |= state.position[i] != baseline.position[i];
+	}
+	stream.WriteBool(positionChanged);
+	if (positionChanged) {
+		for (int i = 0; i < 3; ++i) {
+			WriteDeltaValue(stream, baseline.position[i], state.position[i], positionBits);
+		}
+	}
+
+	bool velocityChanged = false;
+	for (int i = 0; i < 3; ++i) {
+		velocityChanged |= state.velocity[i] != baseline.velocity[i];
+	}
+	stream.WriteBool(velocityChanged);
+	if (velocityChanged) {
+		for (int i = 0; i < 3; ++i) {
+			WriteDeltaValue(stream, baseline.velocity[i], state.velocity[i], velocityBits);
+		}
+	}
+
+	bool orientationChanged = state.largest != baseline.largest;
+	for (int i = 0; i < 3; ++i) {
+		orientationChanged |= state.orientation[i] != baseline.orientation[i];
+	}
+	stream.WriteBool(orientationChanged);
+	if (!orientationChanged) {
+		return;
+	}
+	bool sameLargest = state.largest == baseline.largest;
+	stream.WriteBool(sameLargest);
+	if (!sameLargest) {
+		stream.Write(state.largest, 2);
+		for (int i = 0; i < 3; ++i) {
+			stream.Write(state.orientation[i], orientationBits);
+		}
+		return;
+	}
+	for (int i = 0; i < 3; ++i) {
+		WriteDeltaValue(stream, baseline.orientation[i], state.orientation[i], orientationBits);
+	}
+}
+
+void SnapshotQuantizer::ReadDelta(BitReader& stream, const QuantizedState& baseline, QuantizedState& state) const {
+	state = baseline;
+	if (stream.ReadBool()) {
+		for (int i = 0; i < 3; ++i) {
+			state.position[i] = ReadDeltaValue(stream, baseline.position[i], positionBits);
+		}
+	}
+	if (stream.ReadBool()) {
+		for (int i = 0; i < 3; ++i) {
+			state.velocity[i] = ReadDeltaValue(stream, baseline.velocity[i], velocityBits);
+		}
+	}
+	if (!stream.ReadBool()) {
+		return;
+	}
+	if (!stream.ReadBool()) {
+		state.largest = stream.Read(2);
+		for (int i = 0; i < 3; ++i) {
+			state.orientation[i] = stream.Read(orientationBits);
+		}
+		return;
+	}
+	for (int i = 0; i < 3; ++i) {
+		state.orientation[i] = ReadDeltaValue(stream, baseline.orientation[i], orientationBits);
+	}
+}
+
+/*
+Differences are zigzag encoded, so that small steps either way both come out as small
+numbers, and then sent with the fewest bits of the sizes that will hold them. A change
+too big for either is just sent as the new value, as that's never bigger than the delta.
+*/
+void SnapshotQuantizer::WriteDeltaValue(BitWriter& stream, unsigned int from, unsigned int to, int bits) const {
+	int difference = (int)(to - from);
+	unsigned int zigzag = ((unsigned int)difference << 1) ^ (unsigned int)(difference >> 31);
+	if (zigzag == 0) {
+		stream.Write(0, 2);
+	}
+	else if (zigzag < (1u << SMALL_DELTA_BITS)) {
+		stream.Write(1, 2);
+		stream.Write(zigzag, SMALL_DELTA_BITS);
+	}
+	else if (zigzag < (1u << MEDIUM_DELTA_BITS) && MEDIUM_DELTA_BITS < bits) {
+		stream.Write(2, 2);
+		stream.Write(zigzag, MEDIUM_DELTA_BITS);
+	}
+	else {
+		stream.Write(3, 2);
+		stream.Write(to, bits);
+	}
+}
+
+unsigned int SnapshotQuantizer::ReadDeltaValue(BitReader& stream, unsigned int from, int bits) const {
+	unsigned int zigzag = 0;
+	switch (stream.Read(2)) {
+		case 0: return from;
+		case 1: zigzag = stream.Read(SMALL_DELTA_BITS);		break;
+		case 2: zigzag = stream.Read(MEDIUM_DELTA_BITS);	break;
+		default: return stream.Read(bits);
+	}
+	int difference = (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+	return (from + (unsigned int)difference) & (unsigned int)BitWriter::Mask(bits);
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "BitStream.h"
+
+namespace NCL {
+	using namespace Maths;
+	namespace GameDemo {
+		//Object IDs are sent with this many bits, so a level can network up to 65536 objects
+		const int NETWORK_ID_BITS = 16;
+
+		//A transform as it went over the network, in whole steps of the quantizer that sent it
+		struct QuantizedState {
+			unsigned int position[3];
+			unsigned int largest;			//Which of the quaternion's components was left out
+			unsigned int orientation[3];	//And the other three, in order
+			unsigned int velocity[3];
+
+			bool operator==(const QuantizedState& other) const = default;
+		};
+
+		/*
+		Turns transforms into as few bits as will still put them back where they were to
+		within a configurable step. Positions are stored as fractions of the way across the
+		level's bounds, so the level's size and the number of bits per axis decide how fine
+		the steps are - anything outside the bounds is clamped onto their edge.
+
+		Orientations use 'smallest three' compression: a unit quaternion's largest component
+		can always be worked out from the other three, so only its index is sent, and as it
+		is the largest, the other three are all within +/- 1 / sqrt(2), which is all their
+		steps have to cover. Which way the quaternion faces is flipped to make it positive,
+		as q and -q are the same rotation.
+
+		Linear velocities are sent too, so clients can interpolate between states along a
+		curve rather than a straight line, and carry objects on when a state is late. They're
+		stored either side of a middle step that is exactly zero, so an object at rest always
+		comes out with no velocity at all.
+
+		Deltas are between whole steps rather than floats, so a delta applied to the same
+		baseline always lands on exactly the state the server had, with no drift.
+		*/
+		class SnapshotQuantizer {
+		public:
+			SnapshotQuantizer(const Vector3& boundsMin, const Vector3& boundsMax, int positionBits = 18, int orientationBits = 10,
+				float maxSpeed = 64.0f, int velocityBits = 12);
+			~SnapshotQuantizer() {
+			}
+
+			//Used by any NetworkObject not given a quantizer of its own, sized for the demo levels
+			static const SnapshotQuantizer& Default();
+
+			QuantizedState	Quantize(const Vector3& position, const Quaternion& orientation, const Vector3& velocity) const;
+			void			Dequantize(const QuantizedState& state, Vector3& position, Quaternion& orientation, Vector3& velocity) const;
+
+			void WriteState(BitWriter& stream, const QuantizedState& state) const;
+			void ReadState(BitReader& stream, QuantizedState& state) const;
+
+			//Anything that hasn't changed since the baseline costs a single bit
+			void WriteDelta(BitWriter& stream, const QuantizedState& baseline, const QuantizedState& state) const;
+			void ReadDelta(BitReader& stream, const QuantizedState& baseline, QuantizedState& state) const;
+
+			//Of the whole state, before a delta makes it any smaller
+			int GetStateBits() const {
+				return 3 * positionBits + 2 + 3 * orientationBits + 3 * velocityBits;
+			}
+
+			//The largest error a position can be sent with along each axis
+			Vector3 GetPositionPrecision() const {
+				return positionStep * 0.5f;
+			}
+
+		protected:
+			//Each delta is sent as one of these sizes, with a two bit prefix saying which
+			static const int SMALL_DELTA_BITS	= 6;
+			static const int MEDIUM_DELTA_BITS	= 12;
+
+			void WriteDeltaValue(BitWriter& stream, unsigned int from, unsigned int to, int bits) const;
+			unsigned int ReadDeltaValue(BitReader& stream, unsigned int from, int bits) const;
+
+			Vector3 boundsMin;
+			Vector3 boundsMax;
+			Vector3 positionStep;
+			Vector3 inverseStep;
+			int		positionBits;
+			int		orientationBits;
+			float	velocityStep;
+			int		velocityBits;
+		};
+	}
+}
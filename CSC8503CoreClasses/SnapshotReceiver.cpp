@@ -0,0 +1,121 @@
+#include "SnapshotReceiver.h"
+
+using namespace NCL;
+using namespace GameDemo;
+
+SnapshotReceiver::SnapshotReceiver() {
+	for (TickRecord& record : ticks) {
+		record = { -1, -1, 0, false, false };
+	}
+	completeTick	= -1;
+	latestTick		= -1;
+	syncedTick		= -1;
+	renderTick		= -1.0f;
+	correction		= 0.0f;
+	SetTiming(20.0f, 0.1f, 0.25f);
+}
+
+void SnapshotReceiver::SetTiming(float tickRate, float delay, float maxExtrapolation) {
+	tickLength			= 1.0f / std::max(tickRate, 1.0f);
+	delayTicks			= std::max(delay, 0.0f) / tickLength;
+	extrapolationTicks	= std::max(maxExtrapolation, 0.0f) / tickLength;
+}
+
+bool SnapshotReceiver::Receive(const GamePacket& packet, const std::vector<NetworkObject*>& objects) {
+	const SnapshotPacket& snapshot = (const SnapshotPacket&)packet;
+	BitReader stream(snapshot.data, std::clamp((int)snapshot.size, 0, SNAPSHOT_PACKET_BYTES));
+
+	int tick	= (int)stream.Read(32);
+	int age		= (int)stream.Read(8);
+	int index	= (int)stream.Read(SNAPSHOT_INDEX_BITS);
+	int count	= (int)stream.Read(SNAPSHOT_INDEX_BITS) + 1;
+	if (stream.HasOverflowed() || tick < 0 || index >= count || completeTick - tick >= STATE_HISTORY_SIZE) {
+		return false;
+	}
+	int baselineTick = age > 0 ? tick - age : -1;
+	if (baselineTick >= 0 && !IsComplete(baselineTick)) {
+		return false;
+	}
+	TickRecord& record = ticks[tick & (STATE_HISTORY_SIZE - 1)];
+	if (record.tick > tick) {
+		return false;
+	}
+	if (record.tick != tick) {
+		record = { tick, baselineTick, 0, false, false };
+	}
+	if (record.received & (1u << index)) {
+		return true;
+	}
+	record.received |= 1u << index;
+	latestTick = std::max(latestTick, tick);
+
+	//Whatever is left after the last entry is padding, which is always under a byte
+	while (stream.GetBitsLeft() >= SNAPSHOT_LENGTH_BITS) {
+		int length = (int)stream.Read(SNAPSHOT_LENGTH_BITS);
+		if (length == 0) {
+			break;
+		}
+		int end		= stream.GetBitCount() + length;
+		int type	= stream.ReadBool() ? Full_State : Delta_State;
+		int id		= (int)stream.Read(NETWORK_ID_BITS);
+		NetworkObject* o = id < (int)objects.size() ? objects[id] : nullptr;
+		if (o && !o->ReadState(stream, type, tick, baselineTick)) {
+			record.failed = true;
+		}
+		if (stream.GetBitCount() > end) {
+			record.failed = true;
+			return false;
+		}
+		stream.Skip(end - stream.GetBitCount());
+		if (stream.HasOverflowed()) {
+			record.failed = true;
+			return false;
+		}
+	}
+
+	if (record.received != (1u << count) - 1 || record.failed) {
+		return true;
+	}
+	if (baselineTick >= 0) {
+		for (NetworkObject* o : objects) {
+			if (o) {
+				o->CopyState(baselineTick, tick);
+			}
+		}
+	}
+	record.complete = true;
+	completeTick	= std::max(completeTick, tick);
+	return true;
+}
+
+void SnapshotReceiver::Interpolate(float dt, const std::vector<NetworkObject*>& objects) {
+	if (latestTick < 0) {
+		return;
+	}
+	renderTick += dt / tickLength;
+
+	//Only measured as ticks arrive, as while none are the clock is meant to be running on ahead
+	if (syncedTick != latestTick) {
+		float target = latestTick - delayTicks;
+		if (renderTick < 0.0f || fabsf(target - renderTick) > std::max(delayTicks, 1.0f)) {
+			renderTick	= target;
+			correction	= 0.0f;
+		}
+		else {
+			//Only part of the way, as one packet arriving early or late says little on its own
+			correction	= (target - renderTick) * CLOCK_CORRECTION;
+		}
+		syncedTick = latestTick;
+	}
+	//Made by running the clock a little fast or slow rather than all at once, so nothing jumps
+	float maxStep	= CLOCK_MAX_SKEW * dt / tickLength;
+	float step		= std::clamp(correction, -maxStep, maxStep);
+	renderTick += step;
+	correction -= step;
+
+	for (NetworkObject* o : objects) {
+		if (o) {
+			o->Interpolate(renderTick, tickLength, extrapolationTicks);
+		}
+	}
+}
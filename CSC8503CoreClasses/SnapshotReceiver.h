@@ -0,0 +1,77 @@
+#pragma once
+#include "SnapshotBuilder.h"
+
+namespace NCL::GameDemo {
+	/*
+	The client's end of a SnapshotBuilder. Entries are read into their objects as soon as
+	their packet arrives, but a tick only counts as complete once every one of its packets
+	has, at which point any object it didn't mention carries its state forward from the
+	tick's baseline. Only complete ticks are acknowledged, so the server never takes a
+	delta from a tick the client only has part of.
+
+	It also keeps the client's clock for showing objects: a tick, with a fraction, running
+	a set delay behind the newest tick to have arrived, so that there's usually a state
+	either side of it to interpolate between even if one or two packets have been lost.
+	The clock runs at the server's tick rate, and is eased back towards where it should be
+	whenever a new tick arrives by running slightly fast or slow for a while, so uneven
+	arrival times don't make objects jump about - it only jumps itself if it's out by more
+	than the delay, such as when the server stalls.
+	*/
+	class SnapshotReceiver {
+	public:
+		SnapshotReceiver();
+		~SnapshotReceiver() {
+		}
+
+		//objects are indexed by network ID, with nullptr for any the client doesn't have.
+		//Returns false if the packet couldn't be used
+		bool Receive(const GamePacket& packet, const std::vector<NetworkObject*>& objects);
+
+		//The latest tick every packet has arrived for, to acknowledge to the server
+		int GetCompleteTick() const {
+			return completeTick;
+		}
+
+		bool IsComplete(int tick) const {
+			const TickRecord& record = ticks[tick & (STATE_HISTORY_SIZE - 1)];
+			return tick >= 0 && record.tick == tick && record.complete;
+		}
+
+		//delay and maxExtrapolation are in seconds. A longer delay rides out more packet loss,
+		//but shows everything further in the past
+		void SetTiming(float tickRate, float delay, float maxExtrapolation);
+
+		//Called every frame, to move the clock on and put every object where it was at that point
+		void Interpolate(float dt, const std::vector<NetworkObject*>& objects);
+
+		//-1 until the first packet has arrived
+		float GetRenderTick() const {
+			return renderTick;
+		}
+
+	protected:
+		struct TickRecord {
+			int				tick;
+			int				baselineTick;
+			unsigned int	received;	//A bit for each of the tick's packets
+			bool			failed;		//An entry couldn't be read, so it can never be complete
+			bool			complete;
+		};
+
+		TickRecord	ticks[STATE_HISTORY_SIZE];
+		int			completeTick;
+		int			latestTick;		//That any packet has arrived for, complete or not
+		int			syncedTick;		//The latest tick the clock has been eased towards
+
+		float		tickLength;
+		float		delayTicks;
+		float		extrapolationTicks;
+		float		renderTick;
+		float		correction;		//How far the clock still has to be eased, in ticks
+
+		//How much of how far out the clock is to correct for on each new tick, and how much
+		//faster or slower than real time it can run while it does
+		static constexpr float CLOCK_CORRECTION	= 0.25f;
+		static constexpr float CLOCK_MAX_SKEW	= 0.1f;
+	};
+}
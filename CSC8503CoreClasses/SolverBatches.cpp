@@ -0,0 +1,55 @@
+#include "SolverBatches.h"
+#include "JobSystem.h"
+#include <bit>
+
+using namespace NCL;
+using namespace GameDemo;
+
+void SolverBatches::Build(int itemCount, int bodyCount, const BodyFunc& getBodies) {
+	bodyColours.assign(bodyCount, 0);
+	for (std::vector<int>& batch : batches) {
+		batch.clear();
+	}
+	serialBatch.clear();
+	usedColours = 0;
+
+	for (int i = 0; i < itemCount; ++i) {
+		int bodyA = -1;
+		int bodyB = -1;
+		getBodies(i, bodyA, bodyB);
+
+		uint64_t used = 0;
+		if (bodyA >= 0) { used |= bodyColours[bodyA]; }
+		if (bodyB >= 0) { used |= bodyColours[bodyB]; }
+
+		if (used == ~uint64_t(0)) {
+			serialBatch.emplace_back(i);
+			continue;
+		}
+		int colour = std::countr_zero(~used);
+		uint64_t bit = uint64_t(1) << colour;
+		if (bodyA >= 0) { bodyColours[bodyA] |= bit; }
+		if (bodyB >= 0) { bodyColours[bodyB] |= bit; }
+
+		if (colour >= (int)batches.size()) {
+			batches.resize(colour + 1);
+		}
+		batches[colour].emplace_back(i);
+		usedColours = std::max(usedColours, colour + 1);
+	}
+}
+
+void SolverBatches::Solve(JobSystem& jobs, int jobSize, const SolveFunc& solve) const {
+	for (int c = 0; c < usedColours; ++c) {
+		const std::vector<int>& batch = batches[c];
+		jobs.ParallelFor((int)batch.size(), jobSize,
+			[&](int first, int last, int /*thread*/) {
+				for (int i = first; i < last; ++i) {
+					solve(batch[i]);
+				}
+			});
+	}
+	for (int item : serialBatch) {
+		solve(item);
+	}
+}
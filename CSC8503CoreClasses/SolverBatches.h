@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+
+namespace NCL {
+	namespace GameDemo {
+		class JobSystem;
+
+		/*
+		Splits a list of contacts or constraints into batches (colours), where no two
+		items in a batch share a moving body. Everything in a batch can then be solved
+		at the same time on different threads without the results depending on which
+		thread got there first.
+
+		Items are coloured greedily in the order they're given, so the same list always
+		gives the same batches. Bodies are identified by their PhysicsBodyStore index;
+		pass -1 for bodies that can't move, as they're only ever read from while solving.
+		Items that don't fit in any of the first MAX_COLOURS batches go into one final
+		batch, which is solved on a single thread.
+		*/
+		class SolverBatches {
+		public:
+			typedef std::function<void(int item, int& bodyA, int& bodyB)>	BodyFunc;
+			typedef std::function<void(int item)>							SolveFunc;
+
+			static const int MAX_COLOURS = 64;
+
+			void Build(int itemCount, int bodyCount, const BodyFunc& getBodies);
+
+			//Solves every batch in turn, with each batch split across the job threads
+			void Solve(JobSystem& jobs, int jobSize, const SolveFunc& solve) const;
+
+			int GetBatchCount() const {
+				return usedColours + (serialBatch.empty() ? 0 : 1);
+			}
+
+		protected:
+			std::vector<uint64_t>			bodyColours;
+			std::vector<std::vector<int>>	batches;
+			std::vector<int>				serialBatch;
+			int								usedColours = 0;
+		};
+	}
+}
@@ -0,0 +1,279 @@
+#pragma once
+#include "BoxTests.h"
+
+namespace NCL {
+	using namespace NCL::Maths;
+	namespace GameDemo {
+		//Leaves are split until they hold no more than this many items
+		const int STATIC_BVH_LEAF_SIZE = 4;
+		//Splits are always at the median, so the tree's depth is only ever log2 of its leaves
+		const int STATIC_BVH_STACK_SIZE = 64;
+
+		/*
+		A node of a StaticBVH, packed into 32 bytes so that two fit in a cache line. Nodes
+		are stored depth first, so a branch's first child is always the node straight after
+		it, and offset is the index of its second child. A leaf's offset is instead its first
+		item, with count items following on from it.
+		*/
+		struct StaticBVHNode {
+			Vector3	boxMin;
+			int		offset;
+			Vector3	boxMax;
+			int		count;		//0 for a branch
+
+			bool IsLeaf() const {
+				return count > 0;
+			}
+		};
+
+		template<class T>
+		struct StaticBVHItem {
+			Vector3	boxMin;
+			Vector3	boxMax;
+			T		object;
+		};
+
+		/*
+		A bounding volume hierarchy for things that never move, baked once and then only
+		ever read. Unlike the AABBTree there's no fattening, no free list, no parent links
+		and no rebalancing - just two flat arrays, nodes and items, built top down by
+		splitting each set of items in half along the axis their centres are most spread
+		out on. Nothing in it is touched from one step to the next, so however many
+		objects are baked into it, keeping it up to date costs nothing.
+
+		Its walks take and call back with the same things as the AABBTree's, so a query
+		can be run over both with the same callbacks.
+		*/
+		template<class T>
+		class StaticBVH : protected BoxTests {
+		public:
+			StaticBVH() {
+			}
+			~StaticBVH() {
+			}
+
+			void Clear() {
+				nodes.clear();
+				items.clear();
+			}
+
+			//Items are only found once Build has been called
+			void Add(T object, const Vector3& pos, const Vector3& halfSize) {
+				items.push_back({ pos - halfSize, pos + halfSize, object });
+			}
+
+			void Build() {
+				nodes.clear();
+				if (items.empty()) {
+					return;
+				}
+				nodes.reserve(2 * (items.size() / STATIC_BVH_LEAF_SIZE + 1));
+				BuildNode(0, (int)items.size());
+			}
+
+			int GetItemCount() const {
+				return (int)items.size();
+			}
+
+			int GetNodeCount() const {
+				return (int)nodes.size();
+			}
+
+			//Walks down every branch whose box passes test, calling func on each item whose
+			//box passes it too, until func returns false
+			template<class Test, class F>
+			void Traverse(Test test, F func) const {
+				if (nodes.empty()) {
+					return;
+				}
+				int stack[STATIC_BVH_STACK_SIZE];
+				int count = 0;
+				stack[count++] = 0;
+				while (count > 0) {
+					int index = stack[--count];
+					const StaticBVHNode& n = nodes[index];
+					if (!test(n.boxMin, n.boxMax)) {
+						continue;
+					}
+					if (!n.IsLeaf()) {
+						stack[count++] = n.offset;
+						stack[count++] = index + 1;
+						continue;
+					}
+					for (int i = n.offset; i < n.offset + n.count; ++i) {
+						if (test(items[i].boxMin, items[i].boxMax) && !func(items[i].object)) {
+							return;
+						}
+					}
+				}
+			}
+
+			template<class F>
+			void Query(const Vector3& boxMin, const Vector3& boxMax, F func) const {
+				Traverse(
+					[&](const Vector3& nodeMin, const Vector3& nodeMax) {
+						return Overlaps(nodeMin, nodeMax, boxMin, boxMax);
+					},
+					func);
+			}
+
+			template<class F>
+			void Raycast(const Vector3& origin, const Vector3& direction, float maxDistance, F func) const {
+				Sweep(origin, direction, Vector3(), maxDistance, func);
+			}
+
+			//func is given each item the box hits and the closest hit so far, and returns the
+			//new closest hit, or a negative distance to end the walk
+			template<class F>
+			void Sweep(const Vector3& origin, const Vector3& direction, const Vector3& halfSize, float maxDistance, F func) const {
+				if (nodes.empty()) {
+					return;
+				}
+				Vector3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+				int		stack[STATIC_BVH_STACK_SIZE];
+				float	entries[STATIC_BVH_STACK_SIZE];
+				int		count = 0;
+
+				float entry;
+				if (RayBox(origin, inverse, maxDistance, nodes[0].boxMin - halfSize, nodes[0].boxMax + halfSize, entry)) {
+					stack[count]	= 0;
+					entries[count]	= entry;
+					count++;
+				}
+				while (count > 0) {
+					count--;
+					if (entries[count] > maxDistance) {
+						continue;
+					}
+					int index = stack[count];
+					const StaticBVHNode& n = nodes[index];
+					if (n.IsLeaf()) {
+						for (int i = n.offset; i < n.offset + n.count; ++i) {
+							if (RayBox(origin, inverse, maxDistance, items[i].boxMin - halfSize, items[i].boxMax + halfSize, entry)) {
+								maxDistance = func(items[i].object, maxDistance);
+								if (maxDistance < 0.0f) {
+									return;
+								}
+							}
+						}
+						continue;
+					}
+					int		first = index + 1;
+					float	firstEntry;
+					float	secondEntry;
+					bool	hitFirst	= RayBox(origin, inverse, maxDistance, nodes[first].boxMin - halfSize, nodes[first].boxMax + halfSize, firstEntry);
+					bool	hitSecond	= RayBox(origin, inverse, maxDistance, nodes[n.offset].boxMin - halfSize, nodes[n.offset].boxMax + halfSize, secondEntry);
+					//The nearer child goes on last, so it comes off first
+					bool firstNearer = firstEntry <= secondEntry;
+					if (hitFirst && hitSecond) {
+						stack[count]		= firstNearer ? n.offset : first;
+						entries[count]		= firstNearer ? secondEntry : firstEntry;
+						stack[count + 1]	= firstNearer ? first : n.offset;
+						entries[count + 1]	= firstNearer ? firstEntry : secondEntry;
+						count += 2;
+					}
+					else if (hitFirst || hitSecond) {
+						stack[count]	= hitFirst ? first : n.offset;
+						entries[count]	= hitFirst ? firstEntry : secondEntry;
+						count++;
+					}
+				}
+			}
+
+			//func is given each item and a bitmask of the rays that hit its box, and shortens
+			//the maxDistances of any that hit the item itself
+			template<class F>
+			void RaycastPacket(const Vector3* origins, const Vector3* directions, float* maxDistances, int rayCount, F func) const {
+				if (nodes.empty() || rayCount <= 0) {
+					return;
+				}
+				RayPacket packet = MakeRayPacket(origins, directions, maxDistances, rayCount);
+
+				int		stack[STATIC_BVH_STACK_SIZE];
+				int		count = 0;
+				__m128	entry;
+				if (RayPacketBox(packet, nodes[0].boxMin, nodes[0].boxMax, entry)) {
+					stack[count++] = 0;
+				}
+				while (count > 0) {
+					int index = stack[--count];
+					const StaticBVHNode& n = nodes[index];
+					if (n.IsLeaf()) {
+						for (int i = n.offset; i < n.offset + n.count; ++i) {
+							int mask = RayPacketBox(packet, items[i].boxMin, items[i].boxMax, entry);
+							if (mask) {
+								func(items[i].object, mask);
+								SetPacketDistances(packet, maxDistances, rayCount);
+							}
+						}
+						continue;
+					}
+					int		first = index + 1;
+					__m128	firstEntry;
+					__m128	secondEntry;
+					int firstMask	= RayPacketBox(packet, nodes[first].boxMin, nodes[first].boxMax, firstEntry);
+					int secondMask	= RayPacketBox(packet, nodes[n.offset].boxMin, nodes[n.offset].boxMax, secondEntry);
+					if (firstMask && secondMask) {
+						__m128 difference	= _mm_sub_ps(firstEntry, secondEntry);
+						int firstNearer		= _mm_movemask_ps(_mm_cmplt_ps(difference, _mm_setzero_ps())) & firstMask & secondMask;
+						int secondNearer	= _mm_movemask_ps(_mm_cmpgt_ps(difference, _mm_setzero_ps())) & firstMask & secondMask;
+						bool firstFirst		= PopCount(firstNearer) >= PopCount(secondNearer);
+						stack[count++] = firstFirst ? n.offset : first;
+						stack[count++] = firstFirst ? first : n.offset;
+					}
+					else if (firstMask || secondMask) {
+						stack[count++] = firstMask ? first : n.offset;
+					}
+				}
+			}
+
+		protected:
+			/*
+			Items are sorted rather than partitioned, and with a stable sort, so that a given
+			set of items always bakes into the same tree whichever standard library built it.
+			It's only done once, so the extra cost doesn't matter.
+			*/
+			int BuildNode(int first, int last) {
+				int index = (int)nodes.size();
+				nodes.emplace_back();
+
+				Vector3 boxMin		= items[first].boxMin;
+				Vector3 boxMax		= items[first].boxMax;
+				Vector3 centreMin	= boxMin + boxMax;
+				Vector3 centreMax	= centreMin;
+				for (int i = first + 1; i < last; ++i) {
+					boxMin		= Min(boxMin, items[i].boxMin);
+					boxMax		= Max(boxMax, items[i].boxMax);
+					centreMin	= Min(centreMin, items[i].boxMin + items[i].boxMax);
+					centreMax	= Max(centreMax, items[i].boxMin + items[i].boxMax);
+				}
+				nodes[index].boxMin = boxMin;
+				nodes[index].boxMax = boxMax;
+
+				int count = last - first;
+				if (count <= STATIC_BVH_LEAF_SIZE) {
+					nodes[index].offset	= first;
+					nodes[index].count	= count;
+					return index;
+				}
+				Vector3 spread = centreMax - centreMin;
+				int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+				std::stable_sort(items.begin() + first, items.begin() + last,
+					[axis](const StaticBVHItem<T>& a, const StaticBVHItem<T>& b) {
+						return a.boxMin[axis] + a.boxMax[axis] < b.boxMin[axis] + b.boxMax[axis];
+					});
+
+				int middle = first + count / 2;
+				BuildNode(first, middle);
+				int second = BuildNode(middle, last);
+				nodes[index].offset = second;
+				nodes[index].count	= 0;
+				return index;
+			}
+
+			std::vector<StaticBVHNode>		nodes;
+			std::vector<StaticBVHItem<T>>	items;
+		};
+	}
+}
@@ -0,0 +1,141 @@
+#include "StepScheduler.h"
+#include <algorithm>
+
+using namespace NCL;
+using namespace GameDemo;
+
+//How much each new frame's timings move the smoothed costs
+const float COST_SMOOTHING = 0.1f;
+//Until a step's cost has been measured, a frame never runs more than this many
+const int	MAX_STEPS_PER_FRAME = 8;
+//Iterations are only given back when the frame would still be this far under budget
+const float	RAISE_ITERATIONS_BELOW = 0.7f;
+
+StepScheduler::StepScheduler() {
+	frameBudget = 8.0f;
+	stageBudgets[(int)PhysicsStage::Integrate]		= 1.0f;
+	stageBudgets[(int)PhysicsStage::BroadPhase]		= 1.5f;
+	stageBudgets[(int)PhysicsStage::NarrowPhase]	= 2.0f;
+	stageBudgets[(int)PhysicsStage::Solve]			= 3.5f;
+
+	for (int i = 0; i < (int)PhysicsStage::Max; ++i) {
+		stageStepCosts[i]	= 0.0f;
+		stageFrameCosts[i]	= 0.0f;
+	}
+	minIterations	= 1;
+	maxIterations	= 10;
+	iterations		= maxIterations;
+	droppedSteps	= 0;
+}
+
+void StepScheduler::SetIterationLimits(int minCount, int maxCount) {
+	maxIterations = std::max(maxCount, 1);
+	minIterations = std::clamp(minCount, 1, maxIterations);
+	SetIterations(std::clamp(iterations, minIterations, maxIterations));
+}
+
+//The solve stage's cost goes up and down with the iteration count, so its estimate follows along
+void StepScheduler::SetIterations(int count) {
+	if (count == iterations) {
+		return;
+	}
+	float scale = (float)count / (float)iterations;
+	stageStepCosts[(int)PhysicsStage::Solve]	*= scale;
+	stageFrameCosts[(int)PhysicsStage::Solve]	*= scale;
+	iterations = count;
+}
+
+float StepScheduler::PredictStepCost(int iterationCount) const {
+	float cost = 0.0f;
+	for (int i = 0; i < (int)PhysicsStage::Max; ++i) {
+		cost += stageStepCosts[i];
+	}
+	float solve = stageStepCosts[(int)PhysicsStage::Solve];
+	return cost - solve + solve * (float)iterationCount / (float)iterations;
+}
+
+/*
+Steps are only held back once the solver has nothing left to give - until then,
+every step owed is run, and it's the iteration count that comes down to pay for
+them, straight away rather than waiting for EndFrame to see the frame run long.
+*/
+int StepScheduler::BeginFrame(float& accumulatedTime, float stepDt) {
+	int owed = (int)(accumulatedTime / stepDt);
+	accumulatedTime -= owed * stepDt;
+
+	int steps = owed;
+	if (PredictStepCost(iterations) <= 0.0f) {
+		steps = std::min(owed, MAX_STEPS_PER_FRAME);
+	}
+	else {
+		int count = iterations;
+		while (count > minIterations && PredictStepCost(count) * owed > frameBudget) {
+			count--;
+		}
+		SetIterations(count);
+
+		if (iterations <= minIterations) {
+			int affordable = std::max((int)(frameBudget / PredictStepCost(iterations)), 1);
+			steps = std::min(owed, affordable);
+		}
+	}
+	droppedSteps = owed - steps;
+	return steps;
+}
+
+void StepScheduler::EndFrame(int stepsRun, const float* stageTimes) {
+	if (stepsRun == 0) {
+		return;
+	}
+	for (int i = 0; i < (int)PhysicsStage::Max; ++i) {
+		float frameCost = stageTimes[i] * 1000.0f;
+		float stepCost	= frameCost / (float)stepsRun;
+		if (stageStepCosts[i] == 0.0f) {
+			stageStepCosts[i]	= stepCost;
+			stageFrameCosts[i]	= frameCost;
+		}
+		else {
+			stageStepCosts[i]	+= (stepCost - stageStepCosts[i]) * COST_SMOOTHING;
+			stageFrameCosts[i]	+= (frameCost - stageFrameCosts[i]) * COST_SMOOTHING;
+		}
+	}
+
+	//Cut straight down to whatever fits, but only climb back up one iteration at a time
+	int stepsOwed = stepsRun + droppedSteps;
+	if (PredictStepCost(iterations) * stepsOwed > frameBudget) {
+		int count = iterations;
+		while (count > minIterations && PredictStepCost(count) * stepsOwed > frameBudget) {
+			count--;
+		}
+		SetIterations(count);
+	}
+	else if (iterations < maxIterations && PredictStepCost(iterations + 1) * stepsOwed < frameBudget * RAISE_ITERATIONS_BELOW) {
+		SetIterations(iterations + 1);
+	}
+}
+
+PhysicsStage StepScheduler::GetOverBudgetStage() const {
+	PhysicsStage worst	= PhysicsStage::Max;
+	float worstRatio	= 1.0f;
+	for (int i = 0; i < (int)PhysicsStage::Max; ++i) {
+		if (stageBudgets[i] <= 0.0f) {
+			continue;
+		}
+		float ratio = stageFrameCosts[i] / stageBudgets[i];
+		if (ratio > worstRatio) {
+			worstRatio	= ratio;
+			worst		= (PhysicsStage)i;
+		}
+	}
+	return worst;
+}
+
+const char* StepScheduler::GetStageName(PhysicsStage stage) {
+	switch (stage) {
+		case PhysicsStage::Integrate:	return "Integrate";
+		case PhysicsStage::BroadPhase:	return "Broadphase";
+		case PhysicsStage::NarrowPhase:	return "Narrowphase";
+		case PhysicsStage::Solve:		return "Solve";
+		default:						return "None";
+	}
+}
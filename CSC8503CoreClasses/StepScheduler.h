@@ -0,0 +1,71 @@
+#pragma once
+
+namespace NCL {
+	namespace GameDemo {
+		enum class PhysicsStage {
+			Integrate,
+			BroadPhase,
+			NarrowPhase,
+			Solve,
+			Max
+		};
+
+		/*
+		Decides how much physics work each frame gets. The step size never changes, as
+		changing it makes stacks and constraints behave differently from frame to frame -
+		instead, when the last few frames' physics has cost more than the frame budget,
+		the solver is given fewer iterations, and only once they're down to the minimum
+		are fewer steps run than the time owed, with the rest of that time dropped.
+
+		Each stage's cost is tracked separately, against its own budget, so that when
+		things slow down it's clear which stage is to blame. Costs are smoothed over a
+		few frames, and iterations are only given back once there's plenty of room,
+		so a single slow frame doesn't set the whole thing see-sawing.
+		*/
+		class StepScheduler {
+		public:
+			StepScheduler();
+
+			//Budgets are in milliseconds per frame
+			void	SetFrameBudget(float ms) { frameBudget = ms; }
+			float	GetFrameBudget() const { return frameBudget; }
+
+			void	SetStageBudget(PhysicsStage stage, float ms) { stageBudgets[(int)stage] = ms; }
+			float	GetStageBudget(PhysicsStage stage) const { return stageBudgets[(int)stage]; }
+
+			void	SetIterationLimits(int minIterations, int maxIterations);
+
+			//Works out how many steps of stepDt to run for the time owed, lowering the
+			//iteration count to fit them if need be, and dropping any that still can't
+			//be afforded from accumulatedTime
+			int		BeginFrame(float& accumulatedTime, float stepDt);
+			//Takes the time each stage took over the frame's steps, in seconds
+			void	EndFrame(int stepsRun, const float* stageTimes);
+
+			int		GetIterationCount() const { return iterations; }
+			int		GetDroppedSteps() const { return droppedSteps; }
+
+			//Smoothed milliseconds per frame
+			float	GetStageTime(PhysicsStage stage) const { return stageFrameCosts[(int)stage]; }
+			//Whichever stage is furthest over its budget, or Max if none are
+			PhysicsStage GetOverBudgetStage() const;
+
+			static const char* GetStageName(PhysicsStage stage);
+
+		protected:
+			float	PredictStepCost(int iterationCount) const;
+			void	SetIterations(int count);
+
+			float	frameBudget;
+			float	stageBudgets[(int)PhysicsStage::Max];
+
+			float	stageStepCosts[(int)PhysicsStage::Max];		//ms per step
+			float	stageFrameCosts[(int)PhysicsStage::Max];	//ms per frame
+
+			int		minIterations;
+			int		maxIterations;
+			int		iterations;
+			int		droppedSteps;
+		};
+	}
+}
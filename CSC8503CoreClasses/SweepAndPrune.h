@@ -0,0 +1,265 @@
+#pragma once
+#include <algorithm>
+#include <functional>
+#include "Vector3.h"
+
+namespace NCL {
+	using namespace NCL::Maths;
+	namespace GameDemo {
+		/*
+		A single interval endpoint along one axis. The owning proxy and whether
+		this is the min or max end are packed together, to keep the sorted arrays
+		as small as possible.
+		*/
+		struct SweepEndpoint {
+			float	value;
+			int		data;	//proxy << 1 | isMax
+
+			int		GetProxy() const { return data >> 1; }
+			bool	IsMax() const { return (data & 1) != 0; }
+
+			bool operator < (const SweepEndpoint& other) const {
+				//min ends go first on ties so that touching boxes still overlap
+				return value < other.value || (value == other.value && (data & 1) < (other.data & 1));
+			}
+		};
+
+		template<class T>
+		struct SweepProxy {
+			Vector3 boxMin;
+			Vector3 boxMax;
+			T		object	= T();
+			int		stamp	= 0;
+			int		active	= -1;	//slot in the active list during a sweep, or the free list link
+			bool	inUse	= false;
+			bool	isFree	= false;
+		};
+
+		/*
+		Sort and sweep broadphase. Each axis keeps an array of box endpoints, which
+		stays sorted between steps - when objects only move a little, the arrays are
+		nearly sorted already, so an insertion sort fixes them up in close to linear
+		time. Newly added objects are sorted on their own and merged in. Pairs are then
+		found by sweeping along whichever axis the objects are most spread out on,
+		testing the other two axes directly.
+		*/
+		template<class T>
+		class SweepAndPrune {
+		public:
+			typedef std::function<void(T&, T&)> SweepPairFunc;
+
+			SweepAndPrune() {
+				freeList	= -1;
+				proxyCount	= 0;
+				removed		= false;
+				for (int i = 0; i < 3; ++i) {
+					sortedCount[i] = 0;
+				}
+			}
+			~SweepAndPrune() {
+			}
+
+			void Clear() {
+				proxies.clear();
+				for (int i = 0; i < 3; ++i) {
+					axes[i].clear();
+					sortedCount[i] = 0;
+				}
+				freeList	= -1;
+				proxyCount	= 0;
+				removed		= false;
+			}
+
+			int Insert(T object, const Vector3& pos, const Vector3& halfSize) {
+				int proxy;
+				if (freeList >= 0) {
+					proxy		= freeList;
+					freeList	= proxies[proxy].active;
+				}
+				else {
+					proxy = (int)proxies.size();
+					proxies.emplace_back();
+				}
+				SweepProxy<T>& p = proxies[proxy];
+				p.object	= object;
+				p.inUse		= true;
+				p.isFree	= false;
+				p.active	= -1;
+				p.boxMin	= pos - halfSize;
+				p.boxMax	= pos + halfSize;
+
+				for (int i = 0; i < 3; ++i) {
+					axes[i].push_back({ p.boxMin[i], proxy << 1 });
+					axes[i].push_back({ p.boxMax[i], (proxy << 1) | 1 });
+				}
+				proxyCount++;
+				return proxy;
+			}
+
+			void Update(int proxy, const Vector3& pos, const Vector3& halfSize) {
+				proxies[proxy].boxMin = pos - halfSize;
+				proxies[proxy].boxMax = pos + halfSize;
+			}
+
+			//The proxy is only reused once its endpoints have been purged from the axes
+			void Remove(int proxy) {
+				proxies[proxy].inUse	= false;
+				proxies[proxy].object	= T();
+				proxyCount--;
+				removed = true;
+			}
+
+			bool IsValid(int proxy, const T& object) const {
+				if (proxy < 0 || proxy >= (int)proxies.size()) {
+					return false;
+				}
+				return proxies[proxy].inUse && proxies[proxy].object == object;
+			}
+
+			void SetStamp(int proxy, int stamp) {
+				proxies[proxy].stamp = stamp;
+			}
+
+			void RemoveStale(int stamp) {
+				for (int i = 0; i < (int)proxies.size(); ++i) {
+					if (proxies[i].inUse && proxies[i].stamp != stamp) {
+						Remove(i);
+					}
+				}
+			}
+
+			int GetProxyCount() const {
+				return proxyCount;
+			}
+
+			void OperateOnPairs(SweepPairFunc func) {
+				if (removed) {
+					RemoveDeadEndpoints();
+				}
+				for (int i = 0; i < 3; ++i) {
+					RefreshEndpoints(axes[i], i);
+					SortAxis(i);
+				}
+
+				int axis = ChooseSweepAxis();
+				int otherA = (axis + 1) % 3;
+				int otherB = (axis + 2) % 3;
+
+				activeList.clear();
+				for (const SweepEndpoint& e : axes[axis]) {
+					int proxy = e.GetProxy();
+					SweepProxy<T>& p = proxies[proxy];
+					if (e.IsMax()) {
+						//swap remove from the active list
+						int slot = p.active;
+						int last = activeList.back();
+						activeList[slot]		= last;
+						proxies[last].active	= slot;
+						activeList.pop_back();
+						p.active = -1;
+						continue;
+					}
+					for (int other : activeList) {
+						SweepProxy<T>& o = proxies[other];
+						if (p.boxMin[otherA] <= o.boxMax[otherA] && p.boxMax[otherA] >= o.boxMin[otherA] &&
+							p.boxMin[otherB] <= o.boxMax[otherB] && p.boxMax[otherB] >= o.boxMin[otherB]) {
+							func(o.object, p.object);
+						}
+					}
+					p.active = (int)activeList.size();
+					activeList.push_back(proxy);
+				}
+			}
+
+		protected:
+			void RefreshEndpoints(std::vector<SweepEndpoint>& endpoints, int axis) {
+				for (SweepEndpoint& e : endpoints) {
+					const SweepProxy<T>& p = proxies[e.GetProxy()];
+					e.value = e.IsMax() ? p.boxMax[axis] : p.boxMin[axis];
+				}
+			}
+
+			//Endpoints past sortedCount were added since the last step, and could belong
+			//anywhere - they're sorted separately rather than walked down one at a time
+			void SortAxis(int axis) {
+				std::vector<SweepEndpoint>& endpoints = axes[axis];
+				auto split = endpoints.begin() + sortedCount[axis];
+				InsertionSort(endpoints, sortedCount[axis]);
+				if (split != endpoints.end()) {
+					std::sort(split, endpoints.end());
+					std::inplace_merge(endpoints.begin(), split, endpoints.end());
+				}
+				sortedCount[axis] = (int)endpoints.size();
+			}
+
+			static void InsertionSort(std::vector<SweepEndpoint>& endpoints, int count) {
+				for (int i = 1; i < count; ++i) {
+					SweepEndpoint key = endpoints[i];
+					int j = i - 1;
+					while (j >= 0 && key < endpoints[j]) {
+						endpoints[j + 1] = endpoints[j];
+						--j;
+					}
+					endpoints[j + 1] = key;
+				}
+			}
+
+			void RemoveDeadEndpoints() {
+				for (int i = 0; i < 3; ++i) {
+					int write = 0;
+					int sortedWrite = 0;
+					for (int read = 0; read < (int)axes[i].size(); ++read) {
+						if (!proxies[axes[i][read].GetProxy()].inUse) {
+							continue;
+						}
+						if (read < sortedCount[i]) {
+							sortedWrite++;
+						}
+						axes[i][write++] = axes[i][read];
+					}
+					axes[i].resize(write);
+					sortedCount[i] = sortedWrite;
+				}
+				for (int i = 0; i < (int)proxies.size(); ++i) {
+					if (!proxies[i].inUse && !proxies[i].isFree) {
+						proxies[i].isFree = true;
+						proxies[i].active = freeList;
+						freeList = i;
+					}
+				}
+				removed = false;
+			}
+
+			//Sweeping along the axis with the most spread produces the fewest false overlaps
+			int ChooseSweepAxis() const {
+				if (proxyCount == 0) {
+					return 0;
+				}
+				Vector3 sum;
+				Vector3 sumSq;
+				for (const SweepProxy<T>& p : proxies) {
+					if (!p.inUse) {
+						continue;
+					}
+					Vector3 centre = (p.boxMin + p.boxMax) * 0.5f;
+					sum		+= centre;
+					sumSq	+= centre * centre;
+				}
+				Vector3 variance = sumSq - (sum * sum) / (float)proxyCount;
+				int axis = 0;
+				if (variance.y > variance[axis]) { axis = 1; }
+				if (variance.z > variance[axis]) { axis = 2; }
+				return axis;
+			}
+
+			std::vector<SweepProxy<T>>	proxies;
+			std::vector<SweepEndpoint>	axes[3];
+			std::vector<int>			activeList;
+
+			int		sortedCount[3];
+			int		freeList;
+			int		proxyCount;
+			bool	removed;
+		};
+	}
+}
@@ -4,33 +4,42 @@ using namespace NCL::GameDemo;
 
 Transform::Transform()	{
 	scale = Vector3(1, 1, 1);
+	axes[0] = Vector3(1, 0, 0);
+	axes[1] = Vector3(0, 1, 0);
+	axes[2] = Vector3(0, 0, 1);
+	matrixDirty = true;
 }
 
 Transform::~Transform()	{
 
 }
 
-void Transform::UpdateMatrix() {
+void Transform::UpdateMatrix() const {
 	matrix =
 		Matrix4::Translation(position) *
 		Matrix4(orientation) *
 		Matrix4::Scale(scale);
+	matrixDirty = false;
 }
 
 Transform& Transform::SetPosition(const Vector3& worldPos) {
 	position = worldPos;
-	UpdateMatrix();
+	matrixDirty = true;
 	return *this;
 }
 
 Transform& Transform::SetScale(const Vector3& worldScale) {
 	scale = worldScale;
-	UpdateMatrix();
+	matrixDirty = true;
 	return *this;
 }
 
 Transform& Transform::SetOrientation(const Quaternion& worldOrientation) {
 	orientation = worldOrientation;
-	UpdateMatrix();
+	Matrix3 rotation(orientation);
+	for (int i = 0; i < 3; ++i) {
+		axes[i] = Vector3(rotation.array[i][0], rotation.array[i][1], rotation.array[i][2]);
+	}
+	matrixDirty = true;
 	return *this;
 }
\ No newline at end of file
@@ -28,7 +28,12 @@ namespace NCL {
 				return orientation;
 			}
 
+			//The matrix is only rebuilt when it's asked for, so a body can be
+			//moved many times during a physics update for the cost of one rebuild
 			Matrix4 GetMatrix() const {
+				if (matrixDirty) {
+					UpdateMatrix();
+				}
 				return matrix;
 			}
 
@@ -36,10 +41,19 @@ namespace NCL {
 				return orientation * Vector3(0, 0, -1);
 			}
 
-			void UpdateMatrix();
+			//The orientation's local x, y and z axes in world space. Unlike the matrix
+			//these are rebuilt as soon as the orientation is set, so that the physics
+			//threads can all read them during a step without racing to rebuild them
+			const Vector3& GetAxis(int axis) const {
+				return axes[axis];
+			}
+
+			void UpdateMatrix() const;
 		protected:
-			Matrix4		matrix;
+			mutable Matrix4	matrix;
+			mutable bool	matrixDirty;
 			Quaternion	orientation;
+			Vector3		axes[3];
 			Vector3		position;
 
 			Vector3		scale;
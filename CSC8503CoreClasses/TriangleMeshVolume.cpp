@@ -0,0 +1,121 @@
+#include "TriangleMeshVolume.h"
+#include "MeshGeometry.h"
+
+using namespace NCL;
+using GameDemo::BoxTests;
+
+TriangleMeshVolume::TriangleMeshVolume(const MeshGeometry& mesh, const Vector3& scale) {
+	type = VolumeType::Mesh;
+
+	if (mesh.GetPrimitiveType() != GeometryPrimitive::Triangles || mesh.GetVertexCount() == 0) {
+		return;
+	}
+	for (const Vector3& position : mesh.GetPositionData()) {
+		vertices.push_back(position * scale);
+	}
+	//Meshes without indices just use their vertices in order
+	indices = mesh.GetIndexData();
+	if (indices.empty()) {
+		for (unsigned int i = 0; i < mesh.GetVertexCount(); ++i) {
+			indices.push_back(i);
+		}
+	}
+	indices.resize(indices.size() - indices.size() % 3);
+	if (indices.empty()) {
+		return;
+	}
+
+	boundsMin = vertices[0];
+	boundsMax = vertices[0];
+	for (const Vector3& v : vertices) {
+		boundsMin = BoxTests::Min(boundsMin, v);
+		boundsMax = BoxTests::Max(boundsMax, v);
+	}
+	halfSizes = BoxTests::Max(-boundsMin, boundsMax);
+
+	Vector3 extent = boundsMax - boundsMin;
+	for (int i = 0; i < 3; ++i) {
+		quantize[i]		= extent[i] > 0.0f ? 65535.0f / extent[i] : 0.0f;
+		dequantize[i]	= extent[i] / 65535.0f;
+	}
+
+	int triangleCount = GetTriangleCount();
+	std::vector<Vector3>		boxes(triangleCount * 2);
+	std::vector<unsigned int>	order(triangleCount);
+	for (int i = 0; i < triangleCount; ++i) {
+		const Vector3& a = vertices[indices[i * 3]];
+		const Vector3& b = vertices[indices[i * 3 + 1]];
+		const Vector3& c = vertices[indices[i * 3 + 2]];
+		boxes[i * 2]		= BoxTests::Min(a, BoxTests::Min(b, c));
+		boxes[i * 2 + 1]	= BoxTests::Max(a, BoxTests::Max(b, c));
+		order[i] = i;
+	}
+	nodes.reserve(2 * (triangleCount / TRIANGLE_MESH_LEAF_SIZE + 1));
+	BuildNode(boxes, order, 0, triangleCount);
+
+	//The triangles are then put in the order the leaves ended up in
+	std::vector<unsigned int> sorted(indices.size());
+	for (int i = 0; i < triangleCount; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			sorted[i * 3 + j] = indices[order[i] * 3 + j];
+		}
+	}
+	indices.swap(sorted);
+}
+
+/*
+Built just like a StaticBVH, splitting at the median along the axis the triangles'
+centres are most spread out on, with a stable sort so the same mesh always makes
+the same tree.
+*/
+int TriangleMeshVolume::BuildNode(std::vector<Vector3>& boxes, std::vector<unsigned int>& order, int first, int last) {
+	int index = (int)nodes.size();
+	nodes.emplace_back();
+
+	Vector3 boxMin		= boxes[order[first] * 2];
+	Vector3 boxMax		= boxes[order[first] * 2 + 1];
+	Vector3 centreMin	= boxMin + boxMax;
+	Vector3 centreMax	= centreMin;
+	for (int i = first + 1; i < last; ++i) {
+		const Vector3& itemMin = boxes[order[i] * 2];
+		const Vector3& itemMax = boxes[order[i] * 2 + 1];
+		boxMin		= BoxTests::Min(boxMin, itemMin);
+		boxMax		= BoxTests::Max(boxMax, itemMax);
+		centreMin	= BoxTests::Min(centreMin, itemMin + itemMax);
+		centreMax	= BoxTests::Max(centreMax, itemMin + itemMax);
+	}
+	Quantize(boxMin, boxMax, nodes[index].boxMin, nodes[index].boxMax);
+
+	int count = last - first;
+	if (count <= TRIANGLE_MESH_LEAF_SIZE) {
+		nodes[index].offset	= first;
+		nodes[index].count	= count;
+		return index;
+	}
+	Vector3 spread = centreMax - centreMin;
+	int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+	std::stable_sort(order.begin() + first, order.begin() + last,
+		[&](unsigned int a, unsigned int b) {
+			return boxes[a * 2][axis] + boxes[a * 2 + 1][axis] < boxes[b * 2][axis] + boxes[b * 2 + 1][axis];
+		});
+
+	int middle = first + count / 2;
+	BuildNode(boxes, order, first, middle);
+	int second = BuildNode(boxes, order, middle, last);
+	nodes[index].offset	= second;
+	nodes[index].count	= 0;
+	return index;
+}
+
+bool TriangleMeshVolume::Quantize(const Vector3& queryMin, const Vector3& queryMax, unsigned short* quantizedMin, unsigned short* quantizedMax) const {
+	for (int i = 0; i < 3; ++i) {
+		if (queryMax[i] < boundsMin[i] || queryMin[i] > boundsMax[i]) {
+			return false;
+		}
+		float low	= floorf((queryMin[i] - boundsMin[i]) * quantize[i]);
+		float high	= ceilf((queryMax[i] - boundsMin[i]) * quantize[i]);
+		quantizedMin[i] = (unsigned short)std::max(low, 0.0f);
+		quantizedMax[i] = (unsigned short)std::min(high, 65535.0f);
+	}
+	return true;
+}
@@ -0,0 +1,165 @@
+#pragma once
+#include "CollisionVolume.h"
+#include "BoxTests.h"
+
+namespace NCL {
+	using namespace NCL::Maths;
+	class MeshGeometry;
+
+	//Leaves are split until they hold no more than this many triangles
+	const int TRIANGLE_MESH_LEAF_SIZE = 4;
+	//Splits are at the median, so this is deep enough for far more triangles than will fit in memory
+	const int TRIANGLE_MESH_STACK_SIZE = 64;
+
+	/*
+	A node of a triangle mesh's tree, squeezed into 16 bytes so four fit in a cache line.
+	Its box is stored as 16 bit fractions of the way across the whole mesh's bounds,
+	always rounded outwards, so it can only ever be a little bigger than the real one.
+	As in a StaticBVH, nodes are stored depth first - a branch's first child is the node
+	straight after it, and offset is its second child, or a leaf's first triangle.
+	*/
+	struct TriangleMeshNode {
+		unsigned short	boxMin[3];
+		unsigned short	boxMax[3];
+		unsigned int	offset	: 29;
+		unsigned int	count	: 3;	//0 for a branch
+	};
+
+	/*
+	Arbitrary level geometry, made from the positions and indices of a triangle list
+	MeshGeometry. The triangles are kept in the mesh's own local space, along with a
+	tree over them with quantized boxes, so only the few triangles near whatever is
+	touching it ever get looked at.
+
+	Triangles are two sided, so a mesh doesn't have to be closed - but nothing stops
+	something going right through it if it's thinner than what's hitting it.
+	*/
+	class TriangleMeshVolume : CollisionVolume
+	{
+	public:
+		//Only triangle list meshes are read - anything else gives an empty volume
+		TriangleMeshVolume(const MeshGeometry& mesh, const Vector3& scale = Vector3(1, 1, 1));
+		~TriangleMeshVolume() {
+		}
+
+		//Of a box around the volume's origin that holds all of its triangles
+		Vector3 GetHalfDimensions() const {
+			return halfSizes;
+		}
+
+		int GetTriangleCount() const {
+			return (int)indices.size() / 3;
+		}
+
+		int GetNodeCount() const {
+			return (int)nodes.size();
+		}
+
+		//Calls func with the corners of every triangle whose box overlaps the given one
+		template<class F>
+		void GetTriangles(const Vector3& queryMin, const Vector3& queryMax, F func) const {
+			unsigned short quantizedMin[3];
+			unsigned short quantizedMax[3];
+			if (nodes.empty() || !Quantize(queryMin, queryMax, quantizedMin, quantizedMax)) {
+				return;
+			}
+			int stack[TRIANGLE_MESH_STACK_SIZE];
+			int count = 0;
+			stack[count++] = 0;
+			while (count > 0) {
+				int index = stack[--count];
+				const TriangleMeshNode& n = nodes[index];
+				if (n.boxMin[0] > quantizedMax[0] || n.boxMax[0] < quantizedMin[0] ||
+					n.boxMin[1] > quantizedMax[1] || n.boxMax[1] < quantizedMin[1] ||
+					n.boxMin[2] > quantizedMax[2] || n.boxMax[2] < quantizedMin[2]) {
+					continue;
+				}
+				if (n.count == 0) {
+					stack[count++] = n.offset;
+					stack[count++] = index + 1;
+					continue;
+				}
+				for (int i = n.offset, last = n.offset + n.count; i < last; ++i) {
+					func(vertices[indices[i * 3]], vertices[indices[i * 3 + 1]], vertices[indices[i * 3 + 2]]);
+				}
+			}
+		}
+
+		//Calls func with the triangles of every leaf the ray passes through, nearest leaves
+		//first, with func returning the new maxDistance
+		template<class F>
+		void Raycast(const Vector3& origin, const Vector3& direction, float maxDistance, F func) const {
+			if (nodes.empty()) {
+				return;
+			}
+			Vector3 inverse(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+			int		stack[TRIANGLE_MESH_STACK_SIZE];
+			float	entries[TRIANGLE_MESH_STACK_SIZE];
+			int		count = 0;
+
+			float entry;
+			if (RayNode(origin, inverse, maxDistance, nodes[0], entry)) {
+				stack[count]	= 0;
+				entries[count]	= entry;
+				count++;
+			}
+			while (count > 0) {
+				count--;
+				if (entries[count] > maxDistance) {
+					continue;
+				}
+				int index = stack[count];
+				const TriangleMeshNode& n = nodes[index];
+				if (n.count > 0) {
+					for (int i = n.offset, last = n.offset + n.count; i < last; ++i) {
+						maxDistance = func(vertices[indices[i * 3]], vertices[indices[i * 3 + 1]], vertices[indices[i * 3 + 2]], maxDistance);
+					}
+					continue;
+				}
+				int		first = index + 1;
+				float	firstEntry;
+				float	secondEntry;
+				bool	hitFirst	= RayNode(origin, inverse, maxDistance, nodes[first], firstEntry);
+				bool	hitSecond	= RayNode(origin, inverse, maxDistance, nodes[n.offset], secondEntry);
+				//The nearer child goes on last, so it comes off first
+				bool firstNearer = firstEntry <= secondEntry;
+				if (hitFirst && hitSecond) {
+					stack[count]		= firstNearer ? n.offset : first;
+					entries[count]		= firstNearer ? secondEntry : firstEntry;
+					stack[count + 1]	= firstNearer ? first : n.offset;
+					entries[count + 1]	= firstNearer ? firstEntry : secondEntry;
+					count += 2;
+				}
+				else if (hitFirst || hitSecond) {
+					stack[count]	= hitFirst ? first : n.offset;
+					entries[count]	= hitFirst ? firstEntry : secondEntry;
+					count++;
+				}
+			}
+		}
+
+	protected:
+		int BuildNode(std::vector<Vector3>& boxes, std::vector<unsigned int>& order, int first, int last);
+
+		//Rounds a local space box outwards onto the quantized grid, returning false if it
+		//misses the mesh's bounds entirely
+		bool Quantize(const Vector3& queryMin, const Vector3& queryMax, unsigned short* quantizedMin, unsigned short* quantizedMax) const;
+
+		bool RayNode(const Vector3& origin, const Vector3& inverse, float maxDistance, const TriangleMeshNode& node, float& entry) const {
+			Vector3 nodeMin(node.boxMin[0], node.boxMin[1], node.boxMin[2]);
+			Vector3 nodeMax(node.boxMax[0], node.boxMax[1], node.boxMax[2]);
+			return GameDemo::BoxTests::RayBox(origin, inverse, maxDistance, boundsMin + nodeMin * dequantize, boundsMin + nodeMax * dequantize, entry);
+		}
+
+		std::vector<TriangleMeshNode>	nodes;
+		std::vector<Vector3>			vertices;
+		std::vector<unsigned int>		indices;	//Three per triangle, in the order the tree's leaves use them
+
+		Vector3 boundsMin;
+		Vector3 boundsMax;
+		Vector3 quantize;	//From local space to quantized units
+		Vector3 dequantize;	//And back again
+		Vector3 halfSizes;
+	};
+}
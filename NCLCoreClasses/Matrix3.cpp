@@ -131,8 +131,10 @@ Matrix3 Matrix3::Scale( const Vector3 &scale )	{
 }
 
 void	Matrix3::ToZero()	{
-	for(int i = 0; i < 9; ++i) {
-		array[0][0] = 0.0f;
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			array[i][j] = 0.0f;
+		}
 	}
 }
 